@@ -63,6 +63,7 @@ SOURCES +=\
     src/initiation/transport/tcpconnection.cpp \
     src/kvazzupcontroller.cpp \
     src/main.cpp \
+    src/media/delivery/congestioncontroller.cpp \
     src/media/delivery/delivery.cpp \
     src/media/delivery/uvgrtpreceiver.cpp \
     src/media/delivery/uvgrtpsender.cpp \
@@ -70,17 +71,26 @@ SOURCES +=\
     src/media/processing/aecinputfilter.cpp \
     src/media/processing/aecprocessor.cpp \
     src/media/processing/audiocapturefilter.cpp \
+    src/media/processing/audiojitterbuffer.cpp \
     src/media/processing/audiomixerfilter.cpp \
     src/media/processing/audiooutputdevice.cpp \
+    src/media/processing/audioresampler.cpp \
     src/media/processing/camerafilter.cpp \
     src/media/processing/cameraframegrabber.cpp \
     src/media/processing/displayfilter.cpp \
+    src/media/processing/downscalefilter.cpp \
     src/media/processing/filter.cpp \
     src/media/processing/filtergraph.cpp \
+    src/media/processing/filterscheduler.cpp \
+    src/media/processing/filtertracer.cpp \
+    src/media/processing/framepool.cpp \
+    src/media/processing/inputqueue.cpp \
     src/media/processing/kvazaarfilter.cpp \
+    src/media/processing/kvazaarpicturepool.cpp \
+    src/media/processing/layerselectorfilter.cpp \
     src/media/processing/openhevcfilter.cpp \
-    src/media/processing/opusdecoderfilter.cpp \
     src/media/processing/opusencoderfilter.cpp \
+    src/media/processing/resamplefilter.cpp \
     src/media/processing/rgb32toyuv.cpp \
     src/media/processing/scalefilter.cpp \
     src/media/processing/screensharefilter.cpp \
@@ -91,9 +101,9 @@ SOURCES +=\
     src/ui/gui/conferenceview.cpp \
     src/ui/gui/contactlist.cpp \
     src/ui/gui/contactlistitem.cpp \
+    src/ui/gui/presentationscheduler.cpp \
     src/ui/gui/statisticswindow.cpp \
     src/ui/gui/videodrawhelper.cpp \
-    src/ui/gui/videoglwidget.cpp \
     src/ui/gui/videoviewfactory.cpp \
     src/ui/gui/videowidget.cpp \
     src/ui/gui/videoyuvwidget.cpp \
@@ -141,6 +151,7 @@ HEADERS  += \
     src/initiation/transport/siptransport.h \
     src/initiation/transport/tcpconnection.h \
     src/kvazzupcontroller.h \
+    src/media/delivery/congestioncontroller.h \
     src/media/delivery/delivery.h \
     src/media/delivery/uvgrtpreceiver.h \
     src/media/delivery/uvgrtpsender.h \
@@ -148,22 +159,37 @@ HEADERS  += \
     src/media/processing/aecinputfilter.h \
     src/media/processing/aecprocessor.h \
     src/media/processing/audiocapturefilter.h \
+    src/media/processing/audiojitterbuffer.h \
     src/media/processing/audiomixerfilter.h \
     src/media/processing/audiooutputdevice.h \
+    src/media/processing/audioresampler.h \
     src/media/processing/camerafilter.h \
     src/media/processing/cameraframegrabber.h \
     src/media/processing/displayfilter.h \
+    src/media/processing/downscalefilter.h \
     src/media/processing/filter.h \
     src/media/processing/filtergraph.h \
+    src/media/processing/filterscheduler.h \
+    src/media/processing/filtertracer.h \
+    src/media/processing/framepool.h \
+    src/media/processing/inputqueue.h \
     src/media/processing/kvazaarfilter.h \
+    src/media/processing/kvazaarpicturepool.h \
+    src/media/processing/layerselectorfilter.h \
     src/media/processing/openhevcfilter.h \
+    src/media/processing/optimized/audiomix.h \
+    src/media/processing/optimized/cpufeatures.h \
+    src/media/processing/optimized/resample.h \
     src/media/processing/optimized/rgb2yuv.h \
     src/media/processing/optimized/yuv2rgb.h \
-    src/media/processing/opusdecoderfilter.h \
+    src/media/processing/optimized/yuvrepack.h \
+    src/media/processing/optimized/yuvscale.h \
     src/media/processing/opusencoderfilter.h \
+    src/media/processing/resamplefilter.h \
     src/media/processing/rgb32toyuv.h \
     src/media/processing/scalefilter.h \
     src/media/processing/screensharefilter.h \
+    src/media/processing/sequenceextender.h \
     src/media/processing/yuvtorgb32.h \
     src/serverstatusview.h \
     src/statisticsinterface.h \
@@ -175,9 +201,9 @@ HEADERS  += \
     src/ui/gui/conferenceview.h \
     src/ui/gui/contactlist.h \
     src/ui/gui/contactlistitem.h \
+    src/ui/gui/presentationscheduler.h \
     src/ui/gui/statisticswindow.h \
     src/ui/gui/videodrawhelper.h \
-    src/ui/gui/videoglwidget.h \
     src/ui/gui/videointerface.h \
     src/ui/gui/videoviewfactory.h \
     src/ui/gui/videowidget.h \
@@ -0,0 +1,302 @@
+#include "benchmarkstatistics.h"
+
+#include <QMutexLocker>
+
+#include <cstdio>
+
+
+BenchmarkStatistics::BenchmarkStatistics():
+  mutex_(),
+  nextFilterID_(1),
+  filters_(),
+  videoEncodedBytes_(0),
+  audioEncodedBytes_(0),
+  sentBytes_(0),
+  sentPackets_(0),
+  receivedBytes_(0),
+  receivedPackets_(0),
+  minEstimate_(0),
+  maxLoss_(0.0f)
+{}
+
+
+void BenchmarkStatistics::reset()
+{
+  QMutexLocker lock(&mutex_);
+
+  for (auto& filter : filters_)
+  {
+    filter.second.usageSum = 0;
+    filter.second.usageReports = 0;
+    filter.second.dropped = 0;
+    filter.second.maxBuffer = 0;
+  }
+
+  videoEncodedBytes_ = 0;
+  audioEncodedBytes_ = 0;
+  sentBytes_ = 0;
+  sentPackets_ = 0;
+  receivedBytes_ = 0;
+  receivedPackets_ = 0;
+  minEstimate_ = 0;
+  maxLoss_ = 0.0f;
+}
+
+
+void BenchmarkStatistics::print(double seconds)
+{
+  QMutexLocker lock(&mutex_);
+
+  printf("\n%-28s %-12s %8s %8s %10s\n", "Filter", "Identifier", "CPU %", "Dropped", "Max queue");
+
+  uint64_t totalUsage = 0;
+  for (auto& filter : filters_)
+  {
+    const FilterStats& stats = filter.second;
+    double usage = stats.usageReports ? (double)stats.usageSum/stats.usageReports : 0.0;
+    totalUsage += stats.usageReports ? stats.usageSum/stats.usageReports : 0;
+
+    printf("%-28s %-12s %8.1f %8u %10u\n",
+           stats.name.toLocal8Bit().constData(), stats.identifier.toLocal8Bit().constData(),
+           usage, stats.dropped, stats.maxBuffer);
+  }
+  printf("%-28s %-12s %8llu\n", "Total", "", (unsigned long long)totalUsage);
+
+  if (seconds > 0)
+  {
+    printf("\nVideo bitrate: %.1f kbit/s, audio bitrate: %.1f kbit/s\n",
+           8*videoEncodedBytes_/seconds/1000, 8*audioEncodedBytes_/seconds/1000);
+    printf("Sent %u packets (%.1f kbit/s), received %u packets (%.1f kbit/s)\n",
+           sentPackets_, 8*sentBytes_/seconds/1000,
+           receivedPackets_, 8*receivedBytes_/seconds/1000);
+  }
+
+  if (minEstimate_ != 0)
+  {
+    printf("Lowest send bitrate estimate: %.1f kbit/s, highest reported loss: %.1f %%\n",
+           minEstimate_/1000.0, 100*maxLoss_);
+  }
+}
+
+
+void BenchmarkStatistics::addSession(uint32_t sessionID)
+{
+  Q_UNUSED(sessionID);
+}
+
+
+void BenchmarkStatistics::removeSession(uint32_t sessionID)
+{
+  Q_UNUSED(sessionID);
+}
+
+
+void BenchmarkStatistics::videoInfo(double framerate, QSize resolution)
+{
+  Q_UNUSED(framerate);
+  Q_UNUSED(resolution);
+}
+
+
+void BenchmarkStatistics::audioInfo(uint32_t sampleRate, uint16_t channelCount)
+{
+  Q_UNUSED(sampleRate);
+  Q_UNUSED(channelCount);
+}
+
+
+void BenchmarkStatistics::incomingMedia(uint32_t sessionID, QString name, QStringList& ipList,
+                                        QStringList& audioPorts, QStringList& videoPorts)
+{
+  Q_UNUSED(sessionID);
+  Q_UNUSED(name);
+  Q_UNUSED(ipList);
+  Q_UNUSED(audioPorts);
+  Q_UNUSED(videoPorts);
+}
+
+
+void BenchmarkStatistics::outgoingMedia(uint32_t sessionID, QString name, QStringList& ipList,
+                                        QStringList& audioPorts, QStringList& videoPorts)
+{
+  Q_UNUSED(sessionID);
+  Q_UNUSED(name);
+  Q_UNUSED(ipList);
+  Q_UNUSED(audioPorts);
+  Q_UNUSED(videoPorts);
+}
+
+
+void BenchmarkStatistics::sendDelay(QString type, uint32_t delay)
+{
+  Q_UNUSED(type);
+  Q_UNUSED(delay);
+}
+
+
+void BenchmarkStatistics::receiveDelay(uint32_t sessionID, QString type, int32_t delay)
+{
+  Q_UNUSED(sessionID);
+  Q_UNUSED(type);
+  Q_UNUSED(delay);
+}
+
+
+void BenchmarkStatistics::presentPackage(uint32_t sessionID, QString type)
+{
+  Q_UNUSED(sessionID);
+  Q_UNUSED(type);
+}
+
+
+void BenchmarkStatistics::updatePresentation(uint32_t sessionID, uint32_t dropped,
+                                             uint32_t repeated, uint16_t bufferDelay)
+{
+  // the benchmark has no video views
+  Q_UNUSED(sessionID);
+  Q_UNUSED(dropped);
+  Q_UNUSED(repeated);
+  Q_UNUSED(bufferDelay);
+}
+
+
+void BenchmarkStatistics::updateAudioBuffer(uint32_t sessionID, uint16_t depth,
+                                            uint16_t targetDelay, uint32_t concealed,
+                                            uint32_t discarded)
+{
+  // the benchmark does not play audio
+  Q_UNUSED(sessionID);
+  Q_UNUSED(depth);
+  Q_UNUSED(targetDelay);
+  Q_UNUSED(concealed);
+  Q_UNUSED(discarded);
+}
+
+
+void BenchmarkStatistics::addEncodedPacket(QString type, uint32_t size)
+{
+  QMutexLocker lock(&mutex_);
+  if (type == "video")
+  {
+    videoEncodedBytes_ += size;
+  }
+  else
+  {
+    audioEncodedBytes_ += size;
+  }
+}
+
+
+void BenchmarkStatistics::addSendPacket(uint16_t size)
+{
+  QMutexLocker lock(&mutex_);
+  sentBytes_ += size;
+  ++sentPackets_;
+}
+
+
+void BenchmarkStatistics::addReceivePacket(uint32_t sessionID, QString type, uint16_t size)
+{
+  Q_UNUSED(sessionID);
+  Q_UNUSED(type);
+
+  QMutexLocker lock(&mutex_);
+  receivedBytes_ += size;
+  ++receivedPackets_;
+}
+
+
+void BenchmarkStatistics::updateCongestionControl(uint32_t estimate, uint32_t videoBitrate,
+                                                  uint32_t audioBitrate, float loss, int32_t rtt)
+{
+  Q_UNUSED(videoBitrate);
+  Q_UNUSED(audioBitrate);
+  Q_UNUSED(rtt);
+
+  QMutexLocker lock(&mutex_);
+  if (minEstimate_ == 0 || estimate < minEstimate_)
+  {
+    minEstimate_ = estimate;
+  }
+  if (loss > maxLoss_)
+  {
+    maxLoss_ = loss;
+  }
+}
+
+
+uint32_t BenchmarkStatistics::addFilter(QString type, QString identifier, uint64_t TID)
+{
+  Q_UNUSED(TID);
+
+  QMutexLocker lock(&mutex_);
+  uint32_t id = nextFilterID_;
+  ++nextFilterID_;
+  filters_[id] = {type, identifier, 0, 0, 0, 0};
+  return id;
+}
+
+
+void BenchmarkStatistics::removeFilter(uint32_t id)
+{
+  // filters are kept so they can be printed after the graph is gone
+  Q_UNUSED(id);
+}
+
+
+void BenchmarkStatistics::updateBufferStatus(uint32_t id, uint16_t buffersize,
+                                             uint16_t maxBufferSize)
+{
+  Q_UNUSED(maxBufferSize);
+
+  QMutexLocker lock(&mutex_);
+  if (filters_.find(id) != filters_.end() && buffersize > filters_[id].maxBuffer)
+  {
+    filters_[id].maxBuffer = buffersize;
+  }
+}
+
+
+void BenchmarkStatistics::packetDropped(uint32_t id)
+{
+  QMutexLocker lock(&mutex_);
+  if (filters_.find(id) != filters_.end())
+  {
+    ++filters_[id].dropped;
+  }
+}
+
+
+void BenchmarkStatistics::updateBufferPool(uint32_t id, uint32_t hits, uint32_t misses)
+{
+  Q_UNUSED(id);
+  Q_UNUSED(hits);
+  Q_UNUSED(misses);
+}
+
+
+void BenchmarkStatistics::updateCPUUsage(uint32_t id, uint16_t usage)
+{
+  QMutexLocker lock(&mutex_);
+  if (filters_.find(id) != filters_.end())
+  {
+    filters_[id].usageSum += usage;
+    ++filters_[id].usageReports;
+  }
+}
+
+
+void BenchmarkStatistics::addSentSIPMessage(QString type, QString message, QString address)
+{
+  Q_UNUSED(type);
+  Q_UNUSED(message);
+  Q_UNUSED(address);
+}
+
+
+void BenchmarkStatistics::addReceivedSIPMessage(QString type, QString message, QString address)
+{
+  Q_UNUSED(type);
+  Q_UNUSED(message);
+  Q_UNUSED(address);
+}
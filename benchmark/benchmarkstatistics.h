@@ -0,0 +1,91 @@
+#pragma once
+
+#include "statisticsinterface.h"
+
+#include <QMutex>
+#include <QStringList>
+
+#include <map>
+
+// Collects the statistics the pipeline reports during a benchmark run.
+
+class BenchmarkStatistics : public StatisticsInterface
+{
+public:
+  BenchmarkStatistics();
+
+  // forget results so far, for example after warm up
+  void reset();
+
+  // prints CPU usage and drops of each filter and the network traffic
+  void print(double seconds);
+
+  virtual void addSession(uint32_t sessionID);
+  virtual void removeSession(uint32_t sessionID);
+
+  virtual void videoInfo(double framerate, QSize resolution);
+  virtual void audioInfo(uint32_t sampleRate, uint16_t channelCount);
+
+  virtual void incomingMedia(uint32_t sessionID, QString name, QStringList& ipList,
+                             QStringList& audioPorts, QStringList& videoPorts);
+  virtual void outgoingMedia(uint32_t sessionID, QString name, QStringList& ipList,
+                             QStringList& audioPorts, QStringList& videoPorts);
+
+  virtual void sendDelay(QString type, uint32_t delay);
+  virtual void receiveDelay(uint32_t sessionID, QString type, int32_t delay);
+  virtual void presentPackage(uint32_t sessionID, QString type);
+  virtual void updatePresentation(uint32_t sessionID, uint32_t dropped,
+                                  uint32_t repeated, uint16_t bufferDelay);
+  virtual void updateAudioBuffer(uint32_t sessionID, uint16_t depth, uint16_t targetDelay,
+                                 uint32_t concealed, uint32_t discarded);
+  virtual void addEncodedPacket(QString type, uint32_t size);
+
+  virtual void addSendPacket(uint16_t size);
+  virtual void addReceivePacket(uint32_t sessionID, QString type, uint16_t size);
+  virtual void updateCongestionControl(uint32_t estimate, uint32_t videoBitrate,
+                                       uint32_t audioBitrate, float loss, int32_t rtt);
+
+  virtual uint32_t addFilter(QString type, QString identifier, uint64_t TID);
+  virtual void removeFilter(uint32_t id);
+
+  virtual void updateBufferStatus(uint32_t id, uint16_t buffersize,
+                                  uint16_t maxBufferSize);
+  virtual void packetDropped(uint32_t id);
+  virtual void updateBufferPool(uint32_t id, uint32_t hits, uint32_t misses);
+  virtual void updateCPUUsage(uint32_t id, uint16_t usage);
+
+  virtual void addSentSIPMessage(QString type, QString message, QString address);
+  virtual void addReceivedSIPMessage(QString type, QString message, QString address);
+
+private:
+
+  struct FilterStats
+  {
+    QString name;
+    QString identifier;
+
+    // sum of the reported CPU usages and the number of reports
+    uint64_t usageSum;
+    uint32_t usageReports;
+
+    uint32_t dropped;
+    uint16_t maxBuffer;
+  };
+
+  QMutex mutex_;
+
+  uint32_t nextFilterID_;
+  std::map<uint32_t, FilterStats> filters_;
+
+  uint64_t videoEncodedBytes_;
+  uint64_t audioEncodedBytes_;
+
+  uint64_t sentBytes_;
+  uint32_t sentPackets_;
+  uint64_t receivedBytes_;
+  uint32_t receivedPackets_;
+
+  // lowest send bitrate estimate of the congestion control, 0 if none
+  uint32_t minEstimate_;
+  float maxLoss_;
+};
@@ -0,0 +1,313 @@
+#include "media/processing/optimized/cpufeatures.h"
+#include "media/processing/optimized/rgb2yuv.h"
+#include "media/processing/optimized/yuv2rgb.h"
+#include "media/processing/optimized/yuvscale.h"
+#include "media/processing/optimized/yuvrepack.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures the speed of the colour conversion, repacking and scaling kernels and
+// checks that they give the same result as the scalar reference.
+//
+// Usage: kernelbenchmark [name filter] [--time seconds] [--threads count]
+
+enum KernelType {RGB32_TO_YUV420, YUV420_TO_RGB32, NV12_TO_YUV420, YUYV_TO_YUV420, HALVE_YUV420};
+
+struct Kernel
+{
+  std::string name;
+  KernelType type;
+  SIMDLevel required;
+  bool threaded;
+
+  // input, output, width, height, threads
+  std::function<void(uint8_t*, uint8_t*, int, int, int)> run;
+
+  // the kernel does not work with all widths
+  int widthMultiple;
+};
+
+struct Resolution
+{
+  const char* name;
+  int width;
+  int height;
+};
+
+static const Resolution resolutions[] = {{"480p",  640,  480},
+                                         {"720p",  1280, 720},
+                                         {"1080p", 1920, 1080},
+                                         {"4K",    3840, 2160}};
+
+
+static std::vector<Kernel> createKernels()
+{
+  std::vector<Kernel> kernels = {
+    {"rgb2yuv_scalar",         RGB32_TO_YUV420, SIMD_NONE, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int) { rgb2yuv_scalar(in, out, w, h); }, 2},
+    {"rgb2yuv_i_sse41_single", RGB32_TO_YUV420, SIMD_SSE41, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int) { rgb2yuv_i_sse41_single(in, out, w, h); }, 4},
+    {"rgb2yuv_i_sse41",        RGB32_TO_YUV420, SIMD_SSE41, true,
+     [](uint8_t* in, uint8_t* out, int w, int h, int t) { rgb2yuv_i_sse41(in, out, w, h, t); }, 4},
+    {"rgb2yuv_i_avx2",         RGB32_TO_YUV420, SIMD_AVX2, true,
+     [](uint8_t* in, uint8_t* out, int w, int h, int t) { rgb2yuv_i_avx2(in, out, w, h, t); }, 2},
+    {"rgb2yuv_i_avx512bw",     RGB32_TO_YUV420, SIMD_AVX512BW, true,
+     [](uint8_t* in, uint8_t* out, int w, int h, int t) { rgb2yuv_i_avx512bw(in, out, w, h, t); }, 2},
+
+    {"yuv2rgb_scalar",         YUV420_TO_RGB32, SIMD_NONE, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int) { yuv2rgb_scalar(in, out, w, h); }, 2},
+    {"yuv2rgb_i_sse41",        YUV420_TO_RGB32, SIMD_SSE41, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int) { yuv2rgb_i_sse41(in, out, w, h); }, 16},
+    {"yuv2rgb_i_avx2_single",  YUV420_TO_RGB32, SIMD_AVX2, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int) { yuv2rgb_i_avx2_single(in, out, w, h); }, 16},
+    {"yuv2rgb_i_avx2",         YUV420_TO_RGB32, SIMD_AVX2, true,
+     [](uint8_t* in, uint8_t* out, int w, int h, int t) { yuv2rgb_i_avx2(in, out, w, h, t); }, 16},
+
+    {"nv12_to_i420_sse2",      NV12_TO_YUV420, SIMD_NONE, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int)
+     { nv12_to_i420_sse2(in, w, in + w*h, w, out, w, h); }, 2},
+    {"yuyv_to_i420_sse2",      YUYV_TO_YUV420, SIMD_NONE, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int) { yuyv_to_i420_sse2(in, 2*w, out, w, h); }, 2},
+
+    {"halve_yuv420_scalar",    HALVE_YUV420, SIMD_NONE, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int) { halve_yuv420_scalar(in, out, w, h); }, 4},
+    {"halve_yuv420_sse2",      HALVE_YUV420, SIMD_NONE, false,
+     [](uint8_t* in, uint8_t* out, int w, int h, int) { halve_yuv420_sse2(in, out, w, h); }, 4}
+  };
+
+  return kernels;
+}
+
+
+static size_t inputSize(KernelType type, int width, int height)
+{
+  switch (type)
+  {
+  case RGB32_TO_YUV420: return width*height*4;
+  case YUYV_TO_YUV420:  return width*height*2;
+  default:              return width*height*3/2;
+  }
+}
+
+
+static size_t outputSize(KernelType type, int width, int height)
+{
+  switch (type)
+  {
+  case YUV420_TO_RGB32: return width*height*4;
+  case HALVE_YUV420:    return halved_size(width, 1)*halved_size(height, 1)*3/2;
+  default:              return width*height*3/2;
+  }
+}
+
+
+// straightforward versions used for checking the results
+static void reference(KernelType type, uint8_t* input, uint8_t* output, int width, int height)
+{
+  switch (type)
+  {
+  case RGB32_TO_YUV420:
+  {
+    rgb2yuv_scalar(input, output, width, height);
+    break;
+  }
+  case YUV420_TO_RGB32:
+  {
+    yuv2rgb_scalar(input, output, width, height);
+    break;
+  }
+  case NV12_TO_YUV420:
+  {
+    uint8_t* uv = input + width*height;
+    memcpy(output, input, width*height);
+    for (int i = 0; i < width*height/4; ++i)
+    {
+      output[width*height + i] = uv[2*i];
+      output[width*height*5/4 + i] = uv[2*i + 1];
+    }
+    break;
+  }
+  case YUYV_TO_YUV420:
+  {
+    for (int y = 0; y < height; ++y)
+    {
+      for (int x = 0; x < width; ++x)
+      {
+        output[y*width + x] = input[2*(y*width + x)];
+      }
+    }
+    for (int y = 0; y < height/2; ++y)
+    {
+      for (int x = 0; x < width/2; ++x)
+      {
+        const uint8_t* top = input + 2*(2*y*width + 2*x);
+        const uint8_t* bottom = top + 2*width;
+        output[width*height + y*width/2 + x] = (top[1] + bottom[1] + 1) >> 1;
+        output[width*height*5/4 + y*width/2 + x] = (top[3] + bottom[3] + 1) >> 1;
+      }
+    }
+    break;
+  }
+  case HALVE_YUV420:
+  {
+    // each plane is averaged in 2x2 blocks
+    int planeWidths[3] = {width, width/2, width/2};
+    int planeHeights[3] = {height, height/2, height/2};
+    int outWidth = halved_size(width, 1);
+    int outHeight = halved_size(height, 1);
+    int outWidths[3] = {outWidth, outWidth/2, outWidth/2};
+    int outHeights[3] = {outHeight, outHeight/2, outHeight/2};
+
+    for (int p = 0; p < 3; ++p)
+    {
+      for (int y = 0; y < outHeights[p]; ++y)
+      {
+        for (int x = 0; x < outWidths[p]; ++x)
+        {
+          const uint8_t* top = input + (2*y)*planeWidths[p] + 2*x;
+          const uint8_t* bottom = top + planeWidths[p];
+          output[y*outWidths[p] + x] = (top[0] + top[1] + bottom[0] + bottom[1] + 2) >> 2;
+        }
+      }
+      input += planeWidths[p]*planeHeights[p];
+      output += outWidths[p]*outHeights[p];
+    }
+    break;
+  }
+  }
+}
+
+
+static uint64_t cycles()
+{
+  return __rdtsc();
+}
+
+
+int main(int argc, char* argv[])
+{
+  std::string filter = "";
+  double minTime = 0.5;
+  int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--time" && i + 1 < argc)
+    {
+      minTime = atof(argv[++i]);
+    }
+    else if (arg == "--threads" && i + 1 < argc)
+    {
+      maxThreads = std::max(1, atoi(argv[++i]));
+    }
+    else
+    {
+      filter = arg;
+    }
+  }
+
+  SIMDLevel simd = detectSIMDLevel();
+
+  printf("Instruction set: %s, threads: %d\n\n", simdLevelName(simd), maxThreads);
+  printf("%-24s %-6s %7s %10s %12s %10s %8s\n",
+         "Kernel", "Size", "Threads", "ms/frame", "Mpixels/s", "cycles/px", "Check");
+
+  std::mt19937 random(1234);
+  bool allCorrect = true;
+
+  for (const Kernel& kernel : createKernels())
+  {
+    if (!filter.empty() && kernel.name.find(filter) == std::string::npos)
+    {
+      continue;
+    }
+
+    if (kernel.required > simd)
+    {
+      printf("%-24s skipped, CPU does not support %s\n",
+             kernel.name.c_str(), simdLevelName(kernel.required));
+      continue;
+    }
+
+    for (const Resolution& resolution : resolutions)
+    {
+      int width = resolution.width;
+      int height = resolution.height;
+
+      if (width % kernel.widthMultiple != 0)
+      {
+        continue;
+      }
+
+      std::vector<uint8_t> input(inputSize(kernel.type, width, height));
+      std::vector<uint8_t> output(outputSize(kernel.type, width, height));
+      std::vector<uint8_t> expected(output.size());
+
+      for (uint8_t& byte : input)
+      {
+        byte = (uint8_t)random();
+      }
+
+      reference(kernel.type, input.data(), expected.data(), width, height);
+
+      std::vector<int> threadCounts = {1};
+      if (kernel.threaded && maxThreads > 1)
+      {
+        threadCounts.push_back(maxThreads);
+      }
+
+      for (int threads : threadCounts)
+      {
+        std::fill(output.begin(), output.end(), 0xAA);
+        kernel.run(input.data(), output.data(), width, height, threads);
+        bool correct = output == expected;
+        allCorrect = allCorrect && correct;
+
+        // warm up and then repeat until enough time has passed
+        kernel.run(input.data(), output.data(), width, height, threads);
+
+        int iterations = 0;
+        uint64_t startCycles = cycles();
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+
+        do
+        {
+          kernel.run(input.data(), output.data(), width, height, threads);
+          ++iterations;
+          elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < minTime || iterations < 5);
+
+        uint64_t usedCycles = cycles() - startCycles;
+        double pixels = (double)width*height*iterations;
+
+        printf("%-24s %-6s %7d %10.3f %12.1f %10.2f %8s\n",
+               kernel.name.c_str(), resolution.name, threads,
+               1000.0*elapsed/iterations, pixels/elapsed/1000000.0,
+               usedCycles/pixels, correct ? "ok" : "FAIL");
+      }
+    }
+  }
+
+  if (!allCorrect)
+  {
+    printf("\nSome kernels do not match the reference!\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,39 @@
+#-------------------------------------------------
+#
+# Benchmark for the colour conversion and scaling kernels.
+# Build and run separately from Kvazzup:
+#   qmake kernelbenchmark.pro && make && ./kernelbenchmark
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = kernelbenchmark
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    kernelbenchmark.cpp
+
+HEADERS += \
+    ../src/media/processing/optimized/cpufeatures.h \
+    ../src/media/processing/optimized/rgb2yuv.h \
+    ../src/media/processing/optimized/yuv2rgb.h \
+    ../src/media/processing/optimized/yuvrepack.h \
+    ../src/media/processing/optimized/yuvscale.h
+
+# The SIMD kernels select their instruction set with target attributes. The
+# file is compiled for the baseline CPU without auto-vectorisation so that
+# the scalar references stay scalar.
+win32-g++: QMAKE_CXXFLAGS += -fno-tree-vectorize -fopenmp
+win32-g++: LIBS += -fopenmp
+
+unix {
+  QMAKE_CXXFLAGS += -O3 -fno-tree-vectorize -fopenmp
+  QMAKE_LFLAGS += -fopenmp
+}
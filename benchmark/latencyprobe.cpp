@@ -0,0 +1,186 @@
+#include "latencyprobe.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// frames are not expected to take longer than this
+const int64_t MAX_LATENCY = 10000000;
+
+
+LatencyProbe::LatencyProbe():
+  frameNumber_(0),
+  sendTimes_(1 << BITS),
+  sent_(0),
+  resultMutex_(),
+  latencies_(),
+  unreadable_(0),
+  start_(now())
+{
+  for (auto& time : sendTimes_)
+  {
+    time = 0;
+  }
+}
+
+
+int64_t LatencyProbe::now() const
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+uint16_t LatencyProbe::nextFrame()
+{
+  uint16_t frame = (uint16_t)frameNumber_.fetch_add(1);
+  sendTimes_[frame] = now();
+  ++sent_;
+  return frame;
+}
+
+
+// the band is 2*BITS blocks wide, with the bits mirrored in the second half
+static void bandLayout(int width, int height, int& blockWidth, int& left, int& top, int& bottom)
+{
+  blockWidth = width/32;
+  left = (width - 32*blockWidth)/2;
+
+  int bandHeight = std::max(16, height/8);
+  top = height/2 - bandHeight/2;
+  bottom = top + bandHeight;
+}
+
+
+static bool bitOfBlock(uint16_t frame, int block)
+{
+  int bit = block < 16 ? block : 31 - block;
+  return (frame >> bit) & 1;
+}
+
+
+void LatencyProbe::stampRGB32(uint8_t* frame, int width, int height)
+{
+  uint16_t number = nextFrame();
+
+  int blockWidth, left, top, bottom;
+  bandLayout(width, height, blockWidth, left, top, bottom);
+
+  for (int y = top; y < bottom; ++y)
+  {
+    for (int block = 0; block < 32; ++block)
+    {
+      uint8_t value = bitOfBlock(number, block) ? 255 : 0;
+      memset(frame + 4*(y*width + left + block*blockWidth), value, 4*blockWidth);
+    }
+  }
+}
+
+
+void LatencyProbe::stampYUV420(uint8_t* frame, int width, int height)
+{
+  uint16_t number = nextFrame();
+
+  int blockWidth, left, top, bottom;
+  bandLayout(width, height, blockWidth, left, top, bottom);
+
+  uint8_t* u = frame + width*height;
+  uint8_t* v = u + width*height/4;
+
+  for (int y = top; y < bottom; ++y)
+  {
+    for (int block = 0; block < 32; ++block)
+    {
+      uint8_t value = bitOfBlock(number, block) ? 235 : 16;
+      memset(frame + y*width + left + block*blockWidth, value, blockWidth);
+    }
+  }
+
+  // no colour in the band
+  for (int y = top/2; y < bottom/2; ++y)
+  {
+    memset(u + y*width/2 + left/2, 128, 16*blockWidth);
+    memset(v + y*width/2 + left/2, 128, 16*blockWidth);
+  }
+}
+
+
+void LatencyProbe::frameDisplayed(const QImage& image)
+{
+  int64_t displayed = now();
+
+  int blockWidth, left, top, bottom;
+  bandLayout(image.width(), image.height(), blockWidth, left, top, bottom);
+
+  bool readable = blockWidth >= 2 && image.format() == QImage::Format_RGB32;
+  uint16_t number = 0;
+
+  for (int block = 0; readable && block < 16; ++block)
+  {
+    QRgb first = image.pixel(left + block*blockWidth + blockWidth/2, image.height()/2);
+    QRgb second = image.pixel(left + (31 - block)*blockWidth + blockWidth/2, image.height()/2);
+
+    bool firstBit = qGray(first) > 128;
+    bool secondBit = qGray(second) > 128;
+
+    // the mirrored half works as a checksum
+    if (firstBit != secondBit)
+    {
+      readable = false;
+    }
+    else if (firstBit)
+    {
+      number |= 1 << block;
+    }
+  }
+
+  int64_t latency = displayed - sendTimes_[number];
+
+  QMutexLocker lock(&resultMutex_);
+
+  if (!readable || latency < 0 || latency > MAX_LATENCY)
+  {
+    ++unreadable_;
+    return;
+  }
+
+  latencies_.push_back(latency);
+}
+
+
+void LatencyProbe::reset()
+{
+  QMutexLocker lock(&resultMutex_);
+  latencies_.clear();
+  unreadable_ = 0;
+  sent_ = 0;
+  start_ = now();
+}
+
+
+LatencyProbe::Results LatencyProbe::results()
+{
+  QMutexLocker lock(&resultMutex_);
+
+  Results results = {sent_.load(), (uint32_t)latencies_.size(), unreadable_,
+                     (now() - start_)/1000000.0, 0, 0, 0, 0};
+
+  if (!latencies_.empty())
+  {
+    std::vector<int64_t> sorted = latencies_;
+    std::sort(sorted.begin(), sorted.end());
+
+    auto percentile = [&sorted](double p)
+    {
+      size_t index = std::min(sorted.size() - 1, (size_t)(p*sorted.size()));
+      return sorted.at(index)/1000.0;
+    };
+
+    results.p50 = percentile(0.50);
+    results.p90 = percentile(0.90);
+    results.p99 = percentile(0.99);
+    results.max = sorted.back()/1000.0;
+  }
+
+  return results;
+}
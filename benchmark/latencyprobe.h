@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QMutex>
+#include <QImage>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Measures glass-to-glass latency by drawing the frame number into the
+// picture at the source and reading it back from the displayed picture.
+// The number is drawn as a band of black and white blocks in the middle of
+// the frame. The band is symmetric so flipping or mirroring the picture
+// does not change it, and large enough to survive the encoding.
+
+class LatencyProbe
+{
+public:
+  LatencyProbe();
+
+  // draws the number to an RGB32 picture and records the time
+  void stampRGB32(uint8_t* frame, int width, int height);
+
+  // draws the number to the luma of a YUV420 picture and records the time
+  void stampYUV420(uint8_t* frame, int width, int height);
+
+  // reads the number from a displayed picture and records the latency
+  void frameDisplayed(const QImage& image);
+
+  // forget results so far, for example after warm up
+  void reset();
+
+  struct Results
+  {
+    uint32_t sent;
+    uint32_t displayed;
+    uint32_t unreadable;
+    double seconds;
+
+    // in milliseconds
+    double p50;
+    double p90;
+    double p99;
+    double max;
+  };
+
+  Results results();
+
+private:
+
+  uint16_t nextFrame();
+
+  int64_t now() const;
+
+  static const int BITS = 16;
+
+  std::atomic<uint32_t> frameNumber_;
+
+  // send time of each frame number in microseconds
+  std::vector<std::atomic<int64_t>> sendTimes_;
+
+  std::atomic<uint32_t> sent_;
+
+  QMutex resultMutex_;
+  std::vector<int64_t> latencies_;
+  uint32_t unreadable_;
+  int64_t start_;
+};
@@ -0,0 +1,28 @@
+#include "nullview.h"
+
+#include "latencyprobe.h"
+
+
+NullView::NullView(LatencyProbe* probe):
+  probe_(probe)
+{}
+
+
+void NullView::setStats(StatisticsInterface* stats)
+{
+  Q_UNUSED(stats);
+}
+
+
+void NullView::inputImage(FrameBuffer data, QImage &image, int64_t timestamp)
+{
+  Q_UNUSED(data);
+  Q_UNUSED(timestamp);
+  probe_->frameDisplayed(image);
+}
+
+
+VideoFormat NullView::supportedFormat()
+{
+  return VIDEO_RGB32;
+}
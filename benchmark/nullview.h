@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ui/gui/videointerface.h"
+
+class LatencyProbe;
+
+// A video view that does not draw anything. The pictures are only given to
+// the latency probe.
+
+class NullView : public VideoInterface
+{
+public:
+  NullView(LatencyProbe* probe);
+
+  virtual void setStats(StatisticsInterface* stats);
+
+  virtual void inputImage(FrameBuffer data, QImage &image, int64_t timestamp);
+
+  virtual VideoFormat supportedFormat();
+
+private:
+
+  LatencyProbe* probe_;
+};
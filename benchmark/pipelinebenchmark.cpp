@@ -0,0 +1,263 @@
+#include "benchmarkstatistics.h"
+#include "latencyprobe.h"
+#include "nullview.h"
+#include "syntheticsource.h"
+
+#include "media/delivery/congestioncontroller.h"
+#include "media/delivery/delivery.h"
+#include "media/processing/filtergraph.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QHostAddress>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include <cstdio>
+
+// Runs the whole video pipeline of a call without a camera or a screen:
+// synthetic source -> conversion -> Kvazaar -> uvgRTP over loopback ->
+// OpenHEVC -> conversion -> null view. Prints the glass-to-glass latency,
+// the displayed framerate and the CPU usage of each filter.
+//
+// Usage: pipelinebenchmark [--duration seconds] [--warmup seconds] [--fps fps]
+//                          [--width width] [--height height] [--y4m file]
+//                          [--port port] [--qp qp] [--pool] [--layers count]
+
+struct Options
+{
+  int duration = 10;
+  int warmup = 2;
+  int fps = 30;
+  int width = 640;
+  int height = 480;
+  QString y4mFile = "";
+  uint16_t port = 18888;
+  int qp = 32;
+  bool pool = false;
+  int layers = 1;
+};
+
+
+static bool parseOptions(const QStringList& args, Options& options)
+{
+  for (int i = 1; i < args.size(); ++i)
+  {
+    QString arg = args.at(i);
+    bool hasValue = i + 1 < args.size();
+
+    if (arg == "--pool")
+    {
+      options.pool = true;
+    }
+    else if (!hasValue)
+    {
+      return false;
+    }
+    else if (arg == "--duration")
+    {
+      options.duration = args.at(++i).toInt();
+    }
+    else if (arg == "--warmup")
+    {
+      options.warmup = args.at(++i).toInt();
+    }
+    else if (arg == "--fps")
+    {
+      options.fps = args.at(++i).toInt();
+    }
+    else if (arg == "--width")
+    {
+      options.width = args.at(++i).toInt();
+    }
+    else if (arg == "--height")
+    {
+      options.height = args.at(++i).toInt();
+    }
+    else if (arg == "--y4m")
+    {
+      options.y4mFile = QDir::current().absoluteFilePath(args.at(++i));
+    }
+    else if (arg == "--port")
+    {
+      options.port = args.at(++i).toUShort();
+    }
+    else if (arg == "--qp")
+    {
+      options.qp = args.at(++i).toInt();
+    }
+    else if (arg == "--layers")
+    {
+      options.layers = args.at(++i).toInt();
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  return options.duration > 0 && options.fps > 0 && options.port != 0 &&
+      options.layers >= 1 && options.layers <= 3 &&
+      options.width > 0 && options.height > 0 && options.width % 8 == 0 && options.height % 8 == 0;
+}
+
+
+// the filters read their settings from kvazzup.ini in the working directory
+static void writeSettings(const Options& options)
+{
+  QSettings settings("kvazzup.ini", QSettings::IniFormat);
+
+  settings.setValue("video/Preset",            "ultrafast");
+  settings.setValue("video/kvzThreads",        "auto");
+  settings.setValue("video/OWF",               0);
+  settings.setValue("video/WPP",               1);
+  settings.setValue("video/Slices",            0);
+  settings.setValue("video/QP",                options.qp);
+  settings.setValue("video/Intra",             64);
+  settings.setValue("video/VPS",               1);
+  settings.setValue("video/bitrate",           0);
+  settings.setValue("video/rcAlgorithm",       "lambda");
+  settings.setValue("video/obaClipNeighbours", 0);
+  settings.setValue("video/scalingList",       0);
+  settings.setValue("video/lossless",          0);
+  settings.setValue("video/mvConstraint",      "none");
+  settings.setValue("video/qpInCU",            0);
+  settings.setValue("video/vaq",               "off");
+  settings.setValue("video/ResolutionWidth",   options.width);
+  settings.setValue("video/ResolutionHeight",  options.height);
+  settings.setValue("video/Framerate",         options.fps);
+  settings.setValue("video/InputFormat",       options.y4mFile.isEmpty() ? "RGB32" : "YUV420P");
+  settings.setValue("video/yuvThreads",        0);
+  settings.setValue("video/rgbThreads",        0);
+  settings.setValue("video/OPENHEVC_threads",  0);
+  settings.setValue("video/flipViews",         0);
+  settings.setValue("video/filterPool",        options.pool ? 1 : 0);
+  settings.setValue("video/filterTrace",       0);
+  settings.setValue("video/backpressure",      0);
+  settings.setValue("video/simulcastLayers",   options.layers);
+
+  settings.sync();
+}
+
+
+int main(int argc, char* argv[])
+{
+  // no screen is needed
+  if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+  {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
+  QApplication app(argc, argv);
+
+  Options options;
+  if (!parseOptions(app.arguments(), options))
+  {
+    printf("Usage: pipelinebenchmark [--duration seconds] [--warmup seconds] [--fps fps]\n"
+           "                         [--width width] [--height height] [--y4m file]\n"
+           "                         [--port port] [--qp qp] [--pool] [--layers count]\n"
+           "Width and height must be divisible by 8.\n");
+    return 2;
+  }
+
+#ifdef __linux__
+  if (options.y4mFile.isEmpty() && (options.width != 640 || options.height != 480))
+  {
+    // Kvazaar filter always uses 640x480 on Linux
+    printf("Using 640x480, the only resolution the encoder supports on Linux.\n");
+    options.width = 640;
+    options.height = 480;
+  }
+#endif
+
+  // don't touch the settings of the user
+  QTemporaryDir settingsDir;
+  if (!settingsDir.isValid() || !QDir::setCurrent(settingsDir.path()))
+  {
+    printf("Could not create a temporary directory for the settings.\n");
+    return 1;
+  }
+  writeSettings(options);
+
+  LatencyProbe probe;
+  BenchmarkStatistics stats;
+  NullView view(&probe);
+
+  std::shared_ptr<SyntheticSource> source =
+      std::shared_ptr<SyntheticSource>(new SyntheticSource(&stats, &probe, options.width,
+                                                           options.height, options.fps,
+                                                           options.y4mFile));
+
+  FilterGraph graph;
+  Delivery delivery;
+  CongestionController congestion;
+
+  graph.setVideoSource(source);
+  graph.init(nullptr, &stats);
+  delivery.init(&stats);
+
+  congestion.init(&stats);
+  QObject::connect(&congestion, &CongestionController::bitrateChanged,
+                   &graph, &FilterGraph::setSendBitrate);
+  QObject::connect(&congestion, &CongestionController::peerBitrateChanged,
+                   &graph, &FilterGraph::setPeerBitrate);
+  QObject::connect(&congestion, &CongestionController::keyframeRequested,
+                   &graph, &FilterGraph::requestKeyframe);
+
+  const uint32_t sessionID = 1;
+  QHostAddress localhost("127.0.0.1");
+
+  if (!delivery.addPeer(sessionID, localhost.toString(), localhost.toString()))
+  {
+    printf("Failed to create the RTP session.\n");
+    return 1;
+  }
+
+  // the ports are crossed so that the stream loops back to us
+  std::shared_ptr<Filter> sender = delivery.addSendStream(sessionID, localhost,
+                                                          options.port, options.port + 2,
+                                                          "h265", 96);
+  std::shared_ptr<Filter> receiver = delivery.addReceiveStream(sessionID, localhost,
+                                                               options.port + 2, options.port,
+                                                               "h265", 96);
+  if (sender == nullptr || receiver == nullptr)
+  {
+    printf("Failed to create the RTP streams.\n");
+    return 1;
+  }
+
+  graph.receiveVideoFrom(sessionID, receiver, &view);
+  graph.sendVideoto(sessionID, sender);
+
+  printf("Running %d s after %d s warm up, %dx%d at %d fps\n",
+         options.duration, options.warmup, options.width, options.height, options.fps);
+
+  QTimer::singleShot(options.warmup*1000, [&]()
+  {
+    probe.reset();
+    stats.reset();
+  });
+
+  QTimer::singleShot((options.warmup + options.duration)*1000, &app, &QApplication::quit);
+
+  app.exec();
+
+  LatencyProbe::Results results = probe.results();
+
+  congestion.uninit();
+  graph.uninit();
+  delivery.removePeer(sessionID);
+  delivery.uninit();
+
+  printf("\nFrames sent: %u, displayed: %u, unreadable: %u\n",
+         results.sent, results.displayed, results.unreadable);
+  printf("Displayed framerate: %.2f fps\n",
+         results.seconds > 0 ? results.displayed/results.seconds : 0.0);
+  printf("Latency (ms): p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+         results.p50, results.p90, results.p99, results.max);
+
+  stats.print(results.seconds);
+
+  return results.displayed > 0 ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+#-------------------------------------------------
+#
+# End-to-end benchmark of the video pipeline without a camera or a screen.
+# Needs the same libraries as Kvazzup. Build and run separately:
+#   qmake pipelinebenchmark.pro && make && ./pipelinebenchmark
+#
+#-------------------------------------------------
+
+QT       += core gui widgets multimedia network concurrent
+
+TARGET = pipelinebenchmark
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    benchmarkstatistics.cpp \
+    latencyprobe.cpp \
+    nullview.cpp \
+    pipelinebenchmark.cpp \
+    syntheticsource.cpp \
+    ../src/common.cpp \
+    ../src/media/delivery/congestioncontroller.cpp \
+    ../src/media/delivery/delivery.cpp \
+    ../src/media/delivery/uvgrtpreceiver.cpp \
+    ../src/media/delivery/uvgrtpsender.cpp \
+    ../src/media/processing/aecinputfilter.cpp \
+    ../src/media/processing/aecprocessor.cpp \
+    ../src/media/processing/audiocapturefilter.cpp \
+    ../src/media/processing/audiojitterbuffer.cpp \
+    ../src/media/processing/audiomixerfilter.cpp \
+    ../src/media/processing/audiooutputdevice.cpp \
+    ../src/media/processing/audioresampler.cpp \
+    ../src/media/processing/camerafilter.cpp \
+    ../src/media/processing/cameraframegrabber.cpp \
+    ../src/media/processing/displayfilter.cpp \
+    ../src/media/processing/downscalefilter.cpp \
+    ../src/media/processing/filter.cpp \
+    ../src/media/processing/filtergraph.cpp \
+    ../src/media/processing/filterscheduler.cpp \
+    ../src/media/processing/filtertracer.cpp \
+    ../src/media/processing/framepool.cpp \
+    ../src/media/processing/inputqueue.cpp \
+    ../src/media/processing/kvazaarfilter.cpp \
+    ../src/media/processing/kvazaarpicturepool.cpp \
+    ../src/media/processing/layerselectorfilter.cpp \
+    ../src/media/processing/openhevcfilter.cpp \
+    ../src/media/processing/opusencoderfilter.cpp \
+    ../src/media/processing/resamplefilter.cpp \
+    ../src/media/processing/rgb32toyuv.cpp \
+    ../src/media/processing/scalefilter.cpp \
+    ../src/media/processing/screensharefilter.cpp \
+    ../src/media/processing/yuvtorgb32.cpp
+
+HEADERS += \
+    benchmarkstatistics.h \
+    latencyprobe.h \
+    nullview.h \
+    syntheticsource.h \
+    ../src/common.h \
+    ../src/statisticsinterface.h \
+    ../src/ui/gui/videointerface.h \
+    ../src/media/delivery/congestioncontroller.h \
+    ../src/media/delivery/delivery.h \
+    ../src/media/delivery/uvgrtpreceiver.h \
+    ../src/media/delivery/uvgrtpsender.h \
+    ../src/media/processing/aecinputfilter.h \
+    ../src/media/processing/aecprocessor.h \
+    ../src/media/processing/audiocapturefilter.h \
+    ../src/media/processing/audiojitterbuffer.h \
+    ../src/media/processing/audiomixerfilter.h \
+    ../src/media/processing/audiooutputdevice.h \
+    ../src/media/processing/audioresampler.h \
+    ../src/media/processing/camerafilter.h \
+    ../src/media/processing/cameraframegrabber.h \
+    ../src/media/processing/displayfilter.h \
+    ../src/media/processing/downscalefilter.h \
+    ../src/media/processing/filter.h \
+    ../src/media/processing/filtergraph.h \
+    ../src/media/processing/filterscheduler.h \
+    ../src/media/processing/filtertracer.h \
+    ../src/media/processing/framepool.h \
+    ../src/media/processing/inputqueue.h \
+    ../src/media/processing/kvazaarfilter.h \
+    ../src/media/processing/kvazaarpicturepool.h \
+    ../src/media/processing/layerselectorfilter.h \
+    ../src/media/processing/openhevcfilter.h \
+    ../src/media/processing/opusencoderfilter.h \
+    ../src/media/processing/resamplefilter.h \
+    ../src/media/processing/rgb32toyuv.h \
+    ../src/media/processing/scalefilter.h \
+    ../src/media/processing/screensharefilter.h \
+    ../src/media/processing/sequenceextender.h \
+    ../src/media/processing/yuvtorgb32.h \
+    ../src/media/processing/optimized/audiomix.h \
+    ../src/media/processing/optimized/cpufeatures.h \
+    ../src/media/processing/optimized/resample.h \
+    ../src/media/processing/optimized/rgb2yuv.h \
+    ../src/media/processing/optimized/yuv2rgb.h \
+    ../src/media/processing/optimized/yuvrepack.h \
+    ../src/media/processing/optimized/yuvscale.h
+
+win32-g++: QMAKE_CXXFLAGS += -msse4.1 -mavx2 -fopenmp
+
+INCLUDEPATH += $$PWD/../../include/openhevc_dec
+INCLUDEPATH += $$PWD/../../include/
+
+LIBS += -lopus
+LIBS += -lLibOpenHevcWrapper
+LIBS += -lspeexdsp
+LIBS += -luvgrtp
+
+win32{
+  INCLUDEPATH += $$PWD/../../include/uvgrtp
+  INCLUDEPATH += $$PWD/../../include/opus
+  LIBS += -lws2_32
+  LIBS += -lole32
+  LIBS += -loleaut32
+  LIBS += -lcryptlib
+}
+
+win32-g++{
+  LIBS += -lkvazaar
+  LIBS += -fopenmp
+  LIBS += -L$$PWD/../../libs
+  LIBS += -lstrmiids
+  LIBS += -lssp
+}
+
+unix {
+  LIBS += -lkvazaar -lcryptopp
+  QMAKE_CXXFLAGS += -msse4.1 -mavx2 -fopenmp
+  QMAKE_LFLAGS += -fopenmp
+  INCLUDEPATH += /usr/include/opus/
+  INCLUDEPATH += /usr/local/include/uvgrtp/
+}
@@ -0,0 +1,177 @@
+#include "syntheticsource.h"
+
+#include "latencyprobe.h"
+
+#include "common.h"
+
+#include <QDateTime>
+
+
+SyntheticSource::SyntheticSource(StatisticsInterface* stats, LatencyProbe* probe,
+                                 int width, int height, int framerate, QString y4mFile):
+  Filter("", "Synthetic source", stats, NONE, y4mFile.isEmpty() ? RGB32VIDEO : YUV420VIDEO),
+  probe_(probe),
+  width_(width),
+  height_(height),
+  framerate_(framerate),
+  y4mFileName_(y4mFile),
+  y4mFile_(),
+  firstFrame_(0),
+  frameCount_(0),
+  frameTimer_()
+{
+  frameTimer_.setSingleShot(false);
+  frameTimer_.setTimerType(Qt::PreciseTimer);
+  connect(&frameTimer_, &QTimer::timeout, this, &SyntheticSource::nextFrame);
+}
+
+
+bool SyntheticSource::init()
+{
+  if (!y4mFileName_.isEmpty() && !y4mFile_.isOpen() && !openY4M())
+  {
+    return false;
+  }
+
+  frameTimer_.setInterval(1000/framerate_);
+  frameTimer_.start();
+
+  return Filter::init();
+}
+
+
+void SyntheticSource::stop()
+{
+  frameTimer_.stop();
+  Filter::stop();
+}
+
+
+void SyntheticSource::nextFrame()
+{
+  wakeUp();
+}
+
+
+void SyntheticSource::process()
+{
+  if (skipFrame())
+  {
+    return;
+  }
+
+  Data* frame = new Data;
+  frame->type = output_;
+  frame->width = width_;
+  frame->height = height_;
+  frame->framerate = framerate_;
+  frame->source = LOCAL;
+  frame->layer = 0;
+  frame->stride[0] = 0;
+  frame->stride[1] = 0;
+  frame->stride[2] = 0;
+  frame->sequenceNumber = 0;
+  frame->presentationTime = QDateTime::currentMSecsSinceEpoch();
+
+  if (output_ == RGB32VIDEO)
+  {
+    frame->data_size = width_*height_*4;
+    frame->data = allocateBuffer(frame->data_size);
+    drawPattern(frame->data.get());
+    probe_->stampRGB32(frame->data.get(), width_, height_);
+  }
+  else
+  {
+    frame->data_size = width_*height_ + width_*height_/2;
+    frame->data = allocateBuffer(frame->data_size);
+    if (!readY4MFrame(frame->data.get()))
+    {
+      delete frame;
+      return;
+    }
+    probe_->stampYUV420(frame->data.get(), width_, height_);
+  }
+
+  ++frameCount_;
+  sendOutput(std::unique_ptr<Data>(frame));
+}
+
+
+void SyntheticSource::drawPattern(uint8_t* frame)
+{
+  // gradients moving in different directions so every frame has motion
+  for (int y = 0; y < height_; ++y)
+  {
+    uint8_t* row = frame + 4*y*width_;
+    for (int x = 0; x < width_; ++x)
+    {
+      row[4*x]     = (uint8_t)(x + 4*frameCount_);
+      row[4*x + 1] = (uint8_t)(y + 2*frameCount_);
+      row[4*x + 2] = (uint8_t)((x + y)/2 - 3*frameCount_);
+      row[4*x + 3] = 0;
+    }
+  }
+}
+
+
+bool SyntheticSource::openY4M()
+{
+  y4mFile_.setFileName(y4mFileName_);
+  if (!y4mFile_.open(QIODevice::ReadOnly))
+  {
+    printDebug(DEBUG_ERROR, this, "Could not open Y4M file", {"File"}, {y4mFileName_});
+    return false;
+  }
+
+  QList<QByteArray> header = y4mFile_.readLine().trimmed().split(' ');
+  if (header.empty() || header.at(0) != "YUV4MPEG2")
+  {
+    printDebug(DEBUG_ERROR, this, "Not a Y4M file", {"File"}, {y4mFileName_});
+    return false;
+  }
+
+  for (QByteArray& parameter : header)
+  {
+    if (parameter.startsWith('W'))
+    {
+      width_ = parameter.mid(1).toInt();
+    }
+    else if (parameter.startsWith('H'))
+    {
+      height_ = parameter.mid(1).toInt();
+    }
+    else if (parameter.startsWith('C') && !parameter.startsWith("C420"))
+    {
+      printDebug(DEBUG_ERROR, this, "Only 4:2:0 Y4M files are supported", {"Colour space"},
+                 {QString(parameter)});
+      return false;
+    }
+  }
+
+  firstFrame_ = y4mFile_.pos();
+
+  printDebug(DEBUG_NORMAL, this, "Opened Y4M file", {"File", "Resolution"},
+             {y4mFileName_, QString::number(width_) + "x" + QString::number(height_)});
+  return true;
+}
+
+
+bool SyntheticSource::readY4MFrame(uint8_t* frame)
+{
+  // start from beginning at the end of file
+  if (y4mFile_.atEnd())
+  {
+    y4mFile_.seek(firstFrame_);
+  }
+
+  QByteArray frameHeader = y4mFile_.readLine();
+  qint64 size = width_*height_ + width_*height_/2;
+
+  if (!frameHeader.startsWith("FRAME") || y4mFile_.read((char*)frame, size) != size)
+  {
+    printDebug(DEBUG_ERROR, this, "Failed to read Y4M frame");
+    y4mFile_.seek(firstFrame_);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "media/processing/filter.h"
+
+#include <QFile>
+#include <QTimer>
+
+class LatencyProbe;
+
+// Produces video frames at a fixed rate without a camera. The frames are
+// either a moving RGB32 test pattern or YUV420 frames read from a Y4M file,
+// which is looped. Every frame is stamped by the latency probe.
+
+class SyntheticSource : public Filter
+{
+  Q_OBJECT
+public:
+  // empty y4mFile means the test pattern is used
+  SyntheticSource(StatisticsInterface* stats, LatencyProbe* probe,
+                  int width, int height, int framerate, QString y4mFile);
+
+  virtual bool init();
+
+  virtual void stop();
+
+protected:
+
+  virtual void process();
+
+private slots:
+
+  void nextFrame();
+
+private:
+
+  bool openY4M();
+
+  bool readY4MFrame(uint8_t* frame);
+
+  void drawPattern(uint8_t* frame);
+
+  LatencyProbe* probe_;
+
+  int width_;
+  int height_;
+  int framerate_;
+
+  QString y4mFileName_;
+  QFile y4mFile_;
+  qint64 firstFrame_;
+
+  uint32_t frameCount_;
+
+  QTimer frameTimer_;
+};
@@ -9,12 +9,28 @@ const QString APPLICATIONNAME = "Kvazzup";
 // how often registrations are sent in seconds
 const int REGISTER_INTERVAL = 600;
 
-// this affects latency of audio. We have to wait until this much audio
-// has arrived before sending the packet. If packet is too small,
-// we waste bandwidth.
-
-// TODO: This should be at least 100 frames per second to reduce latency
-const uint16_t AUDIO_FRAMES_PER_SECOND = 25; // 40 ms of latency
+// Duration of an audio frame in milliseconds. This affects latency of audio.
+// We have to wait until this much audio has arrived before sending the packet.
+// If packet is too small, we waste bandwidth. The duration is negotiated with
+// the SDP ptime attribute and can be 10, 20 or 40 ms.
+const uint16_t DEFAULT_AUDIO_FRAME_DURATION = 20;
+
+// used with peers that don't tell their ptime
+const uint16_t LEGACY_AUDIO_FRAME_DURATION = 40;
+
+// rounds a packet time down to a supported frame duration
+inline uint16_t supportedAudioFrameDuration(uint32_t ptime)
+{
+  if (ptime >= 40)
+  {
+    return 40;
+  }
+  else if (ptime >= 20)
+  {
+    return 20;
+  }
+  return 10;
+}
 
 const int STREAM_COMPONENTS = 4;
 
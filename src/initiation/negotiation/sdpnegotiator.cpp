@@ -3,8 +3,10 @@
 #include "mediacapabilities.h"
 
 #include "common.h"
+#include "global.h"
 
 #include <QDateTime>
+#include <QSettings>
 #include <QDebug>
 
 SDPNegotiator::SDPNegotiator()
@@ -107,6 +109,18 @@ std::shared_ptr<SDPMessageInfo> SDPNegotiator::negotiateSDP(SDPMessageInfo& remo
                       supportedNums, supportedCodecs,
                       ourMedia.rtpNums, ourMedia.codecs);
 
+      // peers that don't tell their ptime only know the old framing
+      uint16_t duration = LEGACY_AUDIO_FRAME_DURATION;
+      for (auto& attribute : remoteMedia.valueAttributes)
+      {
+        if (attribute.type == A_PTIME && attribute.value.toUInt() != 0)
+        {
+          duration = supportedAudioFrameDuration(qMin(attribute.value.toUInt(),
+                                                      (uint32_t)preferredAudioFrameDuration()));
+        }
+      }
+
+      ourMedia.valueAttributes.push_back({A_PTIME, QString::number(duration)});
     }
     else if (remoteMedia.type == "video")
     {
@@ -204,7 +218,8 @@ bool SDPNegotiator::generateAudioMedia(MediaInfo &audio)
 {
   // we ignore nettype, addrtype and address, because we use a global c=
   audio = {"audio", 0, "RTP/AVP", {},
-           "", "", "", "", {},"", DYNAMIC_AUDIO_CODECS, {A_SENDRECV}, {}};
+           "", "", "", "", {},"", DYNAMIC_AUDIO_CODECS, {A_SENDRECV},
+           {{A_PTIME, QString::number(preferredAudioFrameDuration())}}};
 
   // add all the dynamic numbers first because we want to favor dynamic type codecs.
   for(RTPMap codec : audio.codecs)
@@ -327,3 +342,15 @@ void SDPNegotiator::setMediaPair(MediaInfo& media,
 }
 
 
+uint16_t SDPNegotiator::preferredAudioFrameDuration()
+{
+  QSettings settings("kvazzup.ini", QSettings::IniFormat);
+  uint32_t duration = settings.value("audio/frameDuration").toUInt();
+
+  if (duration == 0)
+  {
+    return DEFAULT_AUDIO_FRAME_DURATION;
+  }
+
+  return supportedAudioFrameDuration(duration);
+}
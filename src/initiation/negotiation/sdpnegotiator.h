@@ -37,4 +37,6 @@ public:
 
 private:
 
+  // the audio frame duration we would like to use in milliseconds
+  uint16_t preferredAudioFrameDuration();
 };
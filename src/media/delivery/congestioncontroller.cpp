@@ -0,0 +1,476 @@
+#include "congestioncontroller.h"
+
+#include "statisticsinterface.h"
+#include "common.h"
+
+#include <QDateTime>
+#include <QSettings>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// how often the estimate is updated in milliseconds
+const int UPDATE_INTERVAL = 200;
+
+// receivers are forgotten if they have not reported in this time (ms)
+const int64_t REPORT_TIMEOUT = 15000;
+
+const uint32_t MIN_VIDEO_BITRATE = 100000;
+const uint32_t MIN_AUDIO_BITRATE = 12000;
+
+// multiplicative increase per second when there is no congestion
+const double INCREASE_PER_SECOND = 0.08;
+
+// the estimate is multiplied by this when the delay grows
+const double DELAY_DECREASE = 0.85;
+
+// loss above high decreases the bitrate, loss below low allows increasing it
+const float HIGH_LOSS = 0.10f;
+const float LOW_LOSS = 0.02f;
+
+// a delay trend larger than this (ms) means the queues are growing
+const float OVERUSE_THRESHOLD = 10.0f;
+
+// without RTT, this much growth in jitter is taken as overuse
+const float JITTER_OVERUSE = 1.5f;
+const uint32_t MIN_JITTER = 900;
+
+// smaller changes are not given to the encoders
+const double CHANGE_THRESHOLD = 0.1;
+
+// The encoder takes a new video bitrate into use at its next intra frame, so
+// changing it more often would only replace changes before they are used (ms)
+const int64_t MIN_VIDEO_CHANGE_INTERVAL = 2000;
+
+// seconds between 1900 (NTP) and 1970 (Unix)
+const uint64_t NTP_OFFSET = 2208988800ull;
+
+
+QMutex CongestionController::instanceMutex_;
+CongestionController* CongestionController::instance_ = nullptr;
+CongestionController::MonitoredStream
+  CongestionController::monitored_[CongestionController::MAX_MONITORED_STREAMS] = {};
+
+
+// the middle 32 bits of NTP time as used in the LSR field
+static uint32_t ntpCompact(int64_t msecsSinceEpoch)
+{
+  uint64_t seconds = msecsSinceEpoch/1000 + NTP_OFFSET;
+  uint64_t fraction = ((msecsSinceEpoch%1000) << 16)/1000;
+  return (uint32_t)(((seconds & 0xFFFF) << 16) | fraction);
+}
+
+
+CongestionController::CongestionController():
+  QObject(),
+  stats_(nullptr),
+  updateTimer_(),
+  lastUpdate_(0),
+  stateMutex_(),
+  receivers_(),
+  enabled_(false),
+  simulcast_(false),
+  maxVideoBitrate_(0),
+  maxAudioBitrate_(0),
+  peers_(),
+  estimate_(0),
+  videoBitrate_(0),
+  audioBitrate_(0),
+  packetLoss_(0),
+  lastVideoChange_(0)
+{
+  connect(&updateTimer_, &QTimer::timeout, this, &CongestionController::update);
+}
+
+
+CongestionController::~CongestionController()
+{
+  uninit();
+}
+
+
+void CongestionController::init(StatisticsInterface* stats)
+{
+  stats_ = stats;
+  updateSettings();
+
+  instanceMutex_.lock();
+  instance_ = this;
+  instanceMutex_.unlock();
+
+  lastUpdate_ = QDateTime::currentMSecsSinceEpoch();
+  updateTimer_.start(UPDATE_INTERVAL);
+}
+
+
+void CongestionController::uninit()
+{
+  updateTimer_.stop();
+
+  instanceMutex_.lock();
+  if (instance_ == this)
+  {
+    instance_ = nullptr;
+  }
+  instanceMutex_.unlock();
+}
+
+
+void CongestionController::updateSettings()
+{
+  QSettings settings("kvazzup.ini", QSettings::IniFormat);
+
+  stateMutex_.lock();
+  maxVideoBitrate_ = settings.value("video/bitrate").toUInt();
+  maxAudioBitrate_ = settings.value("audio/bitrate").toUInt();
+
+  // adapting only makes sense if the encoder follows a bitrate
+  enabled_ = maxVideoBitrate_ != 0;
+  simulcast_ = settings.value("video/simulcastLayers").toInt() > 1;
+
+  // the encoders take the bitrates from settings themselves
+  estimate_ = maxVideoBitrate_ + maxAudioBitrate_;
+  videoBitrate_ = maxVideoBitrate_;
+  audioBitrate_ = maxAudioBitrate_;
+  peers_.clear();
+  stateMutex_.unlock();
+
+  printDebug(DEBUG_NORMAL, "Congestion controller", "Updated settings",
+             {"Enabled", "Max video bitrate", "Max audio bitrate"},
+             {enabled_ ? "yes" : "no", QString::number(maxVideoBitrate_),
+              QString::number(maxAudioBitrate_)});
+}
+
+
+void CongestionController::monitorStream(uint32_t sessionID, uvg_rtp::media_stream* stream)
+{
+  typedef void (*ReportHook)(uvg_rtp::frame::rtcp_receiver_frame*);
+  static const ReportHook hooks[MAX_MONITORED_STREAMS] = {
+    receiverReportHook<0>,  receiverReportHook<1>,  receiverReportHook<2>,  receiverReportHook<3>,
+    receiverReportHook<4>,  receiverReportHook<5>,  receiverReportHook<6>,  receiverReportHook<7>,
+    receiverReportHook<8>,  receiverReportHook<9>,  receiverReportHook<10>, receiverReportHook<11>,
+    receiverReportHook<12>, receiverReportHook<13>, receiverReportHook<14>, receiverReportHook<15>};
+
+  typedef void (*AppHook)(uvg_rtp::frame::rtcp_app_frame*);
+  static const AppHook appHooks[MAX_MONITORED_STREAMS] = {
+    appHook<0>,  appHook<1>,  appHook<2>,  appHook<3>,  appHook<4>,  appHook<5>,
+    appHook<6>,  appHook<7>,  appHook<8>,  appHook<9>,  appHook<10>, appHook<11>,
+    appHook<12>, appHook<13>, appHook<14>, appHook<15>};
+
+  QMutexLocker lock(&instanceMutex_);
+
+  int slot = 0;
+  while (slot < MAX_MONITORED_STREAMS && monitored_[slot].stream != nullptr)
+  {
+    ++slot;
+  }
+
+  uvg_rtp::rtcp* rtcp = stream->get_rtcp();
+
+  if (slot == MAX_MONITORED_STREAMS || rtcp == nullptr ||
+      rtcp->install_receiver_hook(hooks[slot]) != RTP_OK)
+  {
+    printDebug(DEBUG_WARNING, "Congestion controller",
+               "Could not follow RTCP receiver reports of the stream",
+               {"SessionID"}, {QString::number(sessionID)});
+    return;
+  }
+
+  if (rtcp->install_app_hook(appHooks[slot]) != RTP_OK)
+  {
+    printDebug(DEBUG_WARNING, "Congestion controller",
+               "Could not follow keyframe requests of the stream",
+               {"SessionID"}, {QString::number(sessionID)});
+  }
+
+  monitored_[slot] = {stream, sessionID};
+}
+
+
+void CongestionController::forgetStream(uvg_rtp::media_stream* stream)
+{
+  QMutexLocker lock(&instanceMutex_);
+
+  for (int slot = 0; slot < MAX_MONITORED_STREAMS; ++slot)
+  {
+    if (monitored_[slot].stream == stream)
+    {
+      monitored_[slot] = {nullptr, 0};
+    }
+  }
+}
+
+
+void CongestionController::processFrame(int slot, uvg_rtp::frame::rtcp_receiver_frame* frame)
+{
+  instanceMutex_.lock();
+  if (instance_ != nullptr && monitored_[slot].stream != nullptr)
+  {
+    for (const uvg_rtp::frame::rtcp_report_block& block : frame->blocks)
+    {
+      uint64_t receiver = ((uint64_t)frame->sender_ssrc << 32) | block.ssrc;
+
+      instance_->processReport(monitored_[slot].sessionID, receiver, block.fraction,
+                               block.jitter, block.lsr, block.dlsr);
+    }
+  }
+  instanceMutex_.unlock();
+
+  (void)uvg_rtp::frame::dealloc_frame(frame);
+}
+
+
+void CongestionController::processAppFrame(int slot, uvg_rtp::frame::rtcp_app_frame* frame)
+{
+  // picture loss indication or full intra request, see UvgRTPReceiver
+  bool keyframe = memcmp(frame->name, "PLI ", 4) == 0 || memcmp(frame->name, "FIR ", 4) == 0;
+
+  instanceMutex_.lock();
+  if (keyframe && instance_ != nullptr && monitored_[slot].stream != nullptr)
+  {
+    emit instance_->keyframeRequested(monitored_[slot].sessionID);
+  }
+  instanceMutex_.unlock();
+
+  (void)uvg_rtp::frame::dealloc_frame(frame);
+}
+
+
+void CongestionController::processReport(uint32_t sessionID, uint64_t receiver, uint8_t fraction,
+                                         uint32_t jitter, uint32_t lsr, uint32_t dlsr)
+{
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+  // the round-trip time is only known after the peer has received our sender report
+  int32_t rtt = -1;
+  if (lsr != 0)
+  {
+    uint32_t units = ntpCompact(now) - lsr - dlsr; // 1/65536 s
+    if (units < 10*65536)
+    {
+      rtt = (int32_t)((uint64_t)units*1000/65536);
+    }
+  }
+
+  QMutexLocker lock(&stateMutex_);
+
+  if (receivers_.find(receiver) == receivers_.end())
+  {
+    receivers_[receiver] = {sessionID, now, 0.0f, jitter, rtt, 0.0f, false, false};
+  }
+  ReceiverState& state = receivers_[receiver];
+
+  // the delay gradient
+  if (rtt != -1 && state.rtt != -1)
+  {
+    state.delayTrend = 0.6f*state.delayTrend + 0.4f*(rtt - state.rtt);
+    state.overuse = state.overuse || state.delayTrend > OVERUSE_THRESHOLD;
+  }
+  else if (jitter > MIN_JITTER && jitter > JITTER_OVERUSE*state.jitter)
+  {
+    state.overuse = true;
+  }
+
+  state.lastReport = now;
+  state.loss = fraction/256.0f;
+  state.jitter = jitter;
+  state.rtt = rtt;
+  state.newLoss = true;
+}
+
+
+void CongestionController::update()
+{
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+  double elapsed = (now - lastUpdate_)/1000.0;
+  lastUpdate_ = now;
+
+  QMutexLocker lock(&stateMutex_);
+
+  std::map<uint32_t, Feedback> feedback;
+  float loss = 0.0f;
+  int32_t rtt = -1;
+
+  for (auto it = receivers_.begin(); it != receivers_.end();)
+  {
+    ReceiverState& state = it->second;
+
+    if (now - state.lastReport > REPORT_TIMEOUT)
+    {
+      it = receivers_.erase(it);
+      continue;
+    }
+
+    if (feedback.find(state.sessionID) == feedback.end())
+    {
+      feedback[state.sessionID] = {false, false, 0.0f, 0.0f};
+    }
+    Feedback& peer = feedback[state.sessionID];
+
+    peer.overuse = peer.overuse || state.overuse;
+    peer.underuse = peer.underuse || state.delayTrend < -OVERUSE_THRESHOLD;
+    if (state.newLoss)
+    {
+      peer.newLoss = std::max(peer.newLoss, state.loss);
+    }
+    peer.loss = std::max(peer.loss, state.loss);
+
+    loss = std::max(loss, state.loss);
+    rtt = std::max(rtt, state.rtt);
+
+    state.overuse = false;
+    state.newLoss = false;
+    ++it;
+  }
+
+  // the audio encoder protects itself against loss even without rate control
+  uint8_t packetLoss = (uint8_t)std::lround(loss*100);
+  bool lossChange = packetLoss != packetLoss_;
+  packetLoss_ = packetLoss;
+
+  if (!enabled_)
+  {
+    lock.unlock();
+
+    if (lossChange)
+    {
+      emit packetLossChanged(packetLoss);
+    }
+    return;
+  }
+
+  double minimum = MIN_VIDEO_BITRATE + (maxAudioBitrate_ != 0 ? MIN_AUDIO_BITRATE : 0);
+  double maximum = maxVideoBitrate_ + maxAudioBitrate_;
+
+  // peers which no longer report are forgotten
+  for (auto it = peers_.begin(); it != peers_.end();)
+  {
+    if (feedback.find(it->first) == feedback.end())
+    {
+      it = peers_.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> peerChanges;
+  for (auto& report : feedback)
+  {
+    if (peers_.find(report.first) == peers_.end())
+    {
+      peers_[report.first] = {maximum, (uint32_t)maximum};
+    }
+    PeerState& peer = peers_[report.first];
+
+    peer.estimate = std::max(minimum, std::min(maximum,
+                                               adjustEstimate(peer.estimate, report.second, elapsed)));
+
+    if (std::abs(peer.estimate - peer.notifiedBitrate) > CHANGE_THRESHOLD*peer.notifiedBitrate ||
+        (peer.estimate == maximum && peer.notifiedBitrate != maximum))
+    {
+      peer.notifiedBitrate = (uint32_t)peer.estimate;
+      peerChanges.push_back({report.first, peer.notifiedBitrate});
+    }
+  }
+
+  // with simulcast the weaker peers get a smaller layer
+  if (!peers_.empty())
+  {
+    estimate_ = peers_.begin()->second.estimate;
+    for (auto& peer : peers_)
+    {
+      estimate_ = simulcast_ ? std::max(estimate_, peer.second.estimate)
+                             : std::min(estimate_, peer.second.estimate);
+    }
+  }
+
+  estimate_ = std::max(minimum, std::min(maximum, estimate_));
+
+  // audio gets its share of the estimate
+  uint32_t audio = 0;
+  if (maxAudioBitrate_ != 0)
+  {
+    audio = (uint32_t)(estimate_*maxAudioBitrate_/maximum);
+    audio = std::max(MIN_AUDIO_BITRATE, std::min(maxAudioBitrate_, audio));
+  }
+  uint32_t video = std::max(MIN_VIDEO_BITRATE, (uint32_t)estimate_ - audio);
+
+  bool videoChange = video != videoBitrate_ &&
+      (std::abs((double)video - videoBitrate_) > CHANGE_THRESHOLD*videoBitrate_ ||
+       video == maxVideoBitrate_) &&
+      now - lastVideoChange_ >= MIN_VIDEO_CHANGE_INTERVAL;
+
+  bool audioChange = audio != audioBitrate_ &&
+      (std::abs((double)audio - audioBitrate_) > CHANGE_THRESHOLD*audioBitrate_ ||
+       audio == maxAudioBitrate_);
+
+  if (videoChange)
+  {
+    videoBitrate_ = video;
+    lastVideoChange_ = now;
+  }
+  if (audioChange)
+  {
+    audioBitrate_ = audio;
+  }
+
+  if (stats_ != nullptr)
+  {
+    stats_->updateCongestionControl((uint32_t)estimate_, videoBitrate_, audioBitrate_, loss, rtt);
+  }
+
+  lock.unlock();
+
+  if (videoChange || audioChange)
+  {
+    printDebug(DEBUG_NORMAL, this, "Changing send bitrate",
+               {"Video", "Audio", "Loss", "RTT"},
+               {QString::number(video), QString::number(audio),
+                QString::number(loss*100, 'f', 1) + " %", QString::number(rtt) + " ms"});
+
+    emit bitrateChanged(videoChange ? video : 0, audioChange ? audio : 0);
+  }
+
+  for (auto& change : peerChanges)
+  {
+    emit peerBitrateChanged(change.first, change.second);
+  }
+
+  if (lossChange)
+  {
+    emit packetLossChanged(packetLoss);
+  }
+}
+
+
+double CongestionController::adjustEstimate(double estimate, const Feedback& feedback,
+                                            double elapsed) const
+{
+  // each report decreases the bitrate only once
+  double decreased = estimate;
+  if (feedback.overuse)
+  {
+    decreased = estimate*DELAY_DECREASE;
+  }
+  if (feedback.newLoss > HIGH_LOSS)
+  {
+    decreased = std::min(decreased, estimate*(1.0 - 0.5*feedback.newLoss));
+  }
+
+  if (decreased < estimate)
+  {
+    return decreased;
+  }
+
+  // the delay is shrinking when underusing so the queues are still emptying
+  if (!feedback.underuse && feedback.loss < LOW_LOSS)
+  {
+    return estimate*std::pow(1.0 + INCREASE_PER_SECOND, elapsed);
+  }
+
+  return estimate;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <QObject>
+#include <QMutex>
+#include <QTimer>
+
+#include <uvgrtp/lib.hh>
+
+#include <map>
+
+class StatisticsInterface;
+
+// Estimates the bandwidth available for sending from the RTCP receiver
+// reports of our peers and tells the encoders which bitrate to use. Works
+// like the Google Congestion Control, but with the delay signal taken from
+// the round-trip time and jitter of the receiver reports: growing delay or
+// packet loss decreases the bitrate and otherwise it increases slowly up to
+// the bitrates set in settings. Adaptation is used only if the video rate
+// control is enabled in settings.
+//
+// Each peer has its own estimate. The encoders follow the weakest peer, or
+// with simulcast the strongest one while the others get a smaller layer.
+//
+// The keyframe requests of the peers arrive in the same RTCP feedback and
+// are passed on from here.
+
+class CongestionController : public QObject
+{
+  Q_OBJECT
+public:
+  CongestionController();
+  ~CongestionController();
+
+  void init(StatisticsInterface* stats);
+  void uninit();
+
+  // reads the maximum bitrates from settings and starts from them
+  void updateSettings();
+
+  // starts following the receiver reports of this stream. The reports of all
+  // streams go to the controller which was initialized.
+  static void monitorStream(uint32_t sessionID, uvg_rtp::media_stream* stream);
+  static void forgetStream(uvg_rtp::media_stream* stream);
+
+signals:
+
+  // the encoders should use these bitrates. Zero means no change.
+  void bitrateChanged(uint32_t videoBitrate, uint32_t audioBitrate);
+
+  // the total bitrate this peer can receive
+  void peerBitrateChanged(uint32_t sessionID, uint32_t bitrate);
+
+  // The worst packet loss of our streams in percent. Reported also when the
+  // rate control is disabled.
+  void packetLossChanged(uint8_t percent);
+
+  // the peer lost video data and needs a keyframe to continue decoding
+  void keyframeRequested(uint32_t sessionID);
+
+private slots:
+
+  // updates the estimate. Called several times per second.
+  void update();
+
+private:
+
+  // The uvgRTP hooks do not tell which stream the report came to, so each
+  // monitored stream gets a hook of its own.
+  template <int SLOT>
+  static void receiverReportHook(uvg_rtp::frame::rtcp_receiver_frame* frame)
+  {
+    processFrame(SLOT, frame);
+  }
+
+  template <int SLOT>
+  static void appHook(uvg_rtp::frame::rtcp_app_frame* frame)
+  {
+    processAppFrame(SLOT, frame);
+  }
+
+  static void processFrame(int slot, uvg_rtp::frame::rtcp_receiver_frame* frame);
+  static void processAppFrame(int slot, uvg_rtp::frame::rtcp_app_frame* frame);
+
+  void processReport(uint32_t sessionID, uint64_t receiver, uint8_t fraction,
+                     uint32_t jitter, uint32_t lsr, uint32_t dlsr);
+
+  // how a receiver sees our streams
+  struct ReceiverState
+  {
+    uint32_t sessionID;
+    int64_t lastReport; // milliseconds since epoch
+    float loss;         // fraction of packets lost since previous report
+    uint32_t jitter;    // in RTP timestamp units
+    int32_t rtt;        // in milliseconds, -1 if not known
+
+    float delayTrend;   // filtered change of delay between reports in ms
+
+    // new information which has not yet been acted upon
+    bool overuse;
+    bool newLoss;
+  };
+
+  // what the reports of a peer tell since the previous update
+  struct Feedback
+  {
+    bool overuse;
+    bool underuse;
+    float newLoss;
+    float loss;
+  };
+
+  double adjustEstimate(double estimate, const Feedback& feedback, double elapsed) const;
+
+  struct MonitoredStream
+  {
+    uvg_rtp::media_stream* stream;
+    uint32_t sessionID;
+  };
+
+  static const int MAX_MONITORED_STREAMS = 16;
+
+  // the controller receiving the reports and the streams using the hooks
+  static QMutex instanceMutex_;
+  static CongestionController* instance_;
+  static MonitoredStream monitored_[MAX_MONITORED_STREAMS];
+
+  StatisticsInterface* stats_;
+
+  QTimer updateTimer_;
+  int64_t lastUpdate_;
+
+  QMutex stateMutex_;
+  // by the SSRCs of the reporter and the reported stream
+  std::map<uint64_t, ReceiverState> receivers_;
+
+  bool enabled_;
+  bool simulcast_;
+
+  // maximums from settings
+  uint32_t maxVideoBitrate_;
+  uint32_t maxAudioBitrate_;
+
+  struct PeerState
+  {
+    double estimate;
+    uint32_t notifiedBitrate;
+  };
+
+  // by session
+  std::map<uint32_t, PeerState> peers_;
+
+  // total bitrate we think we can send
+  double estimate_;
+
+  // what the encoders have been told
+  uint32_t videoBitrate_;
+  uint32_t audioBitrate_;
+  uint8_t packetLoss_;
+  int64_t lastVideoChange_;
+};
@@ -221,10 +221,11 @@ bool Delivery::addMediaStream(uint32_t sessionID, uint16_t localPort, uint16_t p
 
   printNormal(this, "Creating mediastream");
 
-  // for now just enable srtp + zrtp for all calls
+  // for now just enable srtp + zrtp for all calls. RTCP gives the receiver
+  // reports for congestion control.
   //
   // TODO: add ability to control "flags" from settings
-  int flags = RCE_SRTP_KMNGMNT_ZRTP | RCE_SRTP;
+  int flags = RCE_SRTP_KMNGMNT_ZRTP | RCE_SRTP | RCE_RTCP;
 
   QFuture<uvg_rtp::media_stream *> futureRes =
     QtConcurrent::run([=](uvg_rtp::session *session, uint16_t local, uint16_t peer,
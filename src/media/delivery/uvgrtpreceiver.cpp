@@ -6,10 +6,19 @@
 #include "common.h"
 
 #include <QDateTime>
+#include <QtEndian>
 
 #define RTP_HEADER_SIZE 2
 #define FU_HEADER_SIZE  1
 
+// keyframe requests are not sent more often than this (ms), since the
+// encoder needs a while to react
+const int64_t KEYFRAME_REQUEST_INTERVAL = 500;
+
+// if a packet is this much later than the fastest one, the sender has most
+// likely restarted its timestamps (ms)
+const int64_t TIMESTAMP_RESYNC_LIMIT = 2000;
+
 static void __receiveHook(void *arg, uvg_rtp::frame::rtp_frame *frame)
 {
   if (arg && frame)
@@ -23,17 +32,25 @@ UvgRTPReceiver::UvgRTPReceiver(uint32_t sessionID, QString id, StatisticsInterfa
   Filter(id, "RTP Receiver " + media, stats, NONE, type),
   type_(type),
   addStartCodes_(true),
-  sessionID_(sessionID)
+  sessionID_(sessionID),
+  mstream_(nullptr),
+  remoteSSRC_(0),
+  lastKeyframeRequest_(0),
+  clockRate_(type == OPUSAUDIO ? 48000 : 90000),
+  timestampsReceived_(false),
+  lastRTPTimestamp_(0),
+  rtpTime_(0),
+  timeOffset_(0)
 {
   watcher_.setFuture(stream);
 
   connect(&watcher_, &QFutureWatcher<uvg_rtp::media_stream *>::finished,
           [this]()
           {
-            if (!watcher_.result())
+            if (!(mstream_ = watcher_.result()))
               emit zrtpFailure(sessionID_);
             else
-              watcher_.result()->install_receive_hook(this, __receiveHook);
+              mstream_->install_receive_hook(this, __receiveHook);
           });
 }
 
@@ -48,6 +65,67 @@ void UvgRTPReceiver::process()
 }
 
 
+void UvgRTPReceiver::requestKeyframe()
+{
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+  if (mstream_ == nullptr || now - lastKeyframeRequest_ < KEYFRAME_REQUEST_INTERVAL)
+  {
+    return;
+  }
+
+  uvg_rtp::rtcp* rtcp = mstream_->get_rtcp();
+  if (rtcp == nullptr)
+  {
+    return;
+  }
+
+  lastKeyframeRequest_ = now;
+
+  // uvgRTP does not support RTCP feedback messages so the picture loss
+  // indication is sent as an application-defined packet with the SSRC of
+  // the lost stream.
+  uint8_t mediaSSRC[4];
+  qToBigEndian<quint32>(remoteSSRC_, mediaSSRC);
+
+  char name[] = "PLI ";
+  if (rtcp->send_app_packet(name, 0, sizeof(mediaSSRC), mediaSSRC) != RTP_OK)
+  {
+    printWarning(this, "Failed to send keyframe request");
+    return;
+  }
+
+  printDebug(DEBUG_NORMAL, this, "Requested a keyframe", {"SessionID"}, {QString::number(sessionID_)});
+}
+
+
+int64_t UvgRTPReceiver::presentationTime(uint32_t rtpTimestamp)
+{
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+  // the difference handles the wrap around of the timestamp
+  if (timestampsReceived_)
+  {
+    rtpTime_ += (int32_t)(rtpTimestamp - lastRTPTimestamp_);
+  }
+  lastRTPTimestamp_ = rtpTimestamp;
+
+  int64_t sendTime = rtpTime_*1000/clockRate_;
+  int64_t offset = now - sendTime;
+
+  // The fastest packet had the least delay, so the others are presented
+  // relative to it. The delay variation is left for the jitter buffers.
+  if (!timestampsReceived_ || offset < timeOffset_ ||
+      offset - timeOffset_ > TIMESTAMP_RESYNC_LIMIT)
+  {
+    timeOffset_ = offset;
+    timestampsReceived_ = true;
+  }
+
+  return sendTime + timeOffset_;
+}
+
+
 void UvgRTPReceiver::receiveHook(uvg_rtp::frame::rtp_frame *frame)
 {
   Q_ASSERT(frame && frame->payload != nullptr);
@@ -60,6 +138,8 @@ void UvgRTPReceiver::receiveHook(uvg_rtp::frame::rtp_frame *frame)
     return;
   }
 
+  remoteSSRC_ = frame->header.ssrc;
+
   if (addStartCodes_ && type_ == HEVCVIDEO)
   {
     frame->payload_len += 4;
@@ -68,14 +148,18 @@ void UvgRTPReceiver::receiveHook(uvg_rtp::frame::rtp_frame *frame)
   Data *received_picture = new Data;
   received_picture->data_size = frame->payload_len;
   received_picture->type = type_;
-  received_picture->data = std::unique_ptr<uchar[]>(new uchar[received_picture->data_size]);
+  received_picture->data = allocateBuffer(received_picture->data_size);
   received_picture->width = 0; // not known at this point. Decoder tells the correct resolution
   received_picture->height = 0;
   received_picture->framerate = 0;
   received_picture->source = REMOTE;
+  received_picture->layer = 0;
+  received_picture->stride[0] = 0;
+  received_picture->stride[1] = 0;
+  received_picture->stride[2] = 0;
+  received_picture->sequenceNumber = frame->header.seq;
 
-  // TODO: Get this info from RTP
-  received_picture->presentationTime = QDateTime::currentMSecsSinceEpoch();
+  received_picture->presentationTime = presentationTime(frame->header.timestamp);
 
   // TODO: This copying should be done in separate thread as in
   // framedsource if we want to receive 4K with less powerful thread (like in Xeon)
@@ -2,6 +2,9 @@
 
 #include <uvgrtp/lib.hh>
 #include <QFutureWatcher>
+
+#include <atomic>
+
 #include "media/processing/filter.h"
 
 class UvgRTPReceiver : public Filter
@@ -14,6 +17,9 @@ public:
 
   void receiveHook(uvg_rtp::frame::rtp_frame *frame);
 
+  // sends a picture loss indication to the peer
+  virtual void requestKeyframe();
+
   void uninit();
 
 protected:
@@ -30,4 +36,21 @@ private:
   bool addStartCodes_;
 
   QFutureWatcher<uvg_rtp::media_stream *> watcher_;
+  uvg_rtp::media_stream *mstream_;
+
+  // Converts the RTP timestamp to local milliseconds since epoch so that
+  // the frames keep the spacing they were sent with.
+  int64_t presentationTime(uint32_t rtpTimestamp);
+
+  // the SSRC of the received stream, for the keyframe requests
+  std::atomic<uint32_t> remoteSSRC_;
+  int64_t lastKeyframeRequest_; // milliseconds since epoch
+
+  uint32_t clockRate_;
+  bool timestampsReceived_;
+  uint32_t lastRTPTimestamp_;
+  int64_t rtpTime_; // unwrapped timestamp from the first packet
+
+  // local time minus the send time of the fastest packet
+  int64_t timeOffset_;
 };
@@ -1,6 +1,9 @@
+#include <QDateTime>
 #include <QSettings>
+#include <algorithm>
 
 #include "uvgrtpsender.h"
+#include "congestioncontroller.h"
 #include "statisticsinterface.h"
 #include "common.h"
 
@@ -36,11 +39,17 @@ UvgRTPSender::UvgRTPSender(uint32_t sessionID, QString id, StatisticsInterface *
           {
             if (!(mstream_ = watcher_.result()))
               emit zrtpFailure(sessionID_);
+            else
+              CongestionController::monitorStream(sessionID_, mstream_);
           });
 }
 
 UvgRTPSender::~UvgRTPSender()
 {
+  if (mstream_ != nullptr)
+  {
+    CongestionController::forgetStream(mstream_);
+  }
 }
 
 void UvgRTPSender::updateSettings()
@@ -64,6 +73,12 @@ void UvgRTPSender::updateSettings()
       // the number of frames between parameter sets
       maxBufferSize_ = vps * intra;
 
+      // keyframes are only sent when requested, so allow a second of frames
+      if (maxBufferSize_ == 0 || settings.value("video/keyframesOnRequest").toInt() == 1)
+      {
+        maxBufferSize_ = std::max(1, (int)settings.value("video/Framerate").toFloat());
+      }
+
       // discrete framer doesn't like start codes
       removeStartCodes_ = true;
 
@@ -86,7 +101,9 @@ void UvgRTPSender::process()
 
   while (input)
   {
-    ret = mstream_->push_frame(std::move(input->data), input->data_size, rtpFlags_);
+    // the frame is sent before push_frame returns so the pooled buffer
+    // can stay with us
+    ret = mstream_->push_frame(input->data.get(), input->data_size, rtpFlags_);
 
     if (ret != RTP_OK)
     {
@@ -95,6 +112,11 @@ void UvgRTPSender::process()
 
     getStats()->addSendPacket(input->data_size);
 
+    // the presentation time is when the first sample of the frame was
+    // captured, so this includes packetization, encoding and queueing
+    int64_t delay = QDateTime::currentMSecsSinceEpoch() - input->presentationTime;
+    getStats()->sendDelay(type_ == OPUSAUDIO ? "audio" : "video", delay);
+
     input = getInput();
   }
 }
@@ -5,17 +5,20 @@
 #include "initiation/negotiation/sdptypes.h"
 #include "statisticsinterface.h"
 #include "common.h"
+#include "global.h"
 
 #include <QHostAddress>
 #include <QtEndian>
 #include <QSettings>
 
 #include "media/delivery/delivery.h"
+#include "media/delivery/congestioncontroller.h"
 
 MediaManager::MediaManager():
   stats_(nullptr),
   fg_(new FilterGraph()),
   streamer_(nullptr),
+  congestion_(new CongestionController()),
   mic_(true),
   camera_(true),
   screenShare_(false)
@@ -43,12 +46,26 @@ void MediaManager::init(std::shared_ptr<VideoviewFactory> viewfactory, Statistic
     &Delivery::handleZRTPFailure,
     this,
     &MediaManager::handleZRTPFailure);
+
+  // the encoders follow the bitrate the network can take
+  congestion_->init(stats_);
+  connect(congestion_.get(), &CongestionController::bitrateChanged,
+          fg_.get(), &FilterGraph::setSendBitrate);
+  connect(congestion_.get(), &CongestionController::peerBitrateChanged,
+          fg_.get(), &FilterGraph::setPeerBitrate);
+  connect(congestion_.get(), &CongestionController::keyframeRequested,
+          fg_.get(), &FilterGraph::requestKeyframe);
+  connect(congestion_.get(), &CongestionController::packetLossChanged,
+          fg_.get(), &FilterGraph::setPacketLoss);
 }
 
 
 void MediaManager::uninit()
 {
   printDebug(DEBUG_NORMAL, this, "Closing");
+  congestion_->uninit();
+  disconnect(congestion_.get(), nullptr, fg_.get(), nullptr);
+
   // first filter graph, then streamer because of the rtpfilters
   fg_->running(false);
   fg_->uninit();
@@ -66,6 +83,7 @@ void MediaManager::updateSettings()
   fg_->updateSettings();
   fg_->camera(camera_); // kind of a hack to make sure the camera/mic state is preserved
   fg_->mic(mic_);
+  congestion_->updateSettings();
 }
 
 
@@ -119,6 +137,30 @@ void MediaManager::addParticipant(uint32_t sessionID,
     sdpToStats(sessionID, localInfo, true);
   }
 
+  // Both directions use the shorter of the negotiated audio frame durations.
+  // A peer without ptime only knows the old framing.
+  for(int i = 0; i < peerInfo->media.size(); ++i)
+  {
+    if (localInfo->media.at(i).type == "audio")
+    {
+      uint16_t localDuration = audioFrameDuration(localInfo->media.at(i));
+      uint16_t peerDuration = audioFrameDuration(peerInfo->media.at(i));
+
+      if (peerDuration == 0)
+      {
+        fg_->setAudioFrameDuration(LEGACY_AUDIO_FRAME_DURATION);
+      }
+      else if (localDuration == 0)
+      {
+        fg_->setAudioFrameDuration(peerDuration);
+      }
+      else
+      {
+        fg_->setAudioFrameDuration(qMin(localDuration, peerDuration));
+      }
+    }
+  }
+
   // create each agreed media stream
   for(int i = 0; i <peerInfo->media.size(); ++i)  {
     // TODO: I don't like that we match
@@ -398,6 +440,20 @@ void MediaManager::transportAttributes(const QList<SDPAttributeType>& attributes
 }
 
 
+uint16_t MediaManager::audioFrameDuration(const MediaInfo& media)
+{
+  for (auto& attribute : media.valueAttributes)
+  {
+    if (attribute.type == A_PTIME && attribute.value.toUInt() != 0)
+    {
+      return supportedAudioFrameDuration(attribute.value.toUInt());
+    }
+  }
+
+  return 0;
+}
+
+
 void MediaManager::sdpToStats(uint32_t sessionID, std::shared_ptr<SDPMessageInfo> sdp, bool incoming)
 {
   // TODO: This feels like a hack to this here. Instead we should give stats the whole SDP
@@ -25,6 +25,7 @@
 class VideoviewFactory;
 class StatisticsInterface;
 class Delivery;
+class CongestionController;
 
 class FilterGraph;
 class MediaSession;
@@ -94,12 +95,16 @@ private:
 
   void transportAttributes(const QList<SDPAttributeType> &attributes, bool& send, bool& recv);
 
+  // the ptime of the media or zero if it has none
+  uint16_t audioFrameDuration(const MediaInfo& media);
+
   void sdpToStats(uint32_t sessionID, std::shared_ptr<SDPMessageInfo> sdp, bool incoming);
 
   StatisticsInterface* stats_;
 
   std::unique_ptr<FilterGraph> fg_;
   std::unique_ptr<Delivery> streamer_;
+  std::unique_ptr<CongestionController> congestion_;
 
   std::shared_ptr<VideoviewFactory> viewfactory_;
 
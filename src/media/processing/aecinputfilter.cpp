@@ -6,7 +6,9 @@
 
 
 AECInputFilter::AECInputFilter(QString id, StatisticsInterface* stats):
-  Filter(id, "AEC input", stats, RAWAUDIO, RAWAUDIO)
+  Filter(id, "AEC input", stats, RAWAUDIO, RAWAUDIO),
+  aec_(nullptr),
+  sampleRate_(0)
 {}
 
 
@@ -15,9 +17,10 @@ AECInputFilter::~AECInputFilter()
   aec_->cleanup();
 }
 
-void AECInputFilter::initInput(QAudioFormat format)
+void AECInputFilter::initInput(QAudioFormat format, uint16_t frameDuration)
 {
-  aec_ = std::make_shared<AECProcessor>(format);
+  aec_ = std::make_shared<AECProcessor>(format, frameDuration);
+  sampleRate_ = format.sampleRate();
 }
 
 
@@ -33,6 +36,8 @@ void AECInputFilter::process()
 
   while(input)
   {
+    // echo cancellation is done in place
+    makeWritable(input.get());
     input->data = aec_->processInputFrame(std::move(input->data), input->data_size);
 
     if (input->data != nullptr)
@@ -11,13 +11,18 @@ public:
   AECInputFilter(QString id, StatisticsInterface* stats);
   ~AECInputFilter();
 
-  void initInput(QAudioFormat format);
+  void initInput(QAudioFormat format, uint16_t frameDuration);
 
   std::shared_ptr<AECProcessor> getAEC()
   {
     return aec_;
   }
 
+  virtual uint32_t inputSampleRate() const
+  {
+    return sampleRate_;
+  }
+
 protected:
 
   void process();
@@ -25,4 +30,5 @@ protected:
 private:
 
   std::shared_ptr<AECProcessor> aec_;
+  uint32_t sampleRate_;
 };
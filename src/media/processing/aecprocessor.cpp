@@ -15,9 +15,9 @@ bool PREPROCESSOR = true;
 // if you are in a large room, optimal time may be larger.
 const int REVERBERATION_TIME_MS = 100;
 
-AECProcessor::AECProcessor(QAudioFormat format):
+AECProcessor::AECProcessor(QAudioFormat format, uint16_t frameDuration):
   format_(format),
-  samplesPerFrame_(format.sampleRate()/AUDIO_FRAMES_PER_SECOND),
+  samplesPerFrame_(format.sampleRate()*frameDuration/1000),
   preprocessor_(nullptr),
   echo_state_(nullptr),
   echoSize_(0),
@@ -28,13 +28,19 @@ AECProcessor::AECProcessor(QAudioFormat format):
 
 
 void AECProcessor::updateSettings()
+{
+  echoMutex_.lock();
+  updateSettingsLocked();
+  echoMutex_.unlock();
+}
+
+
+void AECProcessor::updateSettingsLocked()
 {
   if (PREPROCESSOR && preprocessor_ != nullptr)
   {
     QSettings settings("kvazzup.ini", QSettings::IniFormat);
 
-    echoMutex_.lock();
-
     if (settings.value("audio/aec") == 1)
     {
       speex_preprocess_ctl(preprocessor_, SPEEX_PREPROCESS_SET_ECHO_STATE, echo_state_);
@@ -89,20 +95,36 @@ void AECProcessor::updateSettings()
 
     delete activeState;
     delete inactiveState;
-
-    echoMutex_.unlock();
   }
 }
 
 
-void AECProcessor::init()
+void AECProcessor::setFrameDuration(uint16_t frameDuration)
 {
-  if (preprocessor_ != nullptr || echo_state_ != nullptr)
+  echoMutex_.lock();
+  uint32_t samplesPerFrame = format_.sampleRate()*frameDuration/1000;
+
+  // no frame may be processed with states of the old size
+  if (samplesPerFrame != samplesPerFrame_)
   {
-    cleanup();
+    samplesPerFrame_ = samplesPerFrame;
+    initLocked();
   }
+  echoMutex_.unlock();
+}
+
 
+void AECProcessor::init()
+{
   echoMutex_.lock();
+  initLocked();
+  echoMutex_.unlock();
+}
+
+
+void AECProcessor::initLocked()
+{
+  cleanupLocked();
 
   // should be around 1/3 of the room reverberation time
   uint16_t echoFilterLength = format_.sampleRate()*REVERBERATION_TIME_MS/1000;
@@ -138,16 +160,20 @@ void AECProcessor::init()
                                                 format_.sampleRate());
   }
 
-  echoMutex_.unlock();
-
-  updateSettings();
+  updateSettingsLocked();
 }
 
 
 void AECProcessor::cleanup()
 {
   echoMutex_.lock();
+  cleanupLocked();
+  echoMutex_.unlock();
+}
 
+
+void AECProcessor::cleanupLocked()
+{
   if (preprocessor_ != nullptr)
   {
     speex_preprocess_state_destroy(preprocessor_);
@@ -159,24 +185,23 @@ void AECProcessor::cleanup()
     speex_echo_state_destroy(echo_state_);
     echo_state_ = nullptr;
   }
-
-  echoMutex_.unlock();
 }
 
 
-std::unique_ptr<uchar[]> AECProcessor::processInputFrame(std::unique_ptr<uchar[]> input,
-                                                         uint32_t dataSize)
+FrameBuffer AECProcessor::processInputFrame(FrameBuffer input, uint32_t dataSize)
 {
+  echoMutex_.lock();
+
   // The audiocapturefilter makes sure the frames are the correct (samplesPerFrame_) size.
+  // Frames captured before a frame duration change are dropped.
   if (dataSize != samplesPerFrame_*format_.bytesPerFrame())
   {
-    printProgramError(this, "Wrong size of input frame for AEC");
+    echoMutex_.unlock();
+    printWarning(this, "Wrong size of input frame for AEC");
     return nullptr;
   }
 
-  echoMutex_.lock();
-
-  if (echoSample_ != nullptr)
+  if (echoSample_ != nullptr && echo_state_ != nullptr)
   {
     // do not know if this is allowed, but it saves a copy
     int16_t* pcmOutput = (int16_t*)input.get();
@@ -185,15 +210,16 @@ std::unique_ptr<uchar[]> AECProcessor::processInputFrame(std::unique_ptr<uchar[]
                             (int16_t*)echoSample_, pcmOutput);
   }
 
-  echoMutex_.unlock();
-
   // Do preprocess trickery defined in init for input.
   // In my understanding preprocessor is run after echo cancellation for some reason.
+  // Under the mutex since a new frame duration recreates the states.
   if(preprocessor_ != nullptr)
   {
     speex_preprocess_run(preprocessor_, (int16_t*)input.get());
   }
 
+  echoMutex_.unlock();
+
   return input;
 }
 
@@ -203,14 +229,15 @@ void AECProcessor::processEchoFrame(uint8_t* echo,
 {
   // TODO: This should prepare for different size of frames in case since they
   // are not generated by us
+  echoMutex_.lock();
+
   if (dataSize != samplesPerFrame_*format_.bytesPerFrame())
   {
+    echoMutex_.unlock();
     printPeerError(this, "Wrong size of echo frame for AEC. AEC will no operate");
     return;
   }
 
-  echoMutex_.lock();
-
   if (echoSample_ == nullptr || echoSize_ != dataSize)
   {
     if (echoSample_ != nullptr)
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "framepool.h"
+
 #include <speex/speex_echo.h>
 #include <speex/speex_preprocess.h>
 
@@ -18,15 +20,17 @@ class AECProcessor : public QObject
 {
   Q_OBJECT
 public:
-  AECProcessor(QAudioFormat format);
+  AECProcessor(QAudioFormat format, uint16_t frameDuration);
 
   void updateSettings();
 
+  // recreates the speex states for frames of this many milliseconds
+  void setFrameDuration(uint16_t frameDuration);
+
   void init();
   void cleanup();
 
-  std::unique_ptr<uchar[]> processInputFrame(std::unique_ptr<uchar[]> input,
-                                             uint32_t dataSize);
+  FrameBuffer processInputFrame(FrameBuffer input, uint32_t dataSize);
 
   void processEchoFrame(uint8_t *echo,
                         uint32_t dataSize);
@@ -35,6 +39,11 @@ public:
 
 private:
 
+  // these assume echoMutex_ is held
+  void initLocked();
+  void cleanupLocked();
+  void updateSettingsLocked();
+
   QAudioFormat format_;
   uint32_t samplesPerFrame_;
 
@@ -12,13 +12,14 @@
 
 
 AudioCaptureFilter::AudioCaptureFilter(QString id, QAudioFormat format,
-                                       StatisticsInterface *stats):
+                                       uint16_t frameDuration, StatisticsInterface *stats):
   Filter(id, "Audio_Capture", stats, NONE, RAWAUDIO),
   deviceInfo_(),
   format_(format),
   audioInput_(nullptr),
   input_(nullptr),
-  frameSize_(format.sampleRate()*format.bytesPerFrame()/AUDIO_FRAMES_PER_SECOND),
+  frameDuration_(frameDuration),
+  frameSize_(format.sampleRate()*format.bytesPerFrame()*frameDuration/1000),
   buffer_(frameSize_, 0),
   wantedState_(QAudio::StoppedState)
 {}
@@ -89,6 +90,10 @@ bool AudioCaptureFilter::init()
     format_ = info.nearestFormat(format_);
   }
 
+  // FilterGraph resamples the audio if the microphone has a different rate
+  frameSize_ = format_.sampleRate()*format_.bytesPerFrame()*frameDuration_/1000;
+  buffer_.resize(frameSize_);
+
   if(format_.sampleRate() != -1)
     getStats()->audioInfo(format_.sampleRate(), format_.channelCount());
   else
@@ -122,6 +127,17 @@ void AudioCaptureFilter::createAudioInput()
 }
 
 
+void AudioCaptureFilter::setFrameDuration(uint16_t frameDuration)
+{
+  frameDuration_ = frameDuration;
+  frameSize_ = format_.sampleRate()*format_.bytesPerFrame()*frameDuration/1000;
+  buffer_.resize(frameSize_);
+
+  printNormal(this, "Changed audio frame duration", {"Duration (ms)"},
+              {QString::number(frameDuration)});
+}
+
+
 void AudioCaptureFilter::readMore()
 {
   if (!audioInput_ || !input_)
@@ -130,7 +146,7 @@ void AudioCaptureFilter::readMore()
     return;
   }
 
-  while (audioInput_->bytesReady() > frameSize_)
+  while (audioInput_->bytesReady() >= frameSize_)
   {
     qint64 len = audioInput_->bytesReady();
     if (len > 10*frameSize_)
@@ -149,10 +165,15 @@ void AudioCaptureFilter::readMore()
     {
       Data* newSample = new Data;
 
+      // The time of the first sample, so that the send delay includes waiting
+      // for the frame to fill. This is the part shorter frames make smaller.
+      int64_t buffered = (audioInput_->bytesReady() + readData)*1000/
+          (format_.sampleRate()*format_.bytesPerFrame());
+
       // create audio data packet to be sent to filter graph
-      newSample->presentationTime = QDateTime::currentMSecsSinceEpoch();
+      newSample->presentationTime = QDateTime::currentMSecsSinceEpoch() - buffered;
       newSample->type = RAWAUDIO;
-      newSample->data = std::unique_ptr<uint8_t[]>(new uint8_t[readData]);
+      newSample->data = allocateBuffer(readData);
 
       memcpy(newSample->data.get(), buffer_.constData(), readData);
 
@@ -160,6 +181,11 @@ void AudioCaptureFilter::readMore()
       newSample->width = 0;
       newSample->height = 0;
       newSample->source = LOCAL;
+      newSample->layer = 0;
+      newSample->stride[0] = 0;
+      newSample->stride[1] = 0;
+      newSample->stride[2] = 0;
+      newSample->sequenceNumber = 0;
       newSample->framerate = format_.sampleRate();
 
       std::unique_ptr<Data> u_newSample( newSample );
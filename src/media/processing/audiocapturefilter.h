@@ -13,7 +13,8 @@ class AudioCaptureFilter : public Filter
 {
   Q_OBJECT
 public:
-  AudioCaptureFilter(QString id, QAudioFormat format, StatisticsInterface* stats);
+  AudioCaptureFilter(QString id, QAudioFormat format, uint16_t frameDuration,
+                     StatisticsInterface* stats);
   virtual ~AudioCaptureFilter();
 
   virtual bool init(); // setups audio device and parameters.
@@ -21,6 +22,15 @@ public:
   virtual void start(); // resumes audio input
   virtual void stop(); // suspends audio input
 
+  // length of the sent frames in milliseconds
+  void setFrameDuration(uint16_t frameDuration);
+
+  // the rate of the microphone, which may differ from the requested one
+  virtual uint32_t outputSampleRate() const
+  {
+    return format_.sampleRate() > 0 ? format_.sampleRate() : 0;
+  }
+
 protected:
 
   // this does nothing. ReadMore does the sending of
@@ -46,6 +56,7 @@ private:
   QIODevice *input_;
   bool pullMode_;
 
+  uint16_t frameDuration_;
   int frameSize_;
   QByteArray buffer_;
 
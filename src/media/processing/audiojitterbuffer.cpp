@@ -0,0 +1,429 @@
+#include "audiojitterbuffer.h"
+
+#include "filter.h"
+#include "statisticsinterface.h"
+
+#include "common.h"
+#include "global.h"
+
+#include <QDateTime>
+
+#include <cmath>
+
+// the target delay is this many times the measured jitter
+const double JITTER_MULTIPLIER = 4.0;
+
+// upper limit for the target delay in milliseconds
+const uint16_t MAX_TARGET_DELAY = 400;
+
+// one second of audio at most. The oldest frames are discarded after this.
+const uint32_t MAX_BUFFER_DELAY = 1000;
+
+// frames are discarded if the buffer is this much deeper than the target
+const uint32_t SHRINK_MARGIN = 2;
+
+// after this many concealed frames in a row the buffer is refilled
+const unsigned int MAX_CONCEALED_FRAMES = 3;
+
+const int64_t REPORT_INTERVAL = 1000;
+
+
+AudioJitterBuffer::AudioJitterBuffer(uint32_t sessionID, QAudioFormat format,
+                                     StatisticsInterface* stats,
+                                     std::shared_ptr<FramePool> pool):
+  sessionID_(sessionID),
+  format_(format),
+  stats_(stats),
+  pool_(pool),
+  mutex_(),
+  frames_(),
+  bufferedBytes_(0),
+  playing_(false),
+  nextSequence_(0),
+  sequences_(),
+  transitKnown_(false),
+  previousTransit_(0),
+  jitter_(0.0),
+  frameDuration_(DEFAULT_AUDIO_FRAME_DURATION),
+  decoder_(nullptr),
+  opus_(false),
+  lastFrame_(),
+  lastFrameSize_(0),
+  lastPresentationTime_(0),
+  concealedInRow_(0),
+  playPosition_(0),
+  concealed_(0),
+  late_(0),
+  discarded_(0),
+  lastReport_(0)
+{
+  int error = 0;
+  decoder_ = opus_decoder_create(format_.sampleRate(), format_.channelCount(), &error);
+
+  if (error != OPUS_OK)
+  {
+    printDebug(DEBUG_WARNING, "Audio Jitter Buffer", "Failed to initialize opus decoder.",
+               {"Errorcode"}, {QString::number(error)});
+    decoder_ = nullptr;
+  }
+}
+
+
+AudioJitterBuffer::~AudioJitterBuffer()
+{
+  if (decoder_ != nullptr)
+  {
+    opus_decoder_destroy(decoder_);
+    decoder_ = nullptr;
+  }
+}
+
+
+void AudioJitterBuffer::insert(std::unique_ptr<Data> frame)
+{
+  if (frame == nullptr || frame->data_size == 0)
+  {
+    return;
+  }
+
+  if (frame->type == OPUSAUDIO && decoder_ == nullptr)
+  {
+    return;
+  }
+
+  uint32_t size = decodedSize(frame.get());
+  if (size == 0)
+  {
+    printDebug(DEBUG_WARNING, "Audio Jitter Buffer", "Received an invalid audio frame.");
+    return;
+  }
+
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+  QMutexLocker lock(&mutex_);
+
+  opus_ = frame->type == OPUSAUDIO;
+
+  // jitter as in RFC 3550. The presentation time follows the RTP timestamp.
+  int64_t transit = now - frame->presentationTime;
+  if (transitKnown_)
+  {
+    double deviation = std::abs((double)(transit - previousTransit_));
+    jitter_ += (deviation - jitter_)/16.0;
+  }
+  previousTransit_ = transit;
+  transitKnown_ = true;
+
+  uint32_t bytesPerSecond = format_.sampleRate()*format_.bytesPerFrame();
+  if (bytesPerSecond != 0)
+  {
+    frameDuration_ = qMax(1, (int)((uint64_t)size*1000/bytesPerSecond));
+  }
+
+  uint32_t sequence = sequences_.extend(frame->sequenceNumber);
+
+  // already played or concealed
+  if (playing_ && sequence < nextSequence_)
+  {
+    ++late_;
+    return;
+  }
+
+  if (frames_.find(sequence) != frames_.end())
+  {
+    return;
+  }
+
+  bufferedBytes_ += size;
+  frames_[sequence] = std::move(frame);
+
+  while (bufferedDelay() > MAX_BUFFER_DELAY)
+  {
+    bufferedBytes_ -= decodedSize(frames_.begin()->second.get());
+    frames_.erase(frames_.begin());
+    ++discarded_;
+
+    if (playing_ && !frames_.empty())
+    {
+      nextSequence_ = frames_.begin()->first;
+    }
+  }
+}
+
+
+std::unique_ptr<Data> AudioJitterBuffer::pull(uint32_t size)
+{
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+  QMutexLocker lock(&mutex_);
+
+  if (!playing_)
+  {
+    if (frames_.empty() || bufferedDelay() < targetDelay())
+    {
+      reportStatistics(now);
+      return nullptr;
+    }
+
+    playing_ = true;
+    nextSequence_ = frames_.begin()->first;
+    lastFrame_.reset();
+    lastFrameSize_ = 0;
+    playPosition_ = 0;
+  }
+
+  FrameBuffer output = pool_->allocate(size);
+  int64_t presentationTime = 0;
+
+  // the output is cut from as many received frames as it takes
+  uint32_t filled = 0;
+  while (filled < size)
+  {
+    if (playPosition_ == lastFrameSize_ && !nextFrame())
+    {
+      break;
+    }
+
+    if (filled == 0)
+    {
+      presentationTime = lastPresentationTime_ +
+          (int64_t)playPosition_*frameDuration_/qMax(1u, lastFrameSize_);
+    }
+
+    uint32_t length = qMin(size - filled, lastFrameSize_ - playPosition_);
+    memcpy(output.get() + filled, lastFrame_.get() + playPosition_, length);
+    playPosition_ += length;
+    filled += length;
+  }
+
+  reportStatistics(now);
+
+  if (filled == 0)
+  {
+    return nullptr;
+  }
+
+  // the stream stopped in the middle of the output
+  memset(output.get() + filled, 0, size - filled);
+
+  std::unique_ptr<Data> frame(new Data);
+  frame->type = RAWAUDIO;
+  frame->data = std::move(output);
+  frame->data_size = size;
+  frame->width = 0;
+  frame->height = 0;
+  frame->presentationTime = presentationTime;
+  frame->framerate = 0;
+  frame->source = REMOTE;
+  frame->layer = 0;
+  frame->stride[0] = 0;
+  frame->stride[1] = 0;
+  frame->stride[2] = 0;
+  frame->sequenceNumber = 0;
+  frame->enqueueTime = 0;
+
+  return frame;
+}
+
+
+bool AudioJitterBuffer::nextFrame()
+{
+  if (!playing_)
+  {
+    return false;
+  }
+
+  // too much delay has accumulated since the jitter has calmed down
+  if (!frames_.empty() &&
+      bufferedDelay() > targetDelay() + SHRINK_MARGIN*frameDuration_)
+  {
+    bufferedBytes_ -= decodedSize(frames_.begin()->second.get());
+    frames_.erase(frames_.begin());
+    ++discarded_;
+
+    if (!frames_.empty())
+    {
+      nextSequence_ = frames_.begin()->first;
+    }
+  }
+
+  // stop waiting for the missing frames
+  if (!frames_.empty() && frames_.begin()->first != nextSequence_ &&
+      concealedInRow_ >= MAX_CONCEALED_FRAMES)
+  {
+    nextSequence_ = frames_.begin()->first;
+  }
+
+  bool playing = true;
+
+  if (!frames_.empty() && frames_.begin()->first == nextSequence_)
+  {
+    std::unique_ptr<Data> frame = std::move(frames_.begin()->second);
+    frames_.erase(frames_.begin());
+    bufferedBytes_ -= decodedSize(frame.get());
+
+    playFrame(frame.get());
+    lastPresentationTime_ = frame->presentationTime;
+    concealedInRow_ = 0;
+  }
+  else if (concealedInRow_ < MAX_CONCEALED_FRAMES && lastFrame_ != nullptr)
+  {
+    // the frame is late or lost
+    concealFrame();
+    lastPresentationTime_ += frameDuration_;
+    ++concealed_;
+    ++concealedInRow_;
+  }
+  else
+  {
+    // the stream has stopped, wait until the buffer fills again
+    playing_ = false;
+    concealedInRow_ = 0;
+    playing = false;
+  }
+
+  playPosition_ = 0;
+  if (!playing)
+  {
+    lastFrame_.reset();
+    lastFrameSize_ = 0;
+  }
+
+  ++nextSequence_;
+  return playing;
+}
+
+
+void AudioJitterBuffer::clear()
+{
+  QMutexLocker lock(&mutex_);
+
+  discarded_ += frames_.size();
+  frames_.clear();
+  bufferedBytes_ = 0;
+  playing_ = false;
+  concealedInRow_ = 0;
+  lastFrame_.reset();
+  lastFrameSize_ = 0;
+  playPosition_ = 0;
+}
+
+
+uint32_t AudioJitterBuffer::targetDelay() const
+{
+  double delay = qMin((double)MAX_TARGET_DELAY, JITTER_MULTIPLIER*jitter_);
+
+  // at least one frame is always waiting
+  return frameDuration_*(1 + (uint32_t)std::ceil(delay/frameDuration_));
+}
+
+
+uint32_t AudioJitterBuffer::bufferedDelay() const
+{
+  uint32_t bytesPerSecond = format_.sampleRate()*format_.bytesPerFrame();
+  if (bytesPerSecond == 0)
+  {
+    return 0;
+  }
+
+  // includes what is left of the frame being played
+  uint32_t bytes = bufferedBytes_ + lastFrameSize_ - playPosition_;
+  return (uint64_t)bytes*1000/bytesPerSecond;
+}
+
+
+uint32_t AudioJitterBuffer::decodedSize(const Data* frame) const
+{
+  if (frame->type == OPUSAUDIO)
+  {
+    int samples = opus_packet_get_nb_samples(frame->data.get(), frame->data_size,
+                                             format_.sampleRate());
+    return samples > 0 ? samples*format_.bytesPerFrame() : 0;
+  }
+
+  return frame->data_size;
+}
+
+
+void AudioJitterBuffer::playFrame(const Data* frame)
+{
+  if (frame->type == OPUSAUDIO)
+  {
+    decode(frame->data.get(), frame->data_size, decodedSize(frame), false);
+  }
+  else
+  {
+    lastFrame_ = frame->data.share();
+    lastFrameSize_ = frame->data_size;
+  }
+}
+
+
+void AudioJitterBuffer::decode(const uint8_t* packet, uint32_t packetSize,
+                               uint32_t size, bool fec)
+{
+  FrameBuffer output = pool_->allocate(size);
+
+  int samples = opus_decode(decoder_, packet, packetSize, (opus_int16*)output.get(),
+                            size/format_.bytesPerFrame(), fec ? 1 : 0);
+
+  if (samples < 0)
+  {
+    printDebug(DEBUG_WARNING, "Audio Jitter Buffer", "Failed to decode audio frame.",
+               {"Error"}, {QString::number(samples)});
+
+    // silence keeps the timing
+    memset(output.get(), 0, size);
+    samples = size/format_.bytesPerFrame();
+  }
+
+  lastFrame_ = std::move(output);
+  lastFrameSize_ = samples*format_.bytesPerFrame();
+}
+
+
+void AudioJitterBuffer::concealFrame()
+{
+  // the missing frame is assumed to be as long as the previous one
+  uint32_t size = lastFrameSize_;
+
+  if (opus_)
+  {
+    // the next packet has the forward error correction data of this one
+    auto next = frames_.find(nextSequence_ + 1);
+    if (next != frames_.end() && next->second->type == OPUSAUDIO)
+    {
+      decode(next->second->data.get(), next->second->data_size, size, true);
+    }
+    else
+    {
+      decode(nullptr, 0, size, false);
+    }
+    return;
+  }
+
+  FrameBuffer frame = pool_->allocate(size);
+
+  // each repeat is half as loud as the previous one
+  const int16_t* previous = (const int16_t*)lastFrame_.get();
+  int16_t* samples = (int16_t*)frame.get();
+  for (unsigned int i = 0; i < size/sizeof(int16_t); ++i)
+  {
+    samples[i] = previous[i]/2;
+  }
+
+  lastFrame_ = std::move(frame);
+}
+
+
+void AudioJitterBuffer::reportStatistics(int64_t now)
+{
+  if (stats_ == nullptr || now - lastReport_ < REPORT_INTERVAL)
+  {
+    return;
+  }
+
+  lastReport_ = now;
+  stats_->updateAudioBuffer(sessionID_, bufferedDelay(), targetDelay(), concealed_,
+                            late_ + discarded_);
+}
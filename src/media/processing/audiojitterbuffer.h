@@ -0,0 +1,123 @@
+#pragma once
+
+#include "framepool.h"
+#include "sequenceextender.h"
+
+#include <opus.h>
+
+#include <QAudioFormat>
+#include <QMutex>
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+
+// Holds the received audio frames of one session until the audio device plays
+// them. Frames are ordered by their RTP sequence number and playback starts
+// once the buffer has reached its target depth. The device takes the audio
+// in its own frame size, so the peer may use any frame duration. The target
+// follows the measured jitter of the arrival times so that the delay stays
+// low on a steady network and grows when packets start arriving unevenly.
+//
+// Opus packets are kept encoded and decoded when they are played, so the
+// decoder sees them in order. If a packet has not arrived by the time it
+// should be played, it is recovered from the forward error correction data
+// of the next packet if that has arrived, or concealed by the decoder. The
+// packet is discarded as late if it arrives afterwards. Uncompressed audio is
+// concealed by fading out the previous frame. When the sender stops sending
+// during silence (Opus DTX), a few frames are concealed and the buffer is
+// then filled again at the start of the next talk spurt.
+
+class StatisticsInterface;
+struct Data;
+
+class AudioJitterBuffer
+{
+public:
+  AudioJitterBuffer(uint32_t sessionID, QAudioFormat format,
+                    StatisticsInterface* stats, std::shared_ptr<FramePool> pool);
+  ~AudioJitterBuffer();
+
+  // Called from the filter thread of the session. Takes Opus packets or
+  // uncompressed audio.
+  void insert(std::unique_ptr<Data> frame);
+
+  // Called by the audio device once per frame. Returns size bytes of audio
+  // or nullptr if there is nothing to play for this session.
+  std::unique_ptr<Data> pull(uint32_t size);
+
+  // drops the buffered frames and starts filling again
+  void clear();
+
+private:
+
+  // how many milliseconds of audio are kept to absorb the current jitter
+  uint32_t targetDelay() const;
+
+  // the buffered audio in milliseconds
+  uint32_t bufferedDelay() const;
+
+  // Moves to the next received or concealed frame. Returns false if playback
+  // has stopped.
+  bool nextFrame();
+
+  // the size of the frame once it has been decoded
+  uint32_t decodedSize(const Data* frame) const;
+
+  // makes the frame the one being played
+  void playFrame(const Data* frame);
+
+  // Decodes a packet, the FEC data in it or the concealment of the decoder
+  // if packet is nullptr into the frame being played.
+  void decode(const uint8_t* packet, uint32_t packetSize, uint32_t size, bool fec);
+
+  // replaces the frame being played with the concealment of the missing one
+  void concealFrame();
+
+  void reportStatistics(int64_t now);
+
+  uint32_t sessionID_;
+  QAudioFormat format_;
+  StatisticsInterface* stats_;
+  std::shared_ptr<FramePool> pool_;
+
+  QMutex mutex_;
+
+  // frames waiting to be played by their extended sequence number
+  std::map<uint32_t, std::unique_ptr<Data>> frames_;
+  uint32_t bufferedBytes_;
+
+  // playback waits until the buffer has been filled to the target
+  bool playing_;
+  uint32_t nextSequence_;
+
+  // sequence numbers are extended to 32 bits to handle wraparound
+  SequenceExtender sequences_;
+
+  // smoothed variation of the transit time in milliseconds, RFC 3550
+  bool transitKnown_;
+  int64_t previousTransit_;
+  double jitter_;
+
+  // duration of the received frames
+  uint16_t frameDuration_;
+
+  // decodes the Opus packets as they are played
+  OpusDecoder* decoder_;
+  bool opus_;
+
+  // the last played frame for concealment
+  FrameBuffer lastFrame_;
+  uint32_t lastFrameSize_;
+  int64_t lastPresentationTime_;
+  unsigned int concealedInRow_;
+
+  // how much of the last frame has been played
+  uint32_t playPosition_;
+
+  uint32_t concealed_;
+  uint32_t late_;
+  uint32_t discarded_;
+
+  int64_t lastReport_;
+};
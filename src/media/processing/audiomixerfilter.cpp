@@ -1,10 +1,12 @@
 #include "audiomixerfilter.h"
 
 #include "audiooutputdevice.h"
+#include "statisticsinterface.h"
 
 AudioMixerFilter::AudioMixerFilter(QString id, StatisticsInterface* stats,
-                 uint32_t sessionID, std::shared_ptr<AudioOutputDevice> output):
-  Filter(id, "Audio Mixer", stats, RAWAUDIO, RAWAUDIO),
+                 uint32_t sessionID, std::shared_ptr<AudioOutputDevice> output,
+                 DataType input):
+  Filter(id, "Audio Mixer", stats, input, RAWAUDIO),
   sessionID_(sessionID),
   output_(output)
 {}
@@ -16,6 +18,11 @@ void AudioMixerFilter::process()
 
   while(input)
   {
+    if (input->type == OPUSAUDIO)
+    {
+      getStats()->addReceivePacket(sessionID_, "Audio", input->data_size);
+    }
+
     if (output_)
     {
       output_->takeInput(std::move(input), sessionID_);
@@ -7,14 +7,16 @@ class AudioOutputDevice;
 
 // This class is only a passthough class which holds the streams sessionID
 // This sessionID can then be used to identify which stream a samples belongs
-// to in mixing.
+// to in mixing. Takes Opus packets or uncompressed audio, the jitter buffer
+// of the output decodes them.
 
 class AudioMixerFilter : public Filter
 {
 public:
 
   AudioMixerFilter(QString id, StatisticsInterface* stats,
-                   uint32_t sessionID, std::shared_ptr<AudioOutputDevice> output);
+                   uint32_t sessionID, std::shared_ptr<AudioOutputDevice> output,
+                   DataType input);
 
 protected:
   void process();
@@ -3,14 +3,32 @@
 #include "filter.h"
 #include "statisticsinterface.h"
 #include "aecprocessor.h"
+#include "audiojitterbuffer.h"
+#include "audioresampler.h"
 
 #include "common.h"
 #include "global.h"
 
+#include "optimized/audiomix.h"
+
 #include <QDateTime>
 
 #include <QDebug>
 
+// the limiter keeps the mix under this level
+const float LIMITER_THRESHOLD = 0.9f*INT16_MAX;
+
+// samples in a block of constant target gain. The limiter looks one block ahead.
+const unsigned int LIMITER_BLOCK = 32;
+
+// how much of the distance to the target the gain recovers each block
+const float LIMITER_RELEASE = 0.02f;
+
+const int64_t CLIP_REPORT_INTERVAL = 5000;
+
+// how many frames the audio device may buffer ahead of playback
+const int OUTPUT_BUFFER_FRAMES = 2;
+
 AudioOutputDevice::AudioOutputDevice(StatisticsInterface *stats):
   QIODevice(),
   stats_(stats),
@@ -18,26 +36,63 @@ AudioOutputDevice::AudioOutputDevice(StatisticsInterface *stats):
   audioOutput_(nullptr),
   output_(nullptr),
   format_(),
-  sampleMutex_(),
+  deviceFormat_(),
+  mixingMutex_(),
+  jitterBuffers_(),
+  mixingBuffer_(),
+  pool_(std::make_shared<FramePool>()),
+  frameDuration_(DEFAULT_AUDIO_FRAME_DURATION),
   outputSample_(nullptr),
   sampleSize_(0),
-  inputs_(0),
-  mixedSample_(false),
-  outputRepeats_(0)
-{}
+  resampler_(nullptr),
+  resampled_(),
+  playSample_(nullptr),
+  playSize_(0),
+  outputPosition_(0),
+  simd_(detectSIMDLevel()),
+  mixInputs_(),
+  mixSum_(),
+  limiterGain_(1.0f),
+  clippedSamples_(0),
+  reportedClips_(0),
+  lastClipReport_(0)
+{
+  printDebug(DEBUG_NORMAL, this, "Selected audio mixing kernel",
+             {"Instruction set"}, {simdLevelName(simd_)});
+}
 
 
 AudioOutputDevice::~AudioOutputDevice()
 {
   if (outputSample_ != nullptr)
   {
-    delete outputSample_;
+    delete[] outputSample_;
     outputSample_ = nullptr;
     sampleSize_ = 0;
   }
 }
 
 
+void AudioOutputDevice::addInput(uint32_t sessionID)
+{
+  mixingMutex_.lock();
+  if (jitterBuffers_.find(sessionID) == jitterBuffers_.end())
+  {
+    jitterBuffers_[sessionID] = std::make_shared<AudioJitterBuffer>(sessionID, format_,
+                                                                    stats_, pool_);
+  }
+  mixingMutex_.unlock();
+}
+
+
+void AudioOutputDevice::removeInput(uint32_t sessionID)
+{
+  mixingMutex_.lock();
+  jitterBuffers_.erase(sessionID);
+  mixingMutex_.unlock();
+}
+
+
 void AudioOutputDevice::updateSettings()
 {
   if (aec_)
@@ -47,20 +102,33 @@ void AudioOutputDevice::updateSettings()
 }
 
 
-void AudioOutputDevice::init(QAudioFormat format,
+void AudioOutputDevice::init(QAudioFormat format, uint16_t frameDuration,
                              std::shared_ptr<AECProcessor> AEC)
 {
   aec_ = AEC;
+  frameDuration_ = frameDuration;
+
+  // the frames are mixed in the codec format
+  format_ = format;
 
   QAudioDeviceInfo info(device_);
   if (!info.isFormatSupported(format)) {
     printDebug(DEBUG_WARNING, this,
                "Default format not supported - trying to use nearest.");
-    format_ = info.nearestFormat(format);
+    deviceFormat_ = info.nearestFormat(format);
   }
   else
   {
-    format_ = format;
+    deviceFormat_ = format;
+  }
+
+  // only the sample rate is converted
+  if (deviceFormat_.channelCount() != format_.channelCount() ||
+      deviceFormat_.sampleSize() != format_.sampleSize())
+  {
+    printWarning(this, "The audio output device does not support mono 16-bit audio.");
+    deviceFormat_.setChannelCount(format_.channelCount());
+    deviceFormat_.setSampleSize(format_.sampleSize());
   }
 
   createAudioOutput();
@@ -78,23 +146,64 @@ void AudioOutputDevice::createAudioOutput()
   {
     delete audioOutput_;
   }
-  audioOutput_ = new QAudioOutput(device_, format_, this);
+  audioOutput_ = new QAudioOutput(device_, deviceFormat_, this);
 
+  mixingMutex_.lock();
   if (outputSample_ != nullptr)
   {
-    delete outputSample_;
+    delete[] outputSample_;
     sampleSize_ = 0;
   }
 
-  sampleSize_ = format_.sampleRate()*format_.bytesPerFrame()/AUDIO_FRAMES_PER_SECOND;
+  sampleSize_ = format_.sampleRate()*format_.bytesPerFrame()*frameDuration_/1000;
   outputSample_ = aec_->createEmptyFrame(sampleSize_);
 
+  resampler_ = nullptr;
+  if (deviceFormat_.sampleRate() != format_.sampleRate())
+  {
+    printNormal(this, "Resampling the output audio", {"Rates"},
+                {QString::number(format_.sampleRate()) + " -> " +
+                 QString::number(deviceFormat_.sampleRate())});
+
+    resampler_ = std::unique_ptr<AudioResampler>(
+          new AudioResampler(format_.sampleRate(), deviceFormat_.sampleRate()));
+  }
+
+  // the first read mixes a new frame
+  playSample_ = outputSample_;
+  playSize_ = 0;
+  outputPosition_ = 0;
+  mixingMutex_.unlock();
+
+  // keep the device from buffering more than the necessary
+  audioOutput_->setBufferSize(OUTPUT_BUFFER_FRAMES*deviceFormat_.sampleRate()*
+                              deviceFormat_.bytesPerFrame()*frameDuration_/1000);
+
   open(QIODevice::ReadOnly);
   // pull mode
   audioOutput_->start(this);
 }
 
 
+void AudioOutputDevice::setFrameDuration(uint16_t frameDuration)
+{
+  if (frameDuration == frameDuration_)
+  {
+    return;
+  }
+
+  frameDuration_ = frameDuration;
+
+  // the jitter buffers give the new size from the next mix
+  mixingMutex_.lock();
+  mixingBuffer_.clear();
+  mixingMutex_.unlock();
+
+  // the device buffer is sized by the frames
+  createAudioOutput();
+}
+
+
 void AudioOutputDevice::deviceChanged(int index)
 {
   Q_UNUSED(index);
@@ -115,60 +224,67 @@ void AudioOutputDevice::volumeChanged(int value)
 
 qint64 AudioOutputDevice::readData(char *data, qint64 maxlen)
 {
-  uint32_t read = 0;
-  if (maxlen < sampleSize_)
+  if (!aec_ || outputSample_ == nullptr)
   {
-    printWarning(this, "Read too little audio data.", {"Read vs available"}, {
-                   QString::number(maxlen) + " vs " + QString::number(sampleSize_)});
+    printProgramError(this, "AEC not set");
+    return 0;
   }
-  else
+
+  // The device asks for audio whenever it has room in its buffer. A new frame
+  // is mixed only when the previous one has been played, so the mix is never
+  // more than one frame ahead of the device regardless of the participants.
+  QMutexLocker lock(&mixingMutex_);
+
+  qint64 read = 0;
+  while (read < maxlen)
   {
-    if (audioOutput_->periodSize() > sampleSize_)
+    if (outputPosition_ == playSize_)
     {
-      printWarning(this, "The audio Frame size is too small. "
-                         "Buffer output underflow.", {"PeriodSize vs frame size"}, {
-                     QString::number(audioOutput_->periodSize()) + " vs " +
-                     QString::number(sampleSize_)});
+      mixFrame();
     }
 
-    if (!aec_)
-    {
-      printProgramError(this, "AEC not set");
-    }
+    qint64 length = qMin((qint64)(playSize_ - outputPosition_), maxlen - read);
+    memcpy(data + read, playSample_ + outputPosition_, length);
+    outputPosition_ += length;
+    read += length;
+  }
 
-    // if no new input has arrived, we play the last sample
-    sampleMutex_.lock();
+  return read;
+}
 
-    // we keep track if this is a repeat so we can change it to silence.
-    if (!mixedSample_)
-    {
-      ++outputRepeats_;
-    }
-    else
-    {
-      mixedSample_ = false;
-    }
 
-    // start playing silence if we played last frame three times.
-    if (outputRepeats_ == 3)
-    {
-      if (outputSample_ != nullptr)
-      {
-        delete[] outputSample_;
-      }
+void AudioOutputDevice::mixFrame()
+{
+  pullFrames();
 
-      outputSample_ = aec_->createEmptyFrame(sampleSize_);
-    }
+  // sessions without a frame are silent in this mix
+  if (mixingBuffer_.empty())
+  {
+    memset(outputSample_, 0, sampleSize_);
+  }
+  else
+  {
+    FrameBuffer mixed = doMixing(sampleSize_);
+    memcpy(outputSample_, mixed.get(), sampleSize_);
+  }
 
-    // send sample to AEC
-    aec_->processEchoFrame(outputSample_, sampleSize_);
+  // send sample to AEC
+  aec_->processEchoFrame(outputSample_, sampleSize_);
 
-    // send sample to speakers
-    memcpy(data, outputSample_, sampleSize_);
-    read = sampleSize_;
-    sampleMutex_.unlock();
+  playSample_ = outputSample_;
+  playSize_ = sampleSize_;
+
+  if (resampler_ != nullptr && resampler_->isValid())
+  {
+    unsigned int samples = sampleSize_/sizeof(int16_t);
+    resampled_.resize(resampler_->maxOutput(samples));
+    samples = resampler_->process((const int16_t*)outputSample_, samples, resampled_.data());
+
+    playSample_ = (uint8_t*)resampled_.data();
+    playSize_ = samples*sizeof(int16_t);
   }
-  return read;
+
+  outputPosition_ = 0;
 }
 
 
@@ -199,117 +315,157 @@ void AudioOutputDevice::takeInput(std::unique_ptr<Data> input, uint32_t sessionI
 
     stats_->receiveDelay(sessionID, "Audio", delay);
 
-    int dataLeft = input->data_size;
-
-    // we record one sample to buffer in case there is a packet loss,
-    // just so we don't have any breaks
-    std::unique_ptr<uchar[]> outputFrame;
+    std::shared_ptr<AudioJitterBuffer> buffer = nullptr;
 
-    if (inputs_ < 2)
+    mixingMutex_.lock();
+    if (jitterBuffers_.find(sessionID) != jitterBuffers_.end())
     {
-      outputFrame = std::move(input->data);
+      buffer = jitterBuffers_[sessionID];
     }
-    else
-    {
-      outputFrame = mixAudio(std::move(input), sessionID);
+    mixingMutex_.unlock();
 
-      // if we are still waiting for other samples to mix
-      if (outputFrame == nullptr)
-      {
-        return;
-      }
+    // the jitter buffer cuts frames of any duration to our frame size
+    if (input->type == RAWAUDIO && input->data_size % format_.bytesPerFrame() != 0)
+    {
+      printWarning(this, "Received audio frame is not whole samples.", {"Size"},
+                   {QString::number(input->data_size)});
+      return;
     }
 
-    sampleMutex_.lock();
-    mixedSample_ = true;
-    outputRepeats_ = 0;
-
-    if (sampleSize_ != dataLeft)
+    if (buffer)
     {
-      outputSample_ = aec_->createEmptyFrame(dataLeft);
-      sampleSize_ = dataLeft;
+      buffer->insert(std::move(input));
     }
-
-    // I don't like this memcpy, but visual studio had problems with smart pointers.
-    memcpy(outputSample_, outputFrame.get(), sampleSize_);
-    sampleMutex_.unlock();
   }
 }
 
 
-std::unique_ptr<uchar[]> AudioOutputDevice::mixAudio(std::unique_ptr<Data> input,
-                                                     uint32_t sessionID)
+void AudioOutputDevice::pullFrames()
 {
-  std::unique_ptr<uchar[]> outputFrame = nullptr;
-  mixingMutex_.lock();
-  // mix if there is already a sample for this stream in buffer
-  if (mixingBuffer_.find(sessionID) != mixingBuffer_.end())
+  for (auto& buffer : jitterBuffers_)
   {
-    printWarning(this, "Mixing overflow. Missing samples.");
-    outputFrame = doMixing(input->data_size);
-    mixingBuffer_[sessionID] = std::move(input);
-  }
-  else
-  {
-    uint32_t size = input->data_size;
-    mixingBuffer_[sessionID] = std::move(input);
+    std::unique_ptr<Data> frame = buffer.second->pull(sampleSize_);
 
-    // mix if there is a sample for all streams
-    if (mixingBuffer_.size() == inputs_)
+    if (frame != nullptr)
     {
-      outputFrame = doMixing(size);
+      mixingBuffer_[buffer.first] = std::move(frame);
     }
   }
-
-  mixingMutex_.unlock();
-
-  return outputFrame;
 }
 
 
-std::unique_ptr<uchar[]> AudioOutputDevice::doMixing(uint32_t frameSize)
+FrameBuffer AudioOutputDevice::doMixing(uint32_t frameSize)
 {
   // don't do mixing if we have only one stream.
   if (mixingBuffer_.size() == 1)
   {
-    std::unique_ptr<uchar[]> oneSample = std::move(mixingBuffer_.begin()->second->data);
+    FrameBuffer oneSample = std::move(mixingBuffer_.begin()->second->data);
     mixingBuffer_.clear();
     return oneSample;
   }
 
-  std::unique_ptr<uchar[]> result = std::unique_ptr<uint8_t[]>(new uint8_t[frameSize]);
-  int16_t * output_ptr = (int16_t*)result.get();
+  unsigned int samples = frameSize/sizeof(int16_t);
+
+  mixInputs_.clear();
+  for (auto& buffer : mixingBuffer_)
+  {
+    mixInputs_.push_back((const int16_t*)buffer.second->data.get());
+  }
+
+  if (mixSum_.size() < samples)
+  {
+    mixSum_.resize(samples);
+  }
+
+  // 32-bit sums cannot overflow with 16-bit inputs
+  if (simd_ >= SIMD_AVX2)
+  {
+    mix_audio_avx2(mixInputs_.data(), mixInputs_.size(), mixSum_.data(), samples);
+  }
+  else if (simd_ == SIMD_SSE41)
+  {
+    mix_audio_sse41(mixInputs_.data(), mixInputs_.size(), mixSum_.data(), samples);
+  }
+  else
+  {
+    mix_audio_scalar(mixInputs_.data(), mixInputs_.size(), mixSum_.data(), samples);
+  }
+
+  FrameBuffer result = pool_->allocate(frameSize);
+  limit(mixSum_.data(), (int16_t*)result.get(), samples);
+
+  mixingBuffer_.clear();
+
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+  if (clippedSamples_ != reportedClips_ && now - lastClipReport_ >= CLIP_REPORT_INTERVAL)
+  {
+    printWarning(this, "Mixed audio was clipped", "Clipped samples",
+                 QString::number(clippedSamples_ - reportedClips_));
+    reportedClips_ = clippedSamples_;
+    lastClipReport_ = now;
+  }
+
+  return result;
+}
+
+
+void AudioOutputDevice::limit(const int32_t* mix, int16_t* output, unsigned int samples)
+{
+  float nextGain = blockGain(mix, qMin(LIMITER_BLOCK, samples));
 
-  for (unsigned int i = 0; i < frameSize/2; ++i)
+  for (unsigned int start = 0; start < samples; start += LIMITER_BLOCK)
   {
-    int32_t sum = 0;
+    unsigned int length = qMin(LIMITER_BLOCK, samples - start);
+    unsigned int next = start + length;
 
-    // This is in my understanding the correct way to do audio mixing. Just add them up.
-    for (auto& buffer : mixingBuffer_)
+    // look ahead so that the gain is already down when the peak arrives
+    float target = nextGain;
+    if (next < samples)
     {
-      sum += *((int16_t*)buffer.second->data.get() + i);
+      nextGain = blockGain(mix + next, qMin(LIMITER_BLOCK, samples - next));
+      target = qMin(target, nextGain);
     }
 
-    // clipping is not desired, but occurs rarely
-    // TODO: Replace this with dynamic range compression
-    if (sum > INT16_MAX)
+    // attack at once, release slowly
+    float endGain = target;
+    if (target > limiterGain_)
     {
-      printWarning(this, "Clipping audio", "Value", QString::number(sum));
-      sum = INT16_MAX;
+      endGain = limiterGain_ + (target - limiterGain_)*LIMITER_RELEASE;
     }
-    else if (sum < INT16_MIN)
+
+    if (simd_ >= SIMD_SSE41)
+    {
+      clippedSamples_ += mix_to_pcm_sse41(mix + start, output + start, length,
+                                          limiterGain_, endGain);
+    }
+    else
     {
-      printWarning(this, "Boosting audio", "Value", QString::number(sum));
-      sum = INT16_MIN;
+      clippedSamples_ += mix_to_pcm_scalar(mix + start, output + start, length,
+                                           limiterGain_, endGain);
     }
 
-    *output_ptr = sum;
-    ++output_ptr;
+    limiterGain_ = endGain;
   }
+}
 
-  mixingBuffer_.clear();
 
-  return result;
+float AudioOutputDevice::blockGain(const int32_t* mix, unsigned int samples)
+{
+  int32_t peak = 0;
+  if (simd_ >= SIMD_SSE41)
+  {
+    peak = mix_peak_sse41(mix, samples);
+  }
+  else
+  {
+    peak = mix_peak_scalar(mix, samples);
+  }
+
+  if (peak > LIMITER_THRESHOLD)
+  {
+    return LIMITER_THRESHOLD/peak;
+  }
+  return 1.0f;
 }
 
 
@@ -1,18 +1,29 @@
 #pragma once
 
+#include "framepool.h"
+#include "optimized/cpufeatures.h"
+
 #include <QAudioOutput>
 #include <QObject>
 #include <QMutex>
 
 #include <stdint.h>
 #include <memory>
+#include <vector>
 
 class Filter;
 class StatisticsInterface;
 class AECProcessor;
+class AudioJitterBuffer;
+class AudioResampler;
 struct Data;
 
-// TODO: There should be an audio buffer with minimum and maximum values so we always have data to send.
+// Plays the received audio. Each session has its own jitter buffer and the
+// audio device clock drives the mixing: when the device needs more data, one
+// frame is pulled from each jitter buffer and mixed. A session that has no
+// frame ready is concealed by its buffer or left out, so a late peer never
+// delays the others. The mix has the sample rate of the codec and is
+// resampled afterwards if the device does not support that rate.
 
 class AudioOutputDevice : public QIODevice
 {
@@ -23,8 +34,11 @@ public:
 
   void updateSettings();
 
-  void init(QAudioFormat format,
+  void init(QAudioFormat format, uint16_t frameDuration,
             std::shared_ptr<AECProcessor> AEC);
+
+  // plays frames of this many milliseconds
+  void setFrameDuration(uint16_t frameDuration);
   void start(); // resume audio output
   void stop(); // suspend audio output
 
@@ -32,49 +46,81 @@ public:
   qint64 writeData(const char *data, qint64 len) override;
   qint64 bytesAvailable() const override;
 
-  void addInput()
-  {
-    ++inputs_;
-  }
+  // creates the jitter buffer of the session
+  void addInput(uint32_t sessionID);
+  void removeInput(uint32_t sessionID);
 
-  void removeInput()
-  {
-    --inputs_;
-  }
-
-  // Receives input from filter graph and tells output that there is input available
+  // Receives input from filter graph and buffers it until it is played
   void takeInput(std::unique_ptr<Data> input, uint32_t sessionID);
 
 private:
 
   void createAudioOutput();
 
-  std::unique_ptr<uchar[]> mixAudio(std::unique_ptr<Data> input, uint32_t sessionID);
+  // Mixes the next frame of all sessions to the output sample. Must be called
+  // with mixingMutex_ locked.
+  void mixFrame();
+
+  // collects the next frame of every session to the mixing buffer
+  void pullFrames();
 
-  std::unique_ptr<uchar[]> doMixing(uint32_t frameSize);
+  FrameBuffer doMixing(uint32_t frameSize);
+
+  // Scales the mixed samples to 16 bits. The gain is lowered before loud
+  // peaks instead of clipping them and recovers slowly after them.
+  void limit(const int32_t* mix, int16_t* output, unsigned int samples);
+
+  // gain that keeps a block of samples under the limiter threshold
+  float blockGain(const int32_t* mix, unsigned int samples);
 
   StatisticsInterface* stats_;
 
   QAudioDeviceInfo device_;
   QAudioOutput *audioOutput_;
   QIODevice *output_; // not owned
+
+  // the format of the mixed frames and the one the device plays
   QAudioFormat format_;
+  QAudioFormat deviceFormat_;
 
   QMutex mixingMutex_;
+  std::map<uint32_t, std::shared_ptr<AudioJitterBuffer>> jitterBuffers_;
   std::map<uint32_t, std::unique_ptr<Data>> mixingBuffer_;
 
-  QMutex sampleMutex_;
-  // this will have the next played output audio. The same frame is played
-  // if no new frame has been received.
+  // buffers for mixed and concealed frames
+  std::shared_ptr<FramePool> pool_;
+
+  uint16_t frameDuration_;
+
+  // the mixed output audio
   uint8_t* outputSample_;
   uint32_t sampleSize_;
 
-  unsigned int inputs_;
+  // converts the mix to the rate of the device when they differ
+  std::unique_ptr<AudioResampler> resampler_;
+  std::vector<int16_t> resampled_;
+
+  // the mixed or resampled audio being played
+  uint8_t* playSample_;
+  uint32_t playSize_;
+
+  // how much of the played sample the device has read
+  uint32_t outputPosition_;
 
   std::shared_ptr<AECProcessor> aec_;
 
-  bool mixedSample_;
-  unsigned int outputRepeats_;
+  SIMDLevel simd_;
+
+  // reused between mixes so the audio thread does not allocate
+  std::vector<const int16_t*> mixInputs_;
+  std::vector<int32_t> mixSum_;
+
+  float limiterGain_;
+
+  // clipping is counted in the audio thread and reported from time to time
+  uint32_t clippedSamples_;
+  uint32_t reportedClips_;
+  int64_t lastClipReport_;
 
 private slots:
   void deviceChanged(int index);
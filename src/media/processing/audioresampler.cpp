@@ -0,0 +1,178 @@
+#include "audioresampler.h"
+
+#include "optimized/resample.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <math.h>
+
+// taps of each phase. Must be a multiple of eight for the kernels.
+const unsigned int RESAMPLER_TAPS = 32;
+
+// keeps the filter table at a reasonable size
+const uint32_t MAX_PHASES = 1024;
+
+// the cutoff as a fraction of the lower Nyquist frequency
+const double RESAMPLER_CUTOFF = 0.9;
+
+// M_PI is not defined by all compilers
+const double PI = 3.14159265358979323846;
+
+
+uint32_t greatestCommonDivisor(uint32_t a, uint32_t b)
+{
+  while (b != 0)
+  {
+    uint32_t remainder = a % b;
+    a = b;
+    b = remainder;
+  }
+  return a;
+}
+
+
+AudioResampler::AudioResampler(uint32_t inputRate, uint32_t outputRate):
+  interpolation_(1),
+  decimation_(1),
+  filters_(),
+  samples_(RESAMPLER_TAPS - 1, 0.0f),
+  position_(0),
+  simd_(detectSIMDLevel())
+{
+  uint32_t divisor = greatestCommonDivisor(inputRate, outputRate);
+  if (divisor == 0)
+  {
+    printDebug(DEBUG_PROGRAM_ERROR, "Audio Resampler", "Invalid sample rate");
+    return;
+  }
+
+  interpolation_ = outputRate/divisor;
+  decimation_ = inputRate/divisor;
+
+  if (interpolation_ > MAX_PHASES)
+  {
+    printDebug(DEBUG_WARNING, "Audio Resampler", "Resampling ratio is not supported",
+               {"Rates"}, {QString::number(inputRate) + " -> " + QString::number(outputRate)});
+    return;
+  }
+
+  // when decimating, the filter also removes what the output cannot represent
+  double cutoff = RESAMPLER_CUTOFF;
+  if (decimation_ > interpolation_)
+  {
+    cutoff *= (double)interpolation_/decimation_;
+  }
+
+  createFilters(cutoff);
+
+  printDebug(DEBUG_NORMAL, "Audio Resampler", "Created resampler",
+             {"Rates", "Phases", "Instruction set"},
+             {QString::number(inputRate) + " -> " + QString::number(outputRate),
+              QString::number(interpolation_), simdLevelName(simd_)});
+}
+
+
+void AudioResampler::createFilters(double cutoff)
+{
+  // The prototype runs at interpolation times the input rate. Its gain is the
+  // interpolation so that the inserted zeros do not lower the volume.
+  unsigned int length = interpolation_*RESAMPLER_TAPS;
+  double center = (length - 1)/2.0;
+  double frequency = cutoff/interpolation_;
+
+  std::vector<double> prototype(length);
+  for (unsigned int i = 0; i < length; ++i)
+  {
+    double x = (i - center)*PI*frequency;
+    double sinc = (x == 0.0) ? 1.0 : sin(x)/x;
+
+    // Blackman window
+    double window = 0.42 - 0.5*cos(2*PI*i/(length - 1)) + 0.08*cos(4*PI*i/(length - 1));
+
+    prototype[i] = interpolation_*frequency*sinc*window;
+  }
+
+  // the taps of a phase are stored oldest sample first
+  filters_.resize(length);
+  for (unsigned int phase = 0; phase < interpolation_; ++phase)
+  {
+    for (unsigned int tap = 0; tap < RESAMPLER_TAPS; ++tap)
+    {
+      filters_[phase*RESAMPLER_TAPS + tap] =
+          prototype[phase + (RESAMPLER_TAPS - 1 - tap)*interpolation_];
+    }
+  }
+}
+
+
+unsigned int AudioResampler::maxOutput(unsigned int inputSamples) const
+{
+  return (uint64_t)inputSamples*interpolation_/decimation_ + 1;
+}
+
+
+unsigned int AudioResampler::process(const int16_t* input, unsigned int inputSamples,
+                                     int16_t* output)
+{
+  if (!isValid())
+  {
+    return 0;
+  }
+
+  unsigned int history = RESAMPLER_TAPS - 1;
+  samples_.resize(history + inputSamples);
+
+  if (simd_ >= SIMD_SSE41)
+  {
+    resample_load_sse41(input, samples_.data() + history, inputSamples);
+  }
+  else
+  {
+    resample_load_scalar(input, samples_.data() + history, inputSamples);
+  }
+
+  // the output is computed while all the taps have samples
+  uint64_t end = (uint64_t)inputSamples*interpolation_;
+
+  unsigned int outputSamples = 0;
+  for (; position_ < end; position_ += decimation_)
+  {
+    const float* samples = samples_.data() + position_/interpolation_;
+    const float* taps = filters_.data() + (position_ % interpolation_)*RESAMPLER_TAPS;
+
+    float value = 0.0f;
+    if (simd_ >= SIMD_AVX2)
+    {
+      value = resample_dot_avx2(samples, taps, RESAMPLER_TAPS);
+    }
+    else if (simd_ == SIMD_SSE41)
+    {
+      value = resample_dot_sse41(samples, taps, RESAMPLER_TAPS);
+    }
+    else
+    {
+      value = resample_dot_scalar(samples, taps, RESAMPLER_TAPS);
+    }
+
+    int32_t rounded = (int32_t)lrintf(value);
+    if (rounded > INT16_MAX)
+    {
+      rounded = INT16_MAX;
+    }
+    else if (rounded < INT16_MIN)
+    {
+      rounded = INT16_MIN;
+    }
+
+    output[outputSamples] = rounded;
+    ++outputSamples;
+  }
+
+  // the newest samples are the history of the next block
+  position_ -= end;
+  std::copy(samples_.end() - history, samples_.end(), samples_.begin());
+  samples_.resize(history);
+
+  return outputSamples;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "optimized/cpufeatures.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Changes the sample rate of 16-bit mono audio with a polyphase FIR filter.
+// The ratio of the rates is reduced to interpolation/decimation and one
+// phase of a windowed sinc filter is computed for each of the interpolation
+// steps, so any ratio of the usual audio rates is exact. The filter history
+// is kept between calls and the audio can be given in blocks of any size.
+
+class AudioResampler
+{
+public:
+  AudioResampler(uint32_t inputRate, uint32_t outputRate);
+
+  // false if the ratio of the rates needs too many phases
+  bool isValid() const
+  {
+    return !filters_.empty();
+  }
+
+  // The number of output samples the input produces. Can be one more than
+  // the exact ratio because of the fractional position.
+  unsigned int maxOutput(unsigned int inputSamples) const;
+
+  // returns the number of samples written to output
+  unsigned int process(const int16_t* input, unsigned int inputSamples, int16_t* output);
+
+private:
+
+  void createFilters(double cutoff);
+
+  uint32_t interpolation_;
+  uint32_t decimation_;
+
+  // the taps of each phase in the order they are applied to the samples
+  std::vector<float> filters_;
+
+  // the history of the previous block followed by the current input
+  std::vector<float> samples_;
+
+  // position of the next output in the samples in 1/interpolation steps
+  uint64_t position_;
+
+  SIMDLevel simd_;
+};
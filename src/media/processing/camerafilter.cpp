@@ -3,6 +3,8 @@
 #include "cameraframegrabber.h"
 #include "statisticsinterface.h"
 
+#include "optimized/yuvrepack.h"
+
 #include "common.h"
 
 #include <QSettings>
@@ -193,6 +195,22 @@ bool CameraFilter::cameraSetup()
       viewSettings.setPixelFormat(QVideoFrame::Format_YUV420P);
       output_ = YUV420VIDEO;
     }
+    // these are repacked to YUV420P so no colour conversion is needed
+    else if(currentInputFormat_ == "YV12")
+    {
+      viewSettings.setPixelFormat(QVideoFrame::Format_YV12);
+      output_ = YUV420VIDEO;
+    }
+    else if(currentInputFormat_ == "NV12")
+    {
+      viewSettings.setPixelFormat(QVideoFrame::Format_NV12);
+      output_ = YUV420VIDEO;
+    }
+    else if(currentInputFormat_ == "YUYV")
+    {
+      viewSettings.setPixelFormat(QVideoFrame::Format_YUYV);
+      output_ = YUV420VIDEO;
+    }
     else
     {
       printError(this, "Input format not supported");
@@ -308,6 +326,12 @@ void CameraFilter::process()
     frames_.pop_front();
     frameMutex_.unlock();
 
+    // the encoder would discard this frame anyway
+    if(skipFrame())
+    {
+      continue;
+    }
+
     // capture the frame data
     Data * newImage = new Data;
     newImage->presentationTime = QDateTime::currentMSecsSinceEpoch();
@@ -316,17 +340,30 @@ void CameraFilter::process()
     QVideoFrame cloneFrame(frame);
     cloneFrame.map(QAbstractVideoBuffer::ReadOnly);
 
-    newImage->data = std::unique_ptr<uchar[]>(new uchar[cloneFrame.mappedBytes()]);
-    uchar *bits = cloneFrame.bits();
-
-    memcpy(newImage->data.get(), bits, cloneFrame.mappedBytes());
-    newImage->data_size = cloneFrame.mappedBytes();
     // kvazaar requires divisable by 8 resolution
     newImage->width = cloneFrame.width() - cloneFrame.width()%8;
     newImage->height = cloneFrame.height() - cloneFrame.height()%8;
     newImage->source = LOCAL;
+    newImage->layer = 0;
+    newImage->stride[0] = 0;
+    newImage->stride[1] = 0;
+    newImage->stride[2] = 0;
+    newImage->sequenceNumber = 0;
     newImage->framerate = framerate_;
 
+    if (output_ == YUV420VIDEO)
+    {
+      copyYUVFrame(cloneFrame, newImage);
+    }
+    else
+    {
+      newImage->data = allocateBuffer(cloneFrame.mappedBytes());
+      uchar *bits = cloneFrame.bits();
+
+      memcpy(newImage->data.get(), bits, cloneFrame.mappedBytes());
+      newImage->data_size = cloneFrame.mappedBytes();
+    }
+
     std::unique_ptr<Data> u_newImage( newImage );
     cloneFrame.unmap();
 
@@ -334,3 +371,55 @@ void CameraFilter::process()
     sendOutput(std::move(u_newImage));
   }
 }
+
+
+void CameraFilter::copyYUVFrame(const QVideoFrame& frame, Data* output)
+{
+  int width = output->width;
+  int height = output->height;
+
+  output->data_size = width*height + width*height/2;
+  output->data = allocateBuffer(output->data_size);
+
+  uint8_t* out_y = output->data.get();
+  uint8_t* out_u = out_y + width*height;
+  uint8_t* out_v = out_u + width*height/4;
+
+  switch (frame.pixelFormat())
+  {
+  case QVideoFrame::Format_YUV420P:
+  {
+    copy_plane(frame.bits(0), frame.bytesPerLine(0), out_y, width, height);
+    copy_plane(frame.bits(1), frame.bytesPerLine(1), out_u, width/2, height/2);
+    copy_plane(frame.bits(2), frame.bytesPerLine(2), out_v, width/2, height/2);
+    break;
+  }
+  case QVideoFrame::Format_YV12:
+  {
+    // same as YUV420P, but V comes first
+    copy_plane(frame.bits(0), frame.bytesPerLine(0), out_y, width, height);
+    copy_plane(frame.bits(1), frame.bytesPerLine(1), out_v, width/2, height/2);
+    copy_plane(frame.bits(2), frame.bytesPerLine(2), out_u, width/2, height/2);
+    break;
+  }
+  case QVideoFrame::Format_NV12:
+  {
+    nv12_to_i420_sse2(frame.bits(0), frame.bytesPerLine(0),
+                      frame.bits(1), frame.bytesPerLine(1),
+                      out_y, width, height);
+    break;
+  }
+  case QVideoFrame::Format_YUYV:
+  {
+    yuyv_to_i420_sse2(frame.bits(), frame.bytesPerLine(), out_y, width, height);
+    break;
+  }
+  default:
+  {
+    printProgramWarning(this, "Camera gave a format we did not ask for",
+                        "Format", QString::number(frame.pixelFormat()));
+    memset(out_y, 0, output->data_size);
+    break;
+  }
+  }
+}
@@ -44,6 +44,9 @@ private:
 
   bool initialCameraSetup();
 
+  // copies a YUV camera frame to output as YUV420P, cropped to the output resolution
+  void copyYUVFrame(const QVideoFrame& frame, Data* output);
+
   // setup camera device. For some reason this has to be called from main thread
   bool cameraSetup();
 
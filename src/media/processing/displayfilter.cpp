@@ -85,20 +85,39 @@ void DisplayFilter::process()
 
     if(input->type == input_)
     {
-      QImage image(
-            input->data.get(),
-            input->width,
-            input->height,
-            format);
+      int32_t delay = QDateTime::currentMSecsSinceEpoch() - input->presentationTime;
 
-      if(flipEnabled_)
+      if(input_ == YUV420VIDEO)
       {
-        image = image.mirrored(horizontalMirroring_, verticalMirroring_);
+        // the widget converts and mirrors the planes itself. The image only
+        // tells the size and row pitch of the luma plane.
+        int lumaStride = input->stride[0] ? input->stride[0] : input->width;
+        int chromaStride = input->stride[1] ? input->stride[1] : input->width/2;
+        Q_ASSERT(input->stride[1] == input->stride[2]);
+
+        QImage luma(input->data.get(), input->width, input->height,
+                    lumaStride, QImage::Format_Grayscale8);
+
+        widget_->inputYUV(std::move(input->data), luma, chromaStride,
+                          flipEnabled_ && horizontalMirroring_,
+                          flipEnabled_ && verticalMirroring_,
+                          input->presentationTime);
+      }
+      else
+      {
+        QImage image(
+              input->data.get(),
+              input->width,
+              input->height,
+              format);
+
+        if(flipEnabled_ && (horizontalMirroring_ || verticalMirroring_))
+        {
+          image = image.mirrored(horizontalMirroring_, verticalMirroring_);
+        }
+
+        widget_->inputImage(std::move(input->data),image, input->presentationTime);
       }
-
-      int32_t delay = QDateTime::currentMSecsSinceEpoch() - input->presentationTime;
-
-      widget_->inputImage(std::move(input->data),image, input->presentationTime);
 
       if( sessionID_ != 1111)
         getStats()->receiveDelay(sessionID_, "Video", delay);
@@ -0,0 +1,83 @@
+#include "downscalefilter.h"
+
+#include "optimized/yuvscale.h"
+#include "common.h"
+
+DownscaleFilter::DownscaleFilter(QString id, StatisticsInterface* stats, uint8_t layer):
+  Filter(id, "Downscale", stats, YUV420VIDEO, YUV420VIDEO),
+  layer_(layer)
+{}
+
+
+void DownscaleFilter::process()
+{
+  std::unique_ptr<Data> input = getInput();
+
+  while(input)
+  {
+    if(skipFrame())
+    {
+      input = getInput();
+      continue;
+    }
+
+    int width = input->width;
+    int height = input->height;
+
+    if (halved_size(width, layer_) == 0 || halved_size(height, layer_) == 0)
+    {
+      printProgramWarning(this, "Input is too small to be downscaled",
+                          "Resolution", QString::number(width) + "x" + QString::number(height));
+      input = getInput();
+      continue;
+    }
+
+    // the planes of the input may be padded to a larger row pitch
+    int yStride = input->stride[0] ? input->stride[0] : width;
+    int uStride = input->stride[1] ? input->stride[1] : width/2;
+    int vStride = input->stride[2] ? input->stride[2] : width/2;
+
+    const uint8_t* inY = input->data.get();
+    const uint8_t* inU = inY + yStride*height;
+    const uint8_t* inV = inU + uStride*height/2;
+
+    // all but the last halving go to the intermediate buffers
+    for (uint8_t i = 1; i < layer_; ++i)
+    {
+      std::vector<uint8_t>& intermediate = intermediate_[i % 2];
+      intermediate.resize(halved_size(width, 1)*halved_size(height, 1)*3/2);
+
+      halve_yuv420(inY, yStride, inU, uStride, inV, vStride, width, height,
+                   intermediate.data(), true);
+      width = halved_size(width, 1);
+      height = halved_size(height, 1);
+
+      inY = intermediate.data();
+      inU = inY + width*height;
+      inV = inU + width*height/4;
+      yStride = width;
+      uStride = width/2;
+      vStride = width/2;
+    }
+
+    int outWidth = halved_size(width, 1);
+    int outHeight = halved_size(height, 1);
+    uint32_t outSize = outWidth*outHeight*3/2;
+
+    FrameBuffer output = allocateBuffer(outSize);
+    halve_yuv420(inY, yStride, inU, uStride, inV, vStride, width, height,
+                 output.get(), true);
+
+    input->data = std::move(output);
+    input->data_size = outSize;
+    input->width = outWidth;
+    input->height = outHeight;
+    input->stride[0] = 0;
+    input->stride[1] = 0;
+    input->stride[2] = 0;
+    input->layer = layer_;
+    sendOutput(std::move(input));
+
+    input = getInput();
+  }
+}
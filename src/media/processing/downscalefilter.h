@@ -0,0 +1,24 @@
+#pragma once
+#include "filter.h"
+
+#include <vector>
+
+// Halves the resolution of YUV420 video once for each simulcast layer. The
+// output is tagged with the layer so the peers can choose between layers.
+
+class DownscaleFilter : public Filter
+{
+public:
+  DownscaleFilter(QString id, StatisticsInterface* stats, uint8_t layer);
+
+protected:
+
+  void process();
+
+private:
+
+  uint8_t layer_;
+
+  // the pictures between halvings when halving more than once
+  std::vector<uint8_t> intermediate_[2];
+};
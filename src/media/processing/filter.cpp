@@ -1,10 +1,26 @@
 #include "filter.h"
 
+#include "filterscheduler.h"
+#include "filtertracer.h"
 #include "statisticsinterface.h"
 
 #include "common.h"
 
+#include <QDateTime>
 #include <QDebug>
+#include <QSettings>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Upper limit for buffered inputs. Also used when the buffer size is unlimited.
+const uint32_t INPUT_QUEUE_CAPACITY = 1024;
+
+// how many frames the framerate stays halved after the bottleneck was saturated
+const uint32_t HALVED_FRAMES = 30;
 
 Filter::Filter(QString id, QString name, StatisticsInterface *stats,
                DataType input, DataType output):
@@ -16,10 +32,36 @@ Filter::Filter(QString id, QString name, StatisticsInterface *stats,
   stats_(stats),
   waitMutex_(new QMutex),
   hasInput_(),
+  wakeups_(0),
+  sleeping_(false),
   running_(true),
+  inBuffer_(INPUT_QUEUE_CAPACITY),
+  discardUntilIntra_(false),
   inputTaken_(0),
   inputDiscarded_(0),
-  filterID_(0)
+  filterID_(0),
+  pool_(std::make_shared<FramePool>()),
+  allocations_(0),
+  outputPoolMutex_(),
+  outputPool_(),
+  pooled_(false),
+  taskState_(TASK_IDLE),
+  taskMutex_(),
+  taskDone_(),
+  cpuTime_(0),
+  reportedCPUTime_(0),
+  lastCPUReport_(0),
+  backpressurePolicy_(BACKPRESSURE_NEWEST),
+  backpressureMutex_(),
+  bottleneck_(),
+  halvedFrames_(0),
+  backpressureFrames_(0),
+  framesSkipped_(0),
+  traceRegistered_(false),
+  traceID_(0),
+  traceOpen_(false),
+  traceEnqueue_(0),
+  traceDequeue_(0)
 {}
 
 Filter::~Filter()
@@ -29,6 +71,9 @@ Filter::~Filter()
 
 void Filter::updateSettings()
 {
+  QSettings settings("kvazzup.ini", QSettings::IniFormat);
+  backpressurePolicy_ = settings.value("video/backpressure").toInt();
+
   // use the following in inherited code. This way the config doesn't go to registry.
   // QSettings settings("kvazzup.ini", QSettings::IniFormat);
 
@@ -68,13 +113,90 @@ void Filter::removeOutConnection(std::shared_ptr<Filter> out)
   }
 }
 
+bool Filter::isSaturated() const
+{
+  return maxBufferSize_ != -1 && inBuffer_.size() + 1 >= (uint32_t)maxBufferSize_;
+}
+
+void Filter::setBackpressure(std::shared_ptr<Filter> bottleneck)
+{
+  QSettings settings("kvazzup.ini", QSettings::IniFormat);
+  backpressurePolicy_ = settings.value("video/backpressure").toInt();
+
+  backpressureMutex_.lock();
+  bottleneck_ = bottleneck;
+  backpressureMutex_.unlock();
+}
+
+void Filter::setOutputPool(std::shared_ptr<FramePool> pool)
+{
+  outputPoolMutex_.lock();
+  outputPool_ = pool;
+  outputPoolMutex_.unlock();
+}
+
+bool Filter::skipFrame()
+{
+  backpressureMutex_.lock();
+  std::shared_ptr<Filter> bottleneck = bottleneck_.lock();
+  backpressureMutex_.unlock();
+
+  if(!bottleneck || backpressurePolicy_ == BACKPRESSURE_DISABLED)
+  {
+    return false;
+  }
+
+  bool saturated = bottleneck->isSaturated();
+  bool skip = false;
+
+  if(backpressurePolicy_ == BACKPRESSURE_NEWEST)
+  {
+    // Nothing is produced for a full buffer. When there is room again, the
+    // next frame captured is the newest one. A filter in the middle of the
+    // chain also skips a frame if a newer one is already waiting behind it
+    // and the bottleneck still has work queued.
+    skip = saturated ||
+        (input_ != NONE && inBuffer_.size() > 0 && bottleneck->inBuffer_.size() > 0);
+  }
+  else if(backpressurePolicy_ == BACKPRESSURE_HALVE)
+  {
+    // producing a frame for a full buffer would only discard an older frame
+    skip = saturated;
+
+    // Only the source halves the framerate, otherwise each filter in the
+    // chain would halve it again.
+    if(input_ == NONE)
+    {
+      if(skip)
+      {
+        halvedFrames_ = HALVED_FRAMES;
+      }
+      else if(halvedFrames_ > 0)
+      {
+        --halvedFrames_;
+        skip = (++backpressureFrames_)%2 == 0;
+      }
+    }
+  }
+
+  if(skip)
+  {
+    ++framesSkipped_;
+    stats_->packetDropped(filterID_);
+    if(framesSkipped_ == 1 || framesSkipped_%30 == 0)
+    {
+      printDebug(DEBUG_NORMAL, this, "Skipping frames because of backpressure",
+                 {"Bottleneck", "Skipped"}, {bottleneck->getName(), QString::number(framesSkipped_)});
+    }
+  }
+
+  return skip;
+}
+
 void Filter::emptyBuffer()
 {
-  bufferMutex_.lock();
-  //std::queue<std::unique_ptr<Data>> empty;
-  std::deque<std::unique_ptr<Data>> empty;
-  std::swap( inBuffer_, empty );
-  bufferMutex_.unlock();
+  while(inBuffer_.pop())
+  {}
 }
 
 void Filter::putInput(std::unique_ptr<Data> data)
@@ -90,69 +212,112 @@ void Filter::putInput(std::unique_ptr<Data> data)
   }
 
   ++inputTaken_;
-
-  bufferMutex_.lock();
+  // reading the clock for every frame is not free
+  data->enqueueTime = FilterTracer::enabled() ? FilterTracer::now() : 0;
 
   if(inputTaken_%30 == 0)
   {
     stats_->updateBufferStatus(filterID_, inBuffer_.size(), maxBufferSize_);
   }
 
-  inBuffer_.push_back(std::move(data));
+  if(maxBufferSize_ != -1 && inBuffer_.size() + 1 >= (uint32_t)maxBufferSize_)
+  {
+    discardOldest();
+  }
+
+  // the queue can only be full if the consumer is very late
+  while(!inBuffer_.push(data))
+  {
+    discardOldest();
+  }
+
+  wakeUp();
+}
+
+void Filter::discardOldest()
+{
+  std::unique_ptr<Data> oldest = inBuffer_.pop();
 
-  if(maxBufferSize_ != -1 && inBuffer_.size() >= (uint32_t)maxBufferSize_)
+  if(!oldest)
   {
-    if(inBuffer_[0]->type == HEVCVIDEO)
+    // the filter took the input before us
+    return;
+  }
+
+  if(oldest->type == HEVCVIDEO)
+  {
+    // Discard everything until the next intra frame
+    if(!discardUntilIntra_)
     {
-      // Search for intra frames and discard everything up to it
-      for(uint32_t i = 0; i < inBuffer_.size(); ++i)
-      {
-        const unsigned char *buff = inBuffer_.at(i)->data.get();
-        if(!isHEVCIntra(buff))
-        {
-          qDebug() << "Processing," << metaObject()->className() << ": Discarding" << i
-                   << "HEVC frames. Found non inter frame from buffer at :" << i;
-          for(int j = i; j != 0; --j)
-          {
-            inBuffer_.pop_front();
-          }
-          break;
-        }
-      }
+      emit keyframeNeeded();
     }
-    else
+    discardUntilIntra_ = true;
+  }
+  else if(oldest->type == OPUSAUDIO)
+  {
+    printDebug(DEBUG_WARNING, this,  "Should input Null pointer to decoder.");
+  }
+
+  ++inputDiscarded_;
+  stats_->packetDropped(filterID_);
+  if(inputDiscarded_ == 1 || inputDiscarded_%10 == 0)
+  {
+    qDebug() << "Processing," << name_ << "buffer full. Discarded input:"
+             << inputDiscarded_.load()  << "Total input:" << inputTaken_.load();
+  }
+}
+
+std::unique_ptr<Data> Filter::getInput()
+{
+  std::unique_ptr<Data> r = inBuffer_.pop();
+
+  while(r && discardUntilIntra_ && r->type == HEVCVIDEO)
+  {
+    const unsigned char *buff = r->data.get();
+    if(!isHEVCIntra(buff))
     {
-      if(inBuffer_[0]->type == OPUSAUDIO)
-      {
-        printDebug(DEBUG_WARNING, this,  "Should input Null pointer to decoder.");
-      }
-      inBuffer_.pop_front(); // discard the oldest
+      qDebug() << "Processing," << metaObject()->className()
+               << ": Found non inter frame after discarding HEVC frames.";
+      discardUntilIntra_ = false;
+      break;
     }
 
     ++inputDiscarded_;
     stats_->packetDropped(filterID_);
-    if(inputDiscarded_ == 1 || inputDiscarded_%10 == 0)
+    r = inBuffer_.pop();
+  }
+
+  if(FilterTracer::enabled())
+  {
+    // taking the next input means the previous one has been processed
+    int64_t now = FilterTracer::now();
+    finishTrace(now);
+
+    if(r)
     {
-      qDebug() << "Processing," << name_ << "buffer full. Discarded input:"
-               << inputDiscarded_  << "Total input:" << inputTaken_;
+      traceOpen_ = true;
+      // the input was queued before tracing was enabled
+      traceEnqueue_ = r->enqueueTime != 0 ? r->enqueueTime : now;
+      traceDequeue_ = now;
     }
   }
-  wakeUp();
 
-  bufferMutex_.unlock();
+  return r;
 }
 
-std::unique_ptr<Data> Filter::getInput()
+void Filter::finishTrace(int64_t end)
 {
-  bufferMutex_.lock();
-  std::unique_ptr<Data> r;
-  if(!inBuffer_.empty())
+  if(traceOpen_)
   {
-    r = std::move(inBuffer_.front());
-    inBuffer_.pop_front();
+    if(!traceRegistered_)
+    {
+      traceID_ = FilterTracer::registerFilter(name_ + " " + id_);
+      traceRegistered_ = true;
+    }
+
+    FilterTracer::record(traceID_, traceEnqueue_, traceDequeue_, end);
+    traceOpen_ = false;
   }
-  bufferMutex_.unlock();
-  return r;
 }
 
 void Filter::sendOutput(std::unique_ptr<Data> output)
@@ -167,6 +332,7 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
   }
 
   connectionMutex_.lock();
+  // The payload is shared between receivers, only the last one gets the original.
   // copy data to callbacks expect the last one is moved
   // in either callbacks or outconnections(default).
   if(outDataCallbacks_.size() != 0)
@@ -174,7 +340,7 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
     // all expect the last
     for(unsigned int i = 0; i < outDataCallbacks_.size() - 1; ++i)
     {
-      Data* copy = deepDataCopy(output.get());
+      Data* copy = sharedDataCopy(output.get());
       std::unique_ptr<Data> u_copy(copy);
       outDataCallbacks_[i](std::move(u_copy));
     }
@@ -182,7 +348,7 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
     // copy last callback and move last connection
     if(outConnections_.size() != 0)
     {
-      Data* copy = deepDataCopy(output.get());
+      Data* copy = sharedDataCopy(output.get());
       std::unique_ptr<Data> u_copy(copy);
       outDataCallbacks_.back()(std::move(u_copy));
     }
@@ -198,7 +364,7 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
     // all expect the last
     for(unsigned int i = 0; i < outConnections_.size() - 1; ++i)
     {
-      Data* copy = deepDataCopy(output.get());
+      Data* copy = sharedDataCopy(output.get());
       std::unique_ptr<Data> u_copy(copy);
       outConnections_[i]->putInput(std::move(u_copy));
     }
@@ -208,10 +374,66 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
   connectionMutex_.unlock();
 }
 
+void Filter::start()
+{
+  running_ = true;
+
+  // the mode can only be changed while the filter is stopped
+  if(!isRunning())
+  {
+    pooled_ = settingEnabled("video/filterPool");
+  }
+
+  if(pooled_)
+  {
+    if(filterID_ == 0)
+    {
+      filterID_ = stats_->addFilter(name_, id_, 0);
+    }
+
+    // process whatever arrived while we were stopped
+    scheduleTask();
+  }
+  else
+  {
+    QThread::start();
+  }
+}
+
 void Filter::stop()
 {
   running_ = false;
-  hasInput_.wakeAll();
+
+  if(pooled_)
+  {
+    // a queued or running task uses the derived filter, so it has to finish
+    // before the filter can be destroyed
+    taskMutex_.lock();
+    while(taskState_ != TASK_IDLE)
+    {
+      taskDone_.wait(&taskMutex_);
+    }
+    taskMutex_.unlock();
+
+    if (filterID_ != 0)
+    {
+      stats_->removeFilter(filterID_);
+      filterID_ = 0;
+    }
+  }
+  else
+  {
+    wakeUp();
+  }
+}
+
+bool Filter::isRunning() const
+{
+  if(pooled_)
+  {
+    return taskState_ != TASK_IDLE;
+  }
+  return QThread::isRunning();
 }
 
 void Filter::run()
@@ -222,7 +444,7 @@ void Filter::run()
     waitForInput();
     if(!running_) break;
 
-    process();
+    measuredProcess();
   }
   if (filterID_ != 0)
   {
@@ -231,6 +453,152 @@ void Filter::run()
   }
 }
 
+void Filter::scheduleTask()
+{
+  // Checked under the task mutex so that no task is queued after stop() has
+  // seen the filter idle. The input waits in the buffer until the filter is
+  // started again.
+  taskMutex_.lock();
+  if(!running_)
+  {
+    taskMutex_.unlock();
+    return;
+  }
+
+  int state = taskState_.load();
+  while(true)
+  {
+    if(state == TASK_IDLE)
+    {
+      if(taskState_.compare_exchange_weak(state, TASK_QUEUED))
+      {
+        taskMutex_.unlock();
+        FilterScheduler::instance().schedule(this);
+        return;
+      }
+    }
+    else if(state == TASK_RUNNING)
+    {
+      // the worker will run us again once it is done
+      if(taskState_.compare_exchange_weak(state, TASK_RERUN))
+      {
+        break;
+      }
+    }
+    else
+    {
+      // already queued
+      break;
+    }
+  }
+  taskMutex_.unlock();
+}
+
+void Filter::executeTask()
+{
+  do
+  {
+    taskState_ = TASK_RUNNING;
+
+    if(running_)
+    {
+      measuredProcess();
+    }
+
+    // The state becomes idle under the mutex so that stop() cannot miss the
+    // wakeup and the filter is not destroyed before we let go of it.
+    taskMutex_.lock();
+    int state = TASK_RUNNING;
+    if(taskState_.compare_exchange_strong(state, TASK_IDLE))
+    {
+      taskDone_.wakeAll();
+      taskMutex_.unlock();
+      return;
+    }
+    taskMutex_.unlock();
+    // more input arrived during processing
+  } while(running_);
+
+  taskMutex_.lock();
+  taskState_ = TASK_IDLE;
+  taskDone_.wakeAll();
+  taskMutex_.unlock();
+}
+
+// CPU time of the current thread in microseconds
+static uint64_t threadCPUTime()
+{
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  if(!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+  {
+    return 0;
+  }
+  uint64_t kernelTime = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+  uint64_t userTime = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+  return (kernelTime + userTime)/10; // 100 ns units
+#else
+  timespec time;
+  if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+  {
+    return 0;
+  }
+  return (uint64_t)time.tv_sec*1000000 + time.tv_nsec/1000;
+#endif
+}
+
+void Filter::measuredProcess()
+{
+  uint64_t start = threadCPUTime();
+  process();
+  cpuTime_ += threadCPUTime() - start;
+
+  if(traceOpen_)
+  {
+    finishTrace(FilterTracer::now());
+  }
+
+  // report the share of one core used about once a second
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+  if(lastCPUReport_ == 0)
+  {
+    lastCPUReport_ = now;
+  }
+  else if(now - lastCPUReport_ >= 1000)
+  {
+    if(filterID_ != 0)
+    {
+      uint16_t usage = (uint16_t)((cpuTime_ - reportedCPUTime_)/(10*(now - lastCPUReport_)));
+      stats_->updateCPUUsage(filterID_, usage);
+    }
+    reportedCPUTime_ = cpuTime_;
+    lastCPUReport_ = now;
+  }
+}
+
+FrameBuffer Filter::allocateBuffer(uint32_t size)
+{
+  outputPoolMutex_.lock();
+  std::shared_ptr<FramePool> outputPool = outputPool_;
+  outputPoolMutex_.unlock();
+
+  if(outputPool)
+  {
+    return outputPool->allocate(size);
+  }
+
+  FrameBuffer buffer = pool_->allocate(size);
+
+  ++allocations_;
+  if(filterID_ != 0 && allocations_%30 == 0)
+  {
+    stats_->updateBufferPool(filterID_, pool_->hits(), pool_->misses());
+  }
+
+  return buffer;
+}
+
+
 Data* Filter::shallowDataCopy(Data* original)
 {
   if(original != nullptr)
@@ -240,8 +608,14 @@ Data* Filter::shallowDataCopy(Data* original)
     copy->width = original->width;
     copy->height = original->height;
     copy->source = original->source;
+    copy->layer = original->layer;
+    copy->stride[0] = original->stride[0];
+    copy->stride[1] = original->stride[1];
+    copy->stride[2] = original->stride[2];
+    copy->sequenceNumber = original->sequenceNumber;
     copy->presentationTime = original->presentationTime;
     copy->framerate = original->framerate;
+    copy->enqueueTime = original->enqueueTime;
     copy->data_size = 0; // no data in shallow copy
 
     return copy;
@@ -256,7 +630,7 @@ Data* Filter::deepDataCopy(Data* original)
   if(original != nullptr)
   {
     Data* copy = shallowDataCopy(original);
-    copy->data = std::unique_ptr<uchar[]>(new uchar[original->data_size]);
+    copy->data = allocateBuffer(original->data_size);
     memcpy(copy->data.get(), original->data.get(), original->data_size);
     copy->data_size = original->data_size;
 
@@ -267,6 +641,34 @@ Data* Filter::deepDataCopy(Data* original)
   return nullptr;
 }
 
+Data* Filter::sharedDataCopy(Data* original)
+{
+  if(original != nullptr)
+  {
+    Data* copy = shallowDataCopy(original);
+    copy->data = original->data.share();
+    copy->data_size = original->data_size;
+
+    return copy;
+  }
+  printDebug(DEBUG_WARNING, this,
+             "Trying to copy nullptr Data pointer.");
+  return nullptr;
+}
+
+
+void Filter::makeWritable(Data* data)
+{
+  Q_ASSERT(data);
+
+  if(data->data.isShared())
+  {
+    FrameBuffer copy = allocateBuffer(data->data_size);
+    memcpy(copy.get(), data->data.get(), data->data_size);
+    data->data = std::move(copy);
+  }
+}
+
 
 QString Filter::printOutputs()
 {
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "framepool.h"
+#include "inputqueue.h"
+
 #include <QWaitCondition>
 #include <QThread>
 #include <QMutex>
@@ -15,6 +18,7 @@
 #include <queue>
 #include <memory>
 #include <functional>
+#include <atomic>
 
 // One of the most fundamental classes of Kvazzup. A filter is an indipendent data processing
 // unit running on its own thread. Filters can be linked together to form a data processing pipeline
@@ -28,7 +32,7 @@ enum DataSource {UNKNOWN, LOCAL, REMOTE};
 struct Data
 {
   uint8_t type;
-  std::unique_ptr<uchar[]> data;
+  FrameBuffer data;
   uint32_t data_size;
   int16_t width;
   int16_t height;
@@ -37,6 +41,19 @@ struct Data
   uint16_t framerate;
 
   DataSource source;
+
+  // simulcast layer of video, 0 is the full resolution
+  uint8_t layer;
+
+  // row pitch of the Y, U and V planes of YUV420VIDEO. 0 means the planes
+  // are packed one after another without padding.
+  uint32_t stride[3];
+
+  // RTP sequence number of received data, 0 for local data
+  uint16_t sequenceNumber;
+
+  // when this was put to the input buffer of a filter, for tracing
+  int64_t enqueueTime;
 };
 
 class StatisticsInterface;
@@ -84,25 +101,64 @@ public:
     return output_;
   }
 
-  virtual void start()
+  // The sample rate of the raw audio this filter takes or gives, zero if the
+  // filter does not care. A resampler is added between differing rates.
+  virtual uint32_t inputSampleRate() const
   {
-    running_ = true;
-    QThread::start();
+    return 0;
   }
+  virtual uint32_t outputSampleRate() const
+  {
+    return 0;
+  }
+
+  // starts the filter on its own thread or in the filter pool
+  virtual void start();
 
+  // A pooled filter returns once its last task has finished.
   virtual void stop();
 
+  // whether the filter is still processing. Hides QThread::isRunning
+  // because pooled filters do not have a thread.
+  bool isRunning() const;
+
   QString printOutputs();
 
   // helper function for copying Data
   Data* shallowDataCopy(Data* original);
   Data* deepDataCopy(Data* original);
 
+  // copies the Data fields, but the payload is shared with the original
+  Data* sharedDataCopy(Data* original);
+
   QString getName()
   {
     return name_;
   }
 
+  // Backpressure. Whether this filter cannot currently take more input
+  // without discarding some.
+  bool isSaturated() const;
+
+  // The filter checks the saturation of bottleneck with skipFrame() and
+  // skips frames according to the backpressure policy in settings.
+  void setBackpressure(std::shared_ptr<Filter> bottleneck);
+
+  // Output frames are allocated from this pool instead of our own. The next
+  // filter can give a pool whose buffers it can use without copying.
+  void setOutputPool(std::shared_ptr<FramePool> pool);
+
+public slots:
+
+  // Asks for a new keyframe of the HEVC stream this filter produces. The
+  // encoder and the RTP receiver implement this, others ignore it.
+  virtual void requestKeyframe() {}
+
+signals:
+
+  // HEVC frames were lost and decoding cannot continue before a keyframe
+  void keyframeNeeded();
+
 protected:
 
   // return: oldest element in buffer, empty if none found
@@ -118,21 +174,56 @@ protected:
 
   bool isHEVCIntra(const unsigned char *buff);
 
+  // The wakeups are counted so none are lost while the filter is processing.
+  // The mutex is only needed when the filter is actually sleeping.
   void wakeUp()
   {
-    waitMutex_->lock();
-    hasInput_.wakeOne();
-    waitMutex_->unlock();
+    if(pooled_)
+    {
+      scheduleTask();
+      return;
+    }
+
+    wakeups_.fetch_add(1);
+    if(sleeping_.load())
+    {
+      waitMutex_->lock();
+      hasInput_.wakeOne();
+      waitMutex_->unlock();
+    }
   }
 
   void waitForInput()
   {
+    if(wakeups_.exchange(0) != 0)
+    {
+      return;
+    }
+
     waitMutex_->lock();
-    // unlocks the mutex
-    hasInput_.wait(waitMutex_);
+    sleeping_.store(true);
+    while(wakeups_.load() == 0)
+    {
+      // unlocks the mutex
+      hasInput_.wait(waitMutex_);
+    }
+    sleeping_.store(false);
+    wakeups_.store(0);
     waitMutex_->unlock();
   }
 
+  // returns a buffer from the pool of this filter. Use this for output data.
+  FrameBuffer allocateBuffer(uint32_t size);
+
+  // true if this frame should not be produced because the backpressure
+  // bottleneck is saturated. With the newest frame policy only the latest
+  // frame is let through once there is room. Call once per frame.
+  bool skipFrame();
+
+  // Copy-on-write. Input payloads may be shared with other filters so call
+  // this before modifying the data in place.
+  void makeWritable(Data* data);
+
   StatisticsInterface* getStats()
   {
     Q_ASSERT(stats_);
@@ -150,23 +241,82 @@ private:
   QString name_;
   QString id_;
 
+  // drops the oldest input to make room for a new one
+  void discardOldest();
+
+  friend class FilterScheduler;
+
+  // filter pool functions. A filter is never in the pool more than once.
+  void scheduleTask();
+  void executeTask();
+
+  // calls process and records the CPU time used
+  void measuredProcess();
+
+  // records the previous frame as done if tracing
+  void finishTrace(int64_t end);
+
   StatisticsInterface* stats_;
   QMutex *waitMutex_;
   QWaitCondition hasInput_;
+  std::atomic<unsigned int> wakeups_;
+  std::atomic<bool> sleeping_;
 
-  bool running_;
+  std::atomic<bool> running_;
 
   std::vector<std::function<void(std::unique_ptr<Data>)> > outDataCallbacks_;
 
   QMutex connectionMutex_;
   std::vector<std::shared_ptr<Filter>> outConnections_;
 
-  QMutex bufferMutex_;
-  //std::queue<std::unique_ptr<Data>> inBuffer_;
-  std::deque<std::unique_ptr<Data>> inBuffer_;
+  InputQueue inBuffer_;
 
-  unsigned int inputTaken_;
-  unsigned int inputDiscarded_;
+  // after dropping an HEVC frame, the inter frames are useless until
+  // the next intra frame
+  std::atomic<bool> discardUntilIntra_;
+
+  std::atomic<unsigned int> inputTaken_;
+  std::atomic<unsigned int> inputDiscarded_;
 
   uint32_t filterID_;
+
+  std::shared_ptr<FramePool> pool_;
+  std::atomic<unsigned int> allocations_;
+
+  // set by the next filter, used instead of pool_ if set
+  QMutex outputPoolMutex_;
+  std::shared_ptr<FramePool> outputPool_;
+
+  // whether this filter runs in the filter pool instead of its own thread
+  bool pooled_;
+
+  enum TaskState {TASK_IDLE = 0, TASK_QUEUED, TASK_RUNNING, TASK_RERUN};
+  std::atomic<int> taskState_;
+
+  // signaled when the task becomes idle, waited by stop()
+  QMutex taskMutex_;
+  QWaitCondition taskDone_;
+
+  // CPU time used by process() in microseconds
+  uint64_t cpuTime_;
+  uint64_t reportedCPUTime_;
+  int64_t lastCPUReport_;
+
+  enum BackpressurePolicy {BACKPRESSURE_NEWEST = 0, BACKPRESSURE_HALVE, BACKPRESSURE_DISABLED};
+  std::atomic<int> backpressurePolicy_;
+
+  QMutex backpressureMutex_;
+  std::weak_ptr<Filter> bottleneck_;
+
+  // frames left at the halved framerate
+  uint32_t halvedFrames_;
+  uint32_t backpressureFrames_;
+  uint32_t framesSkipped_;
+
+  // the frame currently being processed, for tracing
+  bool traceRegistered_;
+  uint32_t traceID_;
+  bool traceOpen_;
+  int64_t traceEnqueue_;
+  int64_t traceDequeue_;
 };
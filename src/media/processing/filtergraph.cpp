@@ -5,6 +5,8 @@
 #include "media/processing/camerafilter.h"
 #include "media/processing/screensharefilter.h"
 #include "media/processing/kvazaarfilter.h"
+#include "media/processing/downscalefilter.h"
+#include "media/processing/layerselectorfilter.h"
 #include "media/processing/rgb32toyuv.h"
 #include "media/processing/openhevcfilter.h"
 #include "media/processing/yuvtorgb32.h"
@@ -13,9 +15,11 @@
 #include "media/processing/audiocapturefilter.h"
 #include "media/processing/audiooutputdevice.h"
 #include "media/processing/opusencoderfilter.h"
-#include "media/processing/opusdecoderfilter.h"
 #include "media/processing/aecinputfilter.h"
+#include "media/processing/aecprocessor.h"
 #include "media/processing/audiomixerfilter.h"
+#include "media/processing/filtertracer.h"
+#include "media/processing/resamplefilter.h"
 
 #include "ui/gui/videointerface.h"
 
@@ -24,29 +28,34 @@
 
 #include <QSettings>
 
+// the full resolution and two halvings
+const int MAX_SIMULCAST_LAYERS = 3;
+
+void changeState(std::shared_ptr<Filter> f, bool state);
+
 FilterGraph::FilterGraph(): QObject(),
   peers_(),
   cameraGraph_(),
   screenShareGraph_(),
   audioProcessing_(),
+  simulcastLayers_(),
+  simulcastInputs_(),
   selfView_(nullptr),
+  videoSource_(nullptr),
   stats_(nullptr),
   format_(),
+  audioFrameDuration_(DEFAULT_AUDIO_FRAME_DURATION),
   videoFormat_(""),
   quitting_(false),
+  videoBitrate_(0),
+  audioBitrate_(0),
+  packetLoss_(0),
   audioOutput_(nullptr)
 {
-  // TODO negotiate these values with all included filters and SDP
   // TODO move these to settings and manage them automatically
 
-#ifndef __linux__
-  // 48000 should be used with opus, since opus is able to downsample when needed
+  // Opus works best with 48000. Devices with other rates are resampled.
   format_.setSampleRate(48000);
-#else
-  // Can be removed once uvgRTP supports pcm sample size 48000 or opus works on
-  // linux
-  format_.setSampleRate(16000);
-#endif
   format_.setChannelCount(1);
   format_.setSampleSize(16);
   format_.setSampleType(QAudioFormat::SignedInt);
@@ -62,13 +71,28 @@ void FilterGraph::init(VideoInterface* selfView, StatisticsInterface* stats)
   stats_ = stats;
   selfView_ = selfView;
 
+  FilterTracer::setEnabled(settingEnabled("video/filterTrace"));
+
   initSelfView(selfView);
 }
 
 
+void FilterGraph::setVideoSource(std::shared_ptr<Filter> source)
+{
+  videoSource_ = source;
+}
+
+
 void FilterGraph::updateSettings()
 {
   QSettings settings("kvazzup.ini", QSettings::IniFormat);
+
+  FilterTracer::setEnabled(settingEnabled("video/filterTrace"));
+
+  // the encoders go back to the bitrates in settings
+  videoBitrate_ = 0;
+  audioBitrate_ = 0;
+
   // if the video format has changed so that we need different conversions
 
   QString wantedVideoFormat = settings.value("video/InputFormat").toString();
@@ -92,9 +116,16 @@ void FilterGraph::updateSettings()
       {
         if(peer.second != nullptr)
         {
+          // the old selectors were connected to the destroyed encoders
+          for (auto& selector : peer.second->videoSelectors)
+          {
+            changeState(selector, false);
+          }
+          peer.second->videoSelectors.clear();
+
           for (auto& senderFilter : peer.second->videoSenders)
           {
-            cameraGraph_.back()->addOutConnection(senderFilter);
+            connectVideoSender(peer.first, senderFilter);
           }
         }
       }
@@ -106,6 +137,14 @@ void FilterGraph::updateSettings()
     {
       filter->updateSettings();
     }
+
+    for(auto& segment : simulcastLayers_)
+    {
+      for (auto& filter : *segment)
+      {
+        filter->updateSettings();
+      }
+    }
   }
 
   for(auto& filter : audioProcessing_)
@@ -159,12 +198,19 @@ void FilterGraph::initSelfView(VideoInterface *selfView)
 
   if(cameraGraph_.size() > 0)
   {
+    destroySimulcast();
     destroyFilters(cameraGraph_);
   }
 
   // Sending video graph
 
-  if (!addToGraph(std::shared_ptr<Filter>(new CameraFilter("", stats_)), cameraGraph_))
+  std::shared_ptr<Filter> source = videoSource_;
+  if (source == nullptr)
+  {
+    source = std::shared_ptr<Filter>(new CameraFilter("", stats_));
+  }
+
+  if (!addToGraph(source, cameraGraph_))
   {
     // camera failed
     printError(this, "Failed to add camera. Does it have supported formats.");
@@ -215,34 +261,318 @@ void FilterGraph::initVideoSend()
   else if(cameraGraph_.size() > 3)
   {
     printProgramError(this, "Too many filters in videosend");
+    destroySimulcast();
     destroyFilters(cameraGraph_);
   }
 
-  std::shared_ptr<Filter> kvazaar = std::shared_ptr<Filter>(new KvazaarFilter("", stats_));
+  // a conversion is added before the encoder if the source is not YUV
+  unsigned int cameraFilters = cameraGraph_.size();
+  unsigned int screenFilters = screenShareGraph_.size();
+
+  std::shared_ptr<KvazaarFilter> kvazaar = std::shared_ptr<KvazaarFilter>(new KvazaarFilter("", stats_));
   addToGraph(kvazaar, cameraGraph_, 0);
   addToGraph(cameraGraph_.back(), screenShareGraph_, 0);
+
+  // the simulcast layers are downscaled from the pictures the encoder gets
+  std::vector<std::shared_ptr<Filter>> yuvSources;
+  yuvSources.push_back(cameraGraph_.at(cameraGraph_.size() > cameraFilters + 1 ? cameraFilters : 0));
+  if (screenShareGraph_.size() > screenFilters + 1)
+  {
+    yuvSources.push_back(screenShareGraph_.at(screenFilters));
+  }
+
+  // don't capture and convert frames the encoder has no room for
+  addBackpressure(cameraGraph_, kvazaar);
+  addBackpressure(screenShareGraph_, kvazaar);
+
+  // the frames are written directly to encoder pictures
+  addPicturePool(cameraGraph_, kvazaar);
+  addPicturePool(screenShareGraph_, kvazaar);
+
+  initSimulcast(yuvSources);
+
+  applySendBitrate();
+}
+
+
+void FilterGraph::initSimulcast(std::vector<std::shared_ptr<Filter>> inputs)
+{
+  destroySimulcast();
+
+  QSettings settings("kvazzup.ini", QSettings::IniFormat);
+  int layers = std::min(settings.value("video/simulcastLayers").toInt(), MAX_SIMULCAST_LAYERS);
+
+  for (int layer = 1; layer < layers; ++layer)
+  {
+    printNormal(this, "Adding simulcast layer", {"Layer"}, {QString::number(layer)});
+
+    std::shared_ptr<GraphSegment> segment = std::shared_ptr<GraphSegment>(new GraphSegment);
+
+    std::shared_ptr<KvazaarFilter> encoder =
+        std::shared_ptr<KvazaarFilter>(new KvazaarFilter("L" + QString::number(layer), stats_));
+    encoder->setLayer(layer);
+
+    addToGraph(std::make_shared<DownscaleFilter>("L" + QString::number(layer), stats_, layer),
+               *segment);
+    addToGraph(encoder, *segment, 0);
+
+    addBackpressure(*segment, encoder);
+    addPicturePool(*segment, encoder);
+
+    for (auto& input : inputs)
+    {
+      connectFilters(segment->front(), input);
+    }
+
+    simulcastLayers_.push_back(segment);
+  }
+
+  simulcastInputs_ = inputs;
+}
+
+
+void FilterGraph::destroySimulcast()
+{
+  for (auto& segment : simulcastLayers_)
+  {
+    for (auto& input : simulcastInputs_)
+    {
+      input->removeOutConnection(segment->front());
+    }
+
+    destroyFilters(*segment);
+  }
+
+  simulcastLayers_.clear();
+  simulcastInputs_.clear();
+}
+
+
+std::vector<std::shared_ptr<Filter>> FilterGraph::videoEncoders()
+{
+  std::vector<std::shared_ptr<Filter>> encoders;
+  if (!cameraGraph_.empty())
+  {
+    encoders.push_back(cameraGraph_.back());
+  }
+
+  for (auto& segment : simulcastLayers_)
+  {
+    encoders.push_back(segment->back());
+  }
+
+  return encoders;
+}
+
+
+void FilterGraph::addBackpressure(GraphSegment& graph, std::shared_ptr<Filter> bottleneck)
+{
+  for (auto& filter : graph)
+  {
+    // displays do not produce anything for the bottleneck
+    if (filter != bottleneck && filter->outputType() != NONE)
+    {
+      filter->setBackpressure(bottleneck);
+    }
+  }
+}
+
+
+void FilterGraph::addPicturePool(GraphSegment& graph, std::shared_ptr<KvazaarFilter> encoder)
+{
+  for (auto& filter : graph)
+  {
+    if (filter != encoder && filter->outputType() == YUV420VIDEO)
+    {
+      filter->setOutputPool(encoder->getPicturePool());
+    }
+  }
 }
 
 
 void FilterGraph::initializeAudio(bool opus)
 {
   // Do this before adding participants, otherwise AEC filter wont get attached
-  addToGraph(std::shared_ptr<Filter>(new AudioCaptureFilter("", format_, stats_)), audioProcessing_);
+  addToGraph(std::shared_ptr<Filter>(new AudioCaptureFilter("", format_, audioFrameDuration_,
+                                                             stats_)), audioProcessing_);
 
   std::shared_ptr<AECInputFilter> aec = std::shared_ptr<AECInputFilter>(new AECInputFilter("", stats_));
-  aec->initInput(format_);
+  aec->initInput(format_, audioFrameDuration_);
   addToGraph(aec, audioProcessing_, audioProcessing_.size() - 1);
 
   if (audioOutput_ == nullptr)
   {
     audioOutput_ = std::make_shared<AudioOutputDevice>(stats_);
-    audioOutput_->init(format_, aec->getAEC());
+    audioOutput_->init(format_, audioFrameDuration_, aec->getAEC());
   }
 
   if (opus)
   {
-    addToGraph(std::shared_ptr<Filter>(new OpusEncoderFilter("", format_, stats_)), audioProcessing_,
-               audioProcessing_.size() - 1);
+    std::shared_ptr<OpusEncoderFilter> encoder =
+        std::make_shared<OpusEncoderFilter>("", format_, audioFrameDuration_, stats_);
+    addToGraph(encoder, audioProcessing_, audioProcessing_.size() - 1);
+
+    encoder->setPacketLoss(packetLoss_);
+    applySendBitrate();
+  }
+}
+
+
+void FilterGraph::setSendBitrate(uint32_t videoBitrate, uint32_t audioBitrate)
+{
+  if (videoBitrate != 0)
+  {
+    videoBitrate_ = videoBitrate;
+  }
+  if (audioBitrate != 0)
+  {
+    audioBitrate_ = audioBitrate;
+  }
+
+  applySendBitrate();
+}
+
+
+void FilterGraph::setPeerBitrate(uint32_t sessionID, uint32_t bitrate)
+{
+  if (simulcastLayers_.empty() || peers_.find(sessionID) == peers_.end() ||
+      peers_[sessionID] == nullptr)
+  {
+    return;
+  }
+
+  QSettings settings("kvazzup.ini", QSettings::IniFormat);
+  uint32_t videoBitrate = videoBitrate_ != 0 ? videoBitrate_ : settings.value("video/bitrate").toUInt();
+  uint32_t audioBitrate = audioBitrate_ != 0 ? audioBitrate_ : settings.value("audio/bitrate").toUInt();
+
+  if (videoBitrate == 0)
+  {
+    // without rate control the layer bitrates are not known
+    return;
+  }
+
+  // each layer has a quarter of the bitrate of the previous one
+  uint8_t layer = 0;
+  while (layer < simulcastLayers_.size() &&
+         (videoBitrate >> 2*layer) + audioBitrate > bitrate)
+  {
+    ++layer;
+  }
+
+  Peer* peer = peers_[sessionID];
+  if (peer->videoLayer == layer)
+  {
+    return;
+  }
+
+  peer->videoLayer = layer;
+  for (auto& selector : peer->videoSelectors)
+  {
+    selector->setLayer(layer);
+  }
+
+  // the selector switches at the next keyframe of the layer
+  requestKeyframe(sessionID);
+}
+
+
+void FilterGraph::requestKeyframe(uint32_t sessionID)
+{
+  if (peers_.find(sessionID) == peers_.end() || peers_[sessionID] == nullptr)
+  {
+    return;
+  }
+
+  std::vector<std::shared_ptr<Filter>> encoders = videoEncoders();
+  uint8_t layer = simulcastLayers_.empty() ? 0 : peers_[sessionID]->videoLayer;
+
+  if (layer < encoders.size())
+  {
+    encoders.at(layer)->requestKeyframe();
+  }
+}
+
+
+void FilterGraph::setPacketLoss(uint8_t percent)
+{
+  packetLoss_ = percent;
+
+  for (auto& filter : audioProcessing_)
+  {
+    std::shared_ptr<OpusEncoderFilter> opus = std::dynamic_pointer_cast<OpusEncoderFilter>(filter);
+    if (opus)
+    {
+      opus->setPacketLoss(percent);
+    }
+  }
+}
+
+
+void FilterGraph::setAudioFrameDuration(uint16_t frameDuration)
+{
+  if (frameDuration == audioFrameDuration_)
+  {
+    return;
+  }
+
+  printNormal(this, "Changing audio frame duration", {"Duration (ms)"},
+              {QString::number(audioFrameDuration_) + " -> " + QString::number(frameDuration)});
+
+  audioFrameDuration_ = frameDuration;
+
+  for (auto& filter : audioProcessing_)
+  {
+    std::shared_ptr<AudioCaptureFilter> capture =
+        std::dynamic_pointer_cast<AudioCaptureFilter>(filter);
+    std::shared_ptr<AECInputFilter> aec = std::dynamic_pointer_cast<AECInputFilter>(filter);
+    std::shared_ptr<OpusEncoderFilter> opus = std::dynamic_pointer_cast<OpusEncoderFilter>(filter);
+
+    if (capture)
+    {
+      capture->setFrameDuration(frameDuration);
+    }
+    else if (aec)
+    {
+      aec->getAEC()->setFrameDuration(frameDuration);
+    }
+    else if (opus)
+    {
+      opus->setFrameDuration(frameDuration);
+    }
+  }
+
+  if (audioOutput_ != nullptr)
+  {
+    audioOutput_->setFrameDuration(frameDuration);
+  }
+}
+
+
+void FilterGraph::applySendBitrate()
+{
+  if (videoBitrate_ != 0)
+  {
+    // the simulcast layers scale the bitrate to their resolution
+    for (auto& filter : videoEncoders())
+    {
+      std::shared_ptr<KvazaarFilter> kvazaar = std::dynamic_pointer_cast<KvazaarFilter>(filter);
+      if (kvazaar)
+      {
+        kvazaar->setTargetBitrate(videoBitrate_);
+      }
+    }
+  }
+
+  if (audioBitrate_ != 0)
+  {
+    for (auto& filter : audioProcessing_)
+    {
+      std::shared_ptr<OpusEncoderFilter> opus = std::dynamic_pointer_cast<OpusEncoderFilter>(filter);
+      if (opus)
+      {
+        opus->setTargetBitrate(audioBitrate_);
+      }
+    }
   }
 }
 
@@ -285,6 +615,24 @@ bool FilterGraph::addToGraph(std::shared_ptr<Filter> filter,
       // the conversion filter has been added to the end
       connectIndex = graph.size() - 1;
     }
+
+    uint32_t outputRate = graph.at(connectIndex)->outputSampleRate();
+    uint32_t inputRate = filter->inputSampleRate();
+
+    if (outputRate != 0 && inputRate != 0 && outputRate != inputRate)
+    {
+      printDebug(DEBUG_NORMAL, this, "Sample rates do not match. Adding resampler",
+                 {"Connection", "Rates"},
+                 {graph.at(connectIndex)->getName() + "->" + filter->getName(),
+                  QString::number(outputRate) + " -> " + QString::number(inputRate)});
+
+      if (!addToGraph(std::make_shared<ResampleFilter>("", stats_, outputRate, inputRate),
+                      graph, connectIndex))
+      {
+        return false;
+      }
+      connectIndex = graph.size() - 1;
+    }
     connectFilters(filter, graph.at(connectIndex));
   }
 
@@ -363,11 +711,70 @@ void FilterGraph::sendVideoto(uint32_t sessionID, std::shared_ptr<Filter> videoF
 
   peers_[sessionID]->videoSenders.push_back(videoFramedSource);
 
-  cameraGraph_.back()->addOutConnection(videoFramedSource);
+  connectVideoSender(sessionID, videoFramedSource);
+
+  // the sender discards frames until the next keyframe if it falls behind
+  connect(videoFramedSource.get(), &Filter::keyframeNeeded,
+          this, [this, sessionID]()
+  {
+    requestKeyframe(sessionID);
+  });
+
   videoFramedSource->start();
 }
 
 
+void FilterGraph::connectVideoSender(uint32_t sessionID, std::shared_ptr<Filter> sender)
+{
+  if (simulcastLayers_.empty())
+  {
+    cameraGraph_.back()->addOutConnection(sender);
+    return;
+  }
+
+  // all layers go to the selector which passes one of them to the sender
+  std::shared_ptr<LayerSelectorFilter> selector =
+      std::make_shared<LayerSelectorFilter>(QString::number(sessionID), stats_);
+  selector->setLayer(peers_[sessionID]->videoLayer);
+  selector->addOutConnection(sender);
+
+  for (auto& encoder : videoEncoders())
+  {
+    connectFilters(selector, encoder);
+  }
+
+  if (selector->init())
+  {
+    selector->start();
+  }
+
+  peers_[sessionID]->videoSelectors.push_back(selector);
+}
+
+
+void FilterGraph::disconnectVideoSenders(Peer* peer)
+{
+  if (peer->videoSelectors.empty())
+  {
+    for (auto& videoSender : peer->videoSenders)
+    {
+      cameraGraph_.back()->removeOutConnection(videoSender);
+    }
+    return;
+  }
+
+  for (auto& selector : peer->videoSelectors)
+  {
+    for (auto& encoder : videoEncoders())
+    {
+      encoder->removeOutConnection(selector);
+    }
+    changeState(selector, false);
+  }
+  peer->videoSelectors.clear();
+}
+
+
 void FilterGraph::receiveVideoFrom(uint32_t sessionID, std::shared_ptr<Filter> videoSink,
                                    VideoInterface *view)
 {
@@ -379,8 +786,13 @@ void FilterGraph::receiveVideoFrom(uint32_t sessionID, std::shared_ptr<Filter> v
   std::shared_ptr<GraphSegment> graph = std::shared_ptr<GraphSegment> (new GraphSegment);
   peers_[sessionID]->videoReceivers.push_back(graph);
 
+  std::shared_ptr<Filter> decoder = std::shared_ptr<Filter>(new OpenHEVCFilter(sessionID, stats_));
+
   addToGraph(videoSink, *graph);
-  addToGraph(std::shared_ptr<Filter>(new OpenHEVCFilter(sessionID, stats_)), *graph, 0);
+  addToGraph(decoder, *graph, 0);
+
+  // the peer is asked for a keyframe when decoding cannot continue
+  connect(decoder.get(), &Filter::keyframeNeeded, videoSink.get(), &Filter::requestKeyframe);
 
   addToGraph(std::shared_ptr<Filter>(new DisplayFilter(QString::number(sessionID), stats_,
                                                        view, sessionID)), *graph, 1);
@@ -421,16 +833,14 @@ void FilterGraph::receiveAudioFrom(uint32_t sessionID, std::shared_ptr<Filter> a
   peers_[sessionID]->audioReceivers.push_back(graph);
 
   addToGraph(audioSink, *graph);
-  if (audioSink->outputType() == OPUSAUDIO)
-  {
-    addToGraph(std::shared_ptr<Filter>(new OpusDecoderFilter(sessionID, format_, stats_)),
-               *graph, graph->size() - 1);
-  }
 
-  audioOutput_->addInput();
+  audioOutput_->addInput(sessionID);
 
+  // Opus is decoded by the jitter buffer of the output as it is played, so
+  // that lost packets can be recovered and concealed by the decoder
   addToGraph(std::make_shared<AudioMixerFilter>(QString::number(sessionID),
-                                                stats_, sessionID, audioOutput_),
+                                                stats_, sessionID, audioOutput_,
+                                                audioSink->outputType()),
              *graph, graph->size() - 1);
 
 }
@@ -441,6 +851,7 @@ void FilterGraph::uninit()
   quitting_ = true;
   removeAllParticipants();
 
+  destroySimulcast();
   destroyFilters(cameraGraph_);
   destroyFilters(screenShareGraph_);
   destroyFilters(audioProcessing_);
@@ -546,6 +957,13 @@ void FilterGraph::running(bool state)
   {
     changeState(f, state);
   }
+  for(auto& segment : simulcastLayers_)
+  {
+    for(std::shared_ptr<Filter> f : *segment)
+    {
+      changeState(f, state);
+    }
+  }
 
   if (screenShareGraph_.size() > 0)
   {
@@ -572,6 +990,11 @@ void FilterGraph::running(bool state)
         }
       }
 
+      for (auto& selector : peer.second->videoSelectors)
+      {
+        changeState(selector, state);
+      }
+
       for (auto& graph : peer.second->audioReceivers)
       {
         for(std::shared_ptr<Filter> f : *graph)
@@ -619,9 +1042,9 @@ void FilterGraph::destroyPeer(Peer* peer)
     changeState(audioSender, false);
     audioSender = nullptr;
   }
+  disconnectVideoSenders(peer);
   for (auto& videoSender : peer->videoSenders)
   {
-    cameraGraph_.back()->removeOutConnection(videoSender);
     changeState(videoSender, false);
     //peer->videoFramedSource is destroyed by RTPStreamer
     videoSender = nullptr;
@@ -629,7 +1052,6 @@ void FilterGraph::destroyPeer(Peer* peer)
   for (auto& graph : peer->audioReceivers)
   {
     destroyFilters(*graph);
-    audioOutput_->removeInput();
   }
 
   for (auto& graph : peer->videoReceivers)
@@ -653,6 +1075,11 @@ void FilterGraph::removeParticipant(uint32_t sessionID)
     destroyPeer(peers_[sessionID]);
     peers_[sessionID] = nullptr;
 
+    if (audioOutput_ != nullptr)
+    {
+      audioOutput_->removeInput(sessionID);
+    }
+
     // destroy send graphs if this was the last peer
     bool peerPresent = false;
     for(auto& peer : peers_)
@@ -665,6 +1092,7 @@ void FilterGraph::removeParticipant(uint32_t sessionID)
 
     if(!peerPresent)
     {
+      destroySimulcast();
       destroyFilters(cameraGraph_);
       if (!quitting_)
       {
@@ -672,6 +1100,11 @@ void FilterGraph::removeParticipant(uint32_t sessionID)
       }
 
       destroyFilters(audioProcessing_);
+
+      if (FilterTracer::enabled())
+      {
+        FilterTracer::exportChromeTrace("filtertrace.json");
+      }
     }
   }
 }
@@ -713,6 +1146,14 @@ void FilterGraph::print()
     videoDotFile += f->printOutputs();
   }
 
+  for(auto& segment : simulcastLayers_)
+  {
+    for (auto& f : *segment)
+    {
+      videoDotFile += f->printOutputs();
+    }
+  }
+
   for(auto& peer : peers_)
   {
     if(peer.second != nullptr)
@@ -12,6 +12,8 @@ class StatisticsInterface;
 class AudioOutputDevice;
 class Filter;
 class ScreenShareFilter;
+class KvazaarFilter;
+class LayerSelectorFilter;
 class AECInputFilter;
 
 typedef std::vector<std::shared_ptr<Filter>> GraphSegment;
@@ -23,6 +25,10 @@ public:
   FilterGraph();
 
   void init(VideoInterface* selfView, StatisticsInterface *stats);
+
+  // Use this filter instead of the camera. Call before init. Used by the
+  // benchmarks to run without a camera.
+  void setVideoSource(std::shared_ptr<Filter> source);
   void uninit();
 
   // These functions are used to manipulate filter graphs regarding a peer
@@ -45,6 +51,25 @@ public:
   // Refresh settings of all filters from QSettings.
   void updateSettings();
 
+  // The bitrates the encoders should use instead of settings. Zero means no
+  // change. Reset by updateSettings.
+  void setSendBitrate(uint32_t videoBitrate, uint32_t audioBitrate);
+
+  // The bitrate the peer can receive. With simulcast the peer is sent the
+  // largest layer that fits.
+  void setPeerBitrate(uint32_t sessionID, uint32_t bitrate);
+
+  // Makes the encoder sending video to this peer produce a keyframe.
+  void requestKeyframe(uint32_t sessionID);
+
+  // The worst packet loss reported by our peers in percent. Tunes the
+  // forward error correction of the audio encoder.
+  void setPacketLoss(uint8_t percent);
+
+  // The audio frame duration negotiated with SDP in milliseconds. The same
+  // duration is used for all peers, so the latest negotiation decides it.
+  void setAudioFrameDuration(uint16_t frameDuration);
+
 private:
 
   // adds fitler to graph and connects it to connectIndex unless this is the first filter in graph.
@@ -56,6 +81,22 @@ private:
   // connects the two filters and checks for any problems
   bool connectFilters(std::shared_ptr<Filter> filter, std::shared_ptr<Filter> previous);
 
+  // the filters in graph producing input for bottleneck skip frames when it is saturated
+  void addBackpressure(GraphSegment& graph, std::shared_ptr<Filter> bottleneck);
+
+  // the filters in graph producing YUV frames write them to the pictures of encoder
+  void addPicturePool(GraphSegment& graph, std::shared_ptr<KvazaarFilter> encoder);
+
+  // gives the bitrates from congestion control to the encoders
+  void applySendBitrate();
+
+  // creates the encoders of the lower resolution layers, fed from inputs
+  void initSimulcast(std::vector<std::shared_ptr<Filter>> inputs);
+  void destroySimulcast();
+
+  // the encoders of all layers, full resolution first
+  std::vector<std::shared_ptr<Filter>> videoEncoders();
+
   // makes sure the participant exists and adds if necessary
   void checkParticipant(uint32_t sessionID);
 
@@ -76,12 +117,20 @@ private:
     std::vector<std::shared_ptr<Filter>> audioSenders; // sends audio
     std::vector<std::shared_ptr<Filter>> videoSenders; // sends video
 
+    // with simulcast the video senders get their layer through these
+    std::vector<std::shared_ptr<LayerSelectorFilter>> videoSelectors;
+    uint8_t videoLayer;
+
     // Arrays of filters which receive media.
     // Each graphsegment receives one mediastream.
     std::vector<std::shared_ptr<GraphSegment>> videoReceivers;
     std::vector<std::shared_ptr<GraphSegment>> audioReceivers;
   };
 
+  // connects the video sender to the encoder or to a layer selector
+  void connectVideoSender(uint32_t sessionID, std::shared_ptr<Filter> sender);
+  void disconnectVideoSenders(Peer* peer);
+
   // destroy all filters associated with this peer.
   void destroyPeer(Peer* peer);
 
@@ -96,16 +145,30 @@ private:
   GraphSegment screenShareGraph_;
   GraphSegment audioProcessing_;
 
+  // downscaler and encoder of each lower simulcast layer
+  std::vector<std::shared_ptr<GraphSegment>> simulcastLayers_;
+  // the filters producing YUV pictures for the layers
+  std::vector<std::shared_ptr<Filter>> simulcastInputs_;
+
   VideoInterface *selfView_;
 
+  // replaces the camera if set
+  std::shared_ptr<Filter> videoSource_;
+
   StatisticsInterface* stats_;
 
   // audio configs
   QAudioFormat format_;
+  uint16_t audioFrameDuration_;
 
   QString videoFormat_;
 
   bool quitting_;
 
+  // from congestion control, 0 if settings are used
+  uint32_t videoBitrate_;
+  uint32_t audioBitrate_;
+  uint8_t packetLoss_;
+
   std::shared_ptr<AudioOutputDevice> audioOutput_;
 };
@@ -0,0 +1,161 @@
+#include "filterscheduler.h"
+
+#include "filter.h"
+
+#include "common.h"
+
+// the worker which the current thread is, -1 if not a worker
+static thread_local int currentWorker = -1;
+
+
+FilterWorker::FilterWorker(FilterScheduler* scheduler, unsigned int index):
+  scheduler_(scheduler),
+  index_(index)
+{}
+
+
+void FilterWorker::run()
+{
+  currentWorker = index_;
+  scheduler_->workerLoop(index_);
+  currentWorker = -1;
+}
+
+
+FilterScheduler& FilterScheduler::instance()
+{
+  static FilterScheduler scheduler(QThread::idealThreadCount());
+  return scheduler;
+}
+
+
+FilterScheduler::FilterScheduler(unsigned int workers):
+  queues_(),
+  workers_(),
+  nextQueue_(0),
+  pending_(0),
+  sleeping_(0),
+  sleepMutex_(),
+  hasTasks_(),
+  stopping_(false)
+{
+  if (workers == 0)
+  {
+    workers = 1;
+  }
+
+  printDebug(DEBUG_NORMAL, "FilterScheduler", "Starting filter worker threads",
+             {"Workers"}, {QString::number(workers)});
+
+  for (unsigned int i = 0; i < workers; ++i)
+  {
+    queues_.push_back(std::unique_ptr<TaskQueue>(new TaskQueue));
+  }
+
+  for (unsigned int i = 0; i < workers; ++i)
+  {
+    workers_.push_back(std::unique_ptr<FilterWorker>(new FilterWorker(this, i)));
+    workers_.back()->start(QThread::HighPriority);
+  }
+}
+
+
+FilterScheduler::~FilterScheduler()
+{
+  stopping_ = true;
+
+  sleepMutex_.lock();
+  hasTasks_.wakeAll();
+  sleepMutex_.unlock();
+
+  for (auto& worker : workers_)
+  {
+    worker->wait();
+  }
+}
+
+
+void FilterScheduler::schedule(Filter* filter)
+{
+  // Workers put the follow-up tasks to their own queue so the data
+  // is still in cache when the next filter processes it.
+  unsigned int index = 0;
+  if (currentWorker != -1)
+  {
+    index = (unsigned int)currentWorker;
+  }
+  else
+  {
+    index = nextQueue_.fetch_add(1)%queues_.size();
+  }
+
+  queues_[index]->mutex.lock();
+  queues_[index]->tasks.push_back(filter);
+  queues_[index]->mutex.unlock();
+
+  pending_.fetch_add(1);
+
+  if (sleeping_.load() > 0)
+  {
+    sleepMutex_.lock();
+    hasTasks_.wakeOne();
+    sleepMutex_.unlock();
+  }
+}
+
+
+void FilterScheduler::workerLoop(unsigned int index)
+{
+  while (!stopping_)
+  {
+    Filter* task = takeTask(index);
+
+    if (task != nullptr)
+    {
+      pending_.fetch_sub(1);
+      task->executeTask();
+    }
+    else
+    {
+      sleepMutex_.lock();
+      sleeping_.fetch_add(1);
+      while (pending_.load() == 0 && !stopping_)
+      {
+        hasTasks_.wait(&sleepMutex_);
+      }
+      sleeping_.fetch_sub(1);
+      sleepMutex_.unlock();
+    }
+  }
+}
+
+
+Filter* FilterScheduler::takeTask(unsigned int index)
+{
+  Filter* task = nullptr;
+
+  // own queue first, newest task
+  queues_[index]->mutex.lock();
+  if (!queues_[index]->tasks.empty())
+  {
+    task = queues_[index]->tasks.back();
+    queues_[index]->tasks.pop_back();
+  }
+  queues_[index]->mutex.unlock();
+
+  // steal the oldest task from someone else
+  for (unsigned int i = 1; task == nullptr && i < queues_.size(); ++i)
+  {
+    TaskQueue* victim = queues_[(index + i)%queues_.size()].get();
+
+    victim->mutex.lock();
+    if (!victim->tasks.empty())
+    {
+      task = victim->tasks.front();
+      victim->tasks.pop_front();
+    }
+    victim->mutex.unlock();
+  }
+
+  return task;
+}
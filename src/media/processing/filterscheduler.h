@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Runs the filters on a fixed number of worker threads instead of every
+// filter having its own thread. A filter is scheduled as a task when it
+// receives input and the task calls process() once. Each worker has its own
+// task queue and idle workers steal tasks from the others. This is only
+// used if the filter pool has been enabled in settings.
+
+class Filter;
+class FilterScheduler;
+
+class FilterWorker : public QThread
+{
+  Q_OBJECT
+public:
+  FilterWorker(FilterScheduler* scheduler, unsigned int index);
+
+protected:
+  void run();
+
+private:
+  FilterScheduler* scheduler_;
+  unsigned int index_;
+};
+
+class FilterScheduler
+{
+public:
+  // the scheduler is shared by all filters and started on first use
+  static FilterScheduler& instance();
+
+  ~FilterScheduler();
+
+  // queue process() call for this filter
+  void schedule(Filter* filter);
+
+  unsigned int workerCount() const
+  {
+    return (unsigned int)queues_.size();
+  }
+
+private:
+
+  friend class FilterWorker;
+
+  FilterScheduler(unsigned int workers);
+
+  void workerLoop(unsigned int index);
+
+  // own tasks are taken from the back and stolen tasks from the front
+  Filter* takeTask(unsigned int index);
+
+  struct TaskQueue
+  {
+    QMutex mutex;
+    std::deque<Filter*> tasks;
+  };
+
+  std::vector<std::unique_ptr<TaskQueue>> queues_;
+  std::vector<std::unique_ptr<FilterWorker>> workers_;
+
+  // used for distributing tasks from outside the pool
+  std::atomic<unsigned int> nextQueue_;
+
+  // number of queued tasks. Workers sleep only when this is zero.
+  std::atomic<int> pending_;
+  std::atomic<int> sleeping_;
+
+  QMutex sleepMutex_;
+  QWaitCondition hasTasks_;
+
+  std::atomic<bool> stopping_;
+};
@@ -0,0 +1,199 @@
+#include "filtertracer.h"
+
+#include "common.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QTextStream>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// how many frames are remembered per thread
+const uint64_t TRACE_RING_SIZE = 8192;
+
+struct TraceEvent
+{
+  uint32_t filter;
+  int64_t enqueue;
+  int64_t dequeue;
+  int64_t end;
+};
+
+// Written only by its own thread. The exporter checks afterwards that the
+// writer did not overwrite the events while they were being copied.
+struct TraceRing
+{
+  uint32_t thread;
+  std::unique_ptr<TraceEvent[]> events;
+  std::atomic<uint64_t> written;
+
+  // only used by the exporter
+  uint64_t exported;
+};
+
+std::atomic<bool> FilterTracer::enabled_(false);
+
+static QMutex traceMutex;
+static std::vector<std::shared_ptr<TraceRing>> rings;
+static std::vector<QString> filterNames;
+
+static thread_local TraceRing* threadRing = nullptr;
+
+
+// filter names may contain characters that end a JSON string
+static QString escapeJSON(QString text)
+{
+  QString escaped;
+  for (QChar character : text)
+  {
+    if (character == '"' || character == '\\')
+    {
+      escaped += '\\';
+      escaped += character;
+    }
+    else if (character.unicode() < 0x20)
+    {
+      escaped += QString("\\u%1").arg(character.unicode(), 4, 16, QChar('0'));
+    }
+    else
+    {
+      escaped += character;
+    }
+  }
+  return escaped;
+}
+
+
+void FilterTracer::setEnabled(bool enabled)
+{
+  if (enabled != enabled_.load())
+  {
+    printDebug(DEBUG_NORMAL, "FilterTracer", "Changing filter tracing",
+               {"Enabled"}, {enabled ? "yes" : "no"});
+  }
+  enabled_.store(enabled);
+}
+
+
+int64_t FilterTracer::now()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+uint32_t FilterTracer::registerFilter(QString name)
+{
+  traceMutex.lock();
+  uint32_t id = (uint32_t)filterNames.size();
+  filterNames.push_back(name);
+  traceMutex.unlock();
+  return id;
+}
+
+
+void FilterTracer::record(uint32_t filter, int64_t enqueue, int64_t dequeue, int64_t end)
+{
+  if (threadRing == nullptr)
+  {
+    std::shared_ptr<TraceRing> ring = std::make_shared<TraceRing>();
+    ring->events = std::unique_ptr<TraceEvent[]>(new TraceEvent[TRACE_RING_SIZE]);
+    ring->written = 0;
+    ring->exported = 0;
+
+    traceMutex.lock();
+    ring->thread = (uint32_t)rings.size() + 1;
+    rings.push_back(ring);
+    traceMutex.unlock();
+
+    threadRing = ring.get();
+  }
+
+  uint64_t position = threadRing->written.load(std::memory_order_relaxed);
+  threadRing->events[position%TRACE_RING_SIZE] = {filter, enqueue, dequeue, end};
+  threadRing->written.store(position + 1, std::memory_order_release);
+}
+
+
+bool FilterTracer::exportChromeTrace(QString filename)
+{
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly))
+  {
+    printDebug(DEBUG_WARNING, "FilterTracer", "Could not open trace file",
+               {"Filename"}, {filename});
+    return false;
+  }
+
+  QTextStream stream(&file);
+  stream << "{\"traceEvents\":[\r\n";
+
+  // processing is shown per thread and queueing per filter
+  stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Threads\"}},\r\n";
+  stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"Filter queues\"}}";
+
+  traceMutex.lock();
+
+  for (uint32_t i = 0; i < filterNames.size(); ++i)
+  {
+    stream << ",\r\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":"
+           << QString::number(i) << ",\"args\":{\"name\":\"" << escapeJSON(filterNames.at(i)) << "\"}}";
+  }
+
+  uint64_t eventCount = 0;
+
+  for (auto& ring : rings)
+  {
+    uint64_t written = ring->written.load(std::memory_order_acquire);
+    uint64_t first = ring->exported;
+    if (written - first > TRACE_RING_SIZE)
+    {
+      first = written - TRACE_RING_SIZE;
+    }
+
+    std::vector<TraceEvent> events;
+    for (uint64_t j = first; j < written; ++j)
+    {
+      events.push_back(ring->events[j%TRACE_RING_SIZE]);
+    }
+
+    // Drop the events the thread may have overwritten during copying. This
+    // includes the slot it may be writing right now, which is not yet counted
+    // in written.
+    uint64_t writtenAfter = ring->written.load(std::memory_order_acquire);
+    uint64_t overwritten = 0;
+    if (writtenAfter + 1 - first > TRACE_RING_SIZE)
+    {
+      overwritten = writtenAfter + 1 - first - TRACE_RING_SIZE;
+    }
+
+    for (uint64_t j = overwritten; j < events.size(); ++j)
+    {
+      const TraceEvent& event = events.at(j);
+      QString name = event.filter < filterNames.size() ? escapeJSON(filterNames.at(event.filter))
+                                                       : "Unknown";
+
+      stream << ",\r\n{\"name\":\"" << name << "\",\"cat\":\"process\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+             << QString::number(ring->thread) << ",\"ts\":" << QString::number(event.dequeue)
+             << ",\"dur\":" << QString::number(event.end - event.dequeue)
+             << ",\"args\":{\"queued\":" << QString::number(event.dequeue - event.enqueue) << "}}";
+
+      stream << ",\r\n{\"name\":\"queued\",\"cat\":\"queue\",\"ph\":\"X\",\"pid\":2,\"tid\":"
+             << QString::number(event.filter) << ",\"ts\":" << QString::number(event.enqueue)
+             << ",\"dur\":" << QString::number(event.dequeue - event.enqueue) << "}";
+      ++eventCount;
+    }
+
+    ring->exported = written;
+  }
+
+  traceMutex.unlock();
+
+  stream << "\r\n]}\r\n";
+
+  printDebug(DEBUG_NORMAL, "FilterTracer", "Wrote filter trace",
+             {"Filename", "Frames"}, {filename, QString::number(eventCount)});
+  return true;
+}
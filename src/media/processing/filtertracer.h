@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+
+// Records when each frame was queued, taken for processing and finished by
+// each filter. Every thread writes to its own ring buffer so recording does
+// not need locks. The result can be written as a Chrome trace JSON file which
+// can be opened in chrome://tracing or Perfetto to see which filter adds the
+// delay.
+
+class FilterTracer
+{
+public:
+
+  static void setEnabled(bool enabled);
+
+  static bool enabled()
+  {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // monotonic time in microseconds
+  static int64_t now();
+
+  // returns the identifier used when recording frames of this filter
+  static uint32_t registerFilter(QString name);
+
+  // record one frame passing a filter. Must be called from the processing thread.
+  static void record(uint32_t filter, int64_t enqueue, int64_t dequeue, int64_t end);
+
+  // writes all recorded frames to a file and clears the recordings
+  static bool exportChromeTrace(QString filename);
+
+private:
+
+  static std::atomic<bool> enabled_;
+};
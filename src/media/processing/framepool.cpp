@@ -0,0 +1,175 @@
+#include "framepool.h"
+
+#include <cstdlib>
+#include <new>
+
+// buffers are aligned to cache line
+const uint32_t BUFFER_ALIGNMENT = 64;
+
+// the smallest size class. Audio frames fit into this.
+const uint32_t MIN_CLASS_EXPONENT = 12;
+// buffers larger than 2^MAX_CLASS_EXPONENT are not pooled
+const uint32_t MAX_CLASS_EXPONENT = 26;
+
+// each power of two is divided into four classes so that at most 25 % is wasted
+const uint32_t CLASSES_PER_EXPONENT = 4;
+const uint32_t SIZE_CLASSES = (MAX_CLASS_EXPONENT - MIN_CLASS_EXPONENT)*CLASSES_PER_EXPONENT + 1;
+
+// how many free buffers are kept in each class
+const uint32_t MAX_FREE_BUFFERS = 8;
+
+// stored just before the aligned data pointer
+struct BlockHeader
+{
+  void* block;
+  int32_t sizeClass;
+  uint32_t capacity;
+};
+
+
+void FrameDeleter::operator()(uchar* buffer) const
+{
+  if (pool)
+  {
+    pool->release(buffer);
+  }
+  else
+  {
+    delete[] buffer;
+  }
+}
+
+
+FramePool::FramePool():
+  freeMutex_(),
+  freeBuffers_(SIZE_CLASSES),
+  hits_(0),
+  misses_(0)
+{}
+
+
+FramePool::~FramePool()
+{
+  for (auto& sizeClass : freeBuffers_)
+  {
+    for (uchar* buffer : sizeClass)
+    {
+      freeBlock(buffer);
+    }
+  }
+}
+
+
+FrameBuffer FramePool::allocate(uint32_t size)
+{
+  uint32_t capacity = 0;
+  int index = sizeClass(size, capacity);
+
+  uchar* buffer = nullptr;
+
+  if (index != -1)
+  {
+    freeMutex_.lock();
+    if (!freeBuffers_[index].empty())
+    {
+      buffer = freeBuffers_[index].back();
+      freeBuffers_[index].pop_back();
+    }
+    freeMutex_.unlock();
+  }
+
+  if (buffer != nullptr)
+  {
+    ++hits_;
+  }
+  else
+  {
+    ++misses_;
+    buffer = allocateBlock(index, capacity);
+  }
+
+  return FrameBuffer(buffer, FrameDeleter{shared_from_this()});
+}
+
+
+void FramePool::release(uchar* buffer)
+{
+  if (buffer == nullptr)
+  {
+    return;
+  }
+
+  const BlockHeader* header = reinterpret_cast<const BlockHeader*>(buffer) - 1;
+
+  if (header->sizeClass != -1)
+  {
+    freeMutex_.lock();
+    std::vector<uchar*>& sizeClass = freeBuffers_[header->sizeClass];
+    if (sizeClass.size() < MAX_FREE_BUFFERS)
+    {
+      sizeClass.push_back(buffer);
+      freeMutex_.unlock();
+      return;
+    }
+    freeMutex_.unlock();
+  }
+
+  freeBlock(buffer);
+}
+
+
+int FramePool::sizeClass(uint32_t size, uint32_t& capacity) const
+{
+  if (size <= (1u << MIN_CLASS_EXPONENT))
+  {
+    capacity = 1u << MIN_CLASS_EXPONENT;
+    return 0;
+  }
+
+  // find exponent so that 2^exponent < size <= 2^(exponent + 1)
+  uint32_t exponent = MIN_CLASS_EXPONENT;
+  while (exponent < 31 && (size - 1) >> (exponent + 1) != 0)
+  {
+    ++exponent;
+  }
+
+  if (exponent >= MAX_CLASS_EXPONENT)
+  {
+    capacity = size;
+    return -1;
+  }
+
+  uint32_t step = 1u << (exponent - 2);
+  uint32_t quarter = (size - (1u << exponent) + step - 1)/step; // 1..4
+
+  capacity = (1u << exponent) + quarter*step;
+  return (exponent - MIN_CLASS_EXPONENT)*CLASSES_PER_EXPONENT + quarter;
+}
+
+
+uchar* FramePool::allocateBlock(int sizeClass, uint32_t capacity)
+{
+  size_t blockSize = capacity + sizeof(BlockHeader) + BUFFER_ALIGNMENT;
+  void* block = malloc(blockSize);
+  if (block == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+
+  uintptr_t start = reinterpret_cast<uintptr_t>(block) + sizeof(BlockHeader);
+  uintptr_t aligned = (start + BUFFER_ALIGNMENT - 1) & ~(uintptr_t)(BUFFER_ALIGNMENT - 1);
+
+  BlockHeader* header = reinterpret_cast<BlockHeader*>(aligned) - 1;
+  header->block = block;
+  header->sizeClass = sizeClass;
+  header->capacity = capacity;
+
+  return reinterpret_cast<uchar*>(aligned);
+}
+
+
+void FramePool::freeBlock(uchar* buffer)
+{
+  BlockHeader* header = reinterpret_cast<BlockHeader*>(buffer) - 1;
+  free(header->block);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <QMutex>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A pool of reusable frame buffers. Allocating and freeing a full video frame
+// for every picture is expensive so filters take their output buffers from a
+// pool instead. The buffers are grouped into size classes and aligned to
+// cache line so that SIMD code can use aligned loads. A buffer returns to its
+// pool automatically when the last FrameBuffer referring to it is destroyed.
+
+class FramePool;
+
+// Returns the memory to its pool. Buffers without a pool are normal arrays.
+struct FrameDeleter
+{
+  std::shared_ptr<FramePool> pool;
+
+  void operator()(uchar* buffer) const;
+};
+
+// Reference counted frame memory. Sending the same frame to several filters
+// only shares the buffer, so the contents must be treated as read-only when
+// the buffer is shared. Use Filter::makeWritable before modifying in place.
+class FrameBuffer
+{
+public:
+  FrameBuffer():
+    buffer_()
+  {}
+
+  FrameBuffer(std::nullptr_t):
+    buffer_()
+  {}
+
+  // takes ownership of an array allocated with new[]
+  explicit FrameBuffer(uchar* array):
+    buffer_(array, FrameDeleter{nullptr})
+  {}
+
+  FrameBuffer(uchar* buffer, FrameDeleter deleter):
+    buffer_(buffer, deleter)
+  {}
+
+  // for memory owned by something else, like an encoder picture
+  explicit FrameBuffer(std::shared_ptr<uchar> buffer):
+    buffer_(std::move(buffer))
+  {}
+
+  FrameBuffer(FrameBuffer&& other) = default;
+  FrameBuffer& operator=(FrameBuffer&& other) = default;
+
+  // copies must be made explicitly with share()
+  FrameBuffer(const FrameBuffer& other) = delete;
+  FrameBuffer& operator=(const FrameBuffer& other) = delete;
+
+  uchar* get() const
+  {
+    return buffer_.get();
+  }
+
+  uchar& operator[](size_t index) const
+  {
+    return buffer_.get()[index];
+  }
+
+  explicit operator bool() const
+  {
+    return buffer_ != nullptr;
+  }
+
+  bool operator==(std::nullptr_t) const
+  {
+    return buffer_ == nullptr;
+  }
+
+  bool operator!=(std::nullptr_t) const
+  {
+    return buffer_ != nullptr;
+  }
+
+  // returns another reference to the same memory
+  FrameBuffer share() const
+  {
+    FrameBuffer shared;
+    shared.buffer_ = buffer_;
+    return shared;
+  }
+
+  // whether someone else is also reading this memory
+  bool isShared() const
+  {
+    return buffer_.use_count() > 1;
+  }
+
+  void reset()
+  {
+    buffer_.reset();
+  }
+
+private:
+  std::shared_ptr<uchar> buffer_;
+};
+
+class FramePool : public std::enable_shared_from_this<FramePool>
+{
+public:
+  FramePool();
+  virtual ~FramePool();
+
+  // returns a buffer of at least size bytes. The contents are undefined.
+  virtual FrameBuffer allocate(uint32_t size);
+
+  // how many allocations have been served from free buffers vs. from heap
+  uint32_t hits() const
+  {
+    return hits_;
+  }
+
+  uint32_t misses() const
+  {
+    return misses_;
+  }
+
+private:
+
+  friend struct FrameDeleter;
+
+  void release(uchar* buffer);
+
+  // returns -1 if size is too large to be pooled
+  int sizeClass(uint32_t size, uint32_t& capacity) const;
+
+  uchar* allocateBlock(int sizeClass, uint32_t capacity);
+  void freeBlock(uchar* buffer);
+
+  QMutex freeMutex_;
+  std::vector<std::vector<uchar*>> freeBuffers_;
+
+  std::atomic<uint32_t> hits_;
+  std::atomic<uint32_t> misses_;
+};
@@ -0,0 +1,121 @@
+#include "inputqueue.h"
+
+#include "filter.h"
+
+
+InputQueue::InputQueue(uint32_t capacity):
+  cells_(),
+  mask_(0),
+  pushPosition_(0),
+  popPosition_(0)
+{
+  uint64_t size = 2;
+  while (size < capacity)
+  {
+    size *= 2;
+  }
+
+  cells_ = std::unique_ptr<Cell[]>(new Cell[size]);
+  mask_ = size - 1;
+
+  for (uint64_t i = 0; i < size; ++i)
+  {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+    cells_[i].data = nullptr;
+  }
+}
+
+
+InputQueue::~InputQueue()
+{
+  while (pop())
+  {}
+}
+
+
+bool InputQueue::push(std::unique_ptr<Data>& data)
+{
+  uint64_t position = pushPosition_.load(std::memory_order_relaxed);
+  Cell* cell = nullptr;
+
+  while (true)
+  {
+    cell = &cells_[position & mask_];
+    uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+    int64_t difference = (int64_t)sequence - (int64_t)position;
+
+    if (difference == 0)
+    {
+      // the cell is free, try to reserve it
+      if (pushPosition_.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (difference < 0)
+    {
+      // the oldest cell has not been popped yet
+      return false;
+    }
+    else
+    {
+      // someone else took this position
+      position = pushPosition_.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->data = data.release();
+  cell->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+
+std::unique_ptr<Data> InputQueue::pop()
+{
+  uint64_t position = popPosition_.load(std::memory_order_relaxed);
+  Cell* cell = nullptr;
+
+  while (true)
+  {
+    cell = &cells_[position & mask_];
+    uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+    int64_t difference = (int64_t)sequence - (int64_t)(position + 1);
+
+    if (difference == 0)
+    {
+      if (popPosition_.compare_exchange_weak(position, position + 1,
+                                             std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (difference < 0)
+    {
+      // empty
+      return nullptr;
+    }
+    else
+    {
+      position = popPosition_.load(std::memory_order_relaxed);
+    }
+  }
+
+  std::unique_ptr<Data> data(cell->data);
+  cell->data = nullptr;
+  cell->sequence.store(position + mask_ + 1, std::memory_order_release);
+  return data;
+}
+
+
+uint32_t InputQueue::size() const
+{
+  uint64_t pushed = pushPosition_.load(std::memory_order_relaxed);
+  uint64_t popped = popPosition_.load(std::memory_order_relaxed);
+
+  if (pushed <= popped)
+  {
+    return 0;
+  }
+  return (uint32_t)(pushed - popped);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// A bounded lock-free queue for the filter inputs. Any number of threads may
+// push and pop at the same time so the previous filters can put their output
+// here while this filter processes, and a producer can also remove the oldest
+// input when the buffer is full. Based on the bounded queue design of Dmitry
+// Vyukov where each cell has a sequence number telling whose turn it is.
+
+struct Data;
+
+class InputQueue
+{
+public:
+  // capacity is rounded up to a power of two
+  InputQueue(uint32_t capacity);
+  ~InputQueue();
+
+  // returns false if the queue is full. The data is not moved in that case.
+  bool push(std::unique_ptr<Data>& data);
+
+  // returns the oldest data or nullptr if the queue is empty
+  std::unique_ptr<Data> pop();
+
+  // only an estimate if other threads are using the queue
+  uint32_t size() const;
+
+  uint32_t capacity() const
+  {
+    return mask_ + 1;
+  }
+
+private:
+
+  struct Cell
+  {
+    std::atomic<uint64_t> sequence;
+    Data* data;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  uint64_t mask_;
+
+  // positions are on separate cache lines so producers and the consumer
+  // do not invalidate each others cache
+  char padding1_[64];
+  std::atomic<uint64_t> pushPosition_;
+  char padding2_[64];
+  std::atomic<uint64_t> popPosition_;
+  char padding3_[64];
+};
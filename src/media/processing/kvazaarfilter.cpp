@@ -1,6 +1,7 @@
 #include "kvazaarfilter.h"
 
 #include "statisticsinterface.h"
+#include "optimized/yuvscale.h"
 
 #include <kvazaar.h>
 #include <common.h>
@@ -8,243 +9,466 @@
 #include <QtDebug>
 #include <QTime>
 #include <QSize>
+#include <QtConcurrent>
 
 enum RETURN_STATUS {C_SUCCESS = 0, C_FAILURE = -1};
 
+// keyframe requests closer than this to the previous keyframe are ignored (ms)
+const int64_t MIN_KEYFRAME_INTERVAL = 500;
+
+// a keyframe request waits for a periodic intra frame coming this soon (ms)
+const int64_t MAX_KEYFRAME_WAIT = 1000;
+
+// A new bitrate is opened this many frames before the next intra frame so
+// that the encoder is ready to be switched to there.
+const uint32_t BITRATE_OPEN_AHEAD = 15;
+
+// Without periodic intra frames a new bitrate waits for a keyframe request.
+// If none comes, a keyframe is sent for it at most this often (ms).
+const int64_t MIN_BITRATE_KEYFRAME_INTERVAL = 10000;
+
 KvazaarFilter::KvazaarFilter(QString id, StatisticsInterface *stats):
   Filter(id, "Kvazaar", stats, YUV420VIDEO, HEVCVIDEO),
   api_(nullptr),
   config_(nullptr),
   enc_(nullptr),
   pts_(0),
-  input_pic_(nullptr),
-  framerate_num_(30),
+  picturePool_(std::make_shared<KvazaarPicturePool>()),
   framerate_denom_(1),
-  encodingFrames_()
+  encodingFrames_(),
+  reconfigureMutex_(),
+  nextEncoder_(),
+  reconfiguring_(false),
+  closing_(),
+  framesEncoded_(0),
+  keyframePending_(false),
+  lastKeyframe_(0),
+  bitrateChanged_(false),
+  targetBitrate_(0),
+  layer_(0)
 {
   maxBufferSize_ = 3;
 }
 
-void KvazaarFilter::updateSettings()
-{
-  qDebug() << "Updating kvazaar settings";
 
+KvazaarFilter::~KvazaarFilter()
+{
+  // the encoder must not be in use when it is closed
   stop();
-
   while(isRunning())
   {
-    sleep(1);
+    qSleep(1);
   }
 
-
+  // the encoder opened in the background uses this filter
   close();
   encodingFrames_.clear();
+}
 
-  if(init())
+void KvazaarFilter::updateSettings()
+{
+  qDebug() << "Updating kvazaar settings";
+
+  // the bitrate in settings replaces the one from congestion control
+  targetBitrate_ = 0;
+
+  reconfigureMutex_.lock();
+  bool running = enc_ != nullptr;
+  reconfigureMutex_.unlock();
+
+  if(!running)
   {
-    qDebug() << getName() << "Kvazaar resolution change successful";
+    // there is no encoder to keep running
+    stop();
+
+    while(isRunning())
+    {
+      sleep(1);
+    }
+
+    close();
+    encodingFrames_.clear();
+
+    if(init())
+    {
+      qDebug() << getName() << "Kvazaar resolution change successful";
+    }
+    else
+    {
+      qDebug() << "Failed to change resolution";
+    }
+
+    start();
   }
   else
   {
-    qDebug() << "Failed to change resolution";
-  }
+    // Without periodic intra frames the new settings would wait for a
+    // keyframe request. The user changing them is worth one keyframe.
+    reconfigureMutex_.lock();
+    if(config_->intra_period <= 0)
+    {
+      keyframePending_ = true;
+    }
+    reconfigureMutex_.unlock();
 
-  start();
+    reconfigure();
+  }
 
   Filter::updateSettings();
 }
 
+
+void KvazaarFilter::setTargetBitrate(uint32_t bitrate)
+{
+  if (bitrate == targetBitrate_)
+  {
+    return;
+  }
+
+  targetBitrate_ = bitrate;
+
+  // Otherwise the bitrate is used when the encoder is opened. The encoder
+  // is opened ahead of the next intra frame in checkReconfiguration.
+  reconfigureMutex_.lock();
+  if (enc_ != nullptr)
+  {
+    bitrateChanged_ = true;
+  }
+  reconfigureMutex_.unlock();
+}
+
+
+void KvazaarFilter::requestKeyframe()
+{
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+  reconfigureMutex_.lock();
+  if(enc_ == nullptr || keyframePending_ || now - lastKeyframe_ < MIN_KEYFRAME_INTERVAL)
+  {
+    reconfigureMutex_.unlock();
+    return;
+  }
+
+  // Opening an encoder costs a lot more than waiting a moment for the
+  // periodic intra frame of the current one.
+  uint32_t frames = framesUntilIntra();
+  if(frames != UINT32_MAX && config_->framerate_num > 0 &&
+     (int64_t)frames*1000*config_->framerate_denom/config_->framerate_num <= MAX_KEYFRAME_WAIT)
+  {
+    reconfigureMutex_.unlock();
+    printDebug(DEBUG_NORMAL, this, "Keyframe requested, waiting for the next intra frame",
+               {"Frames"}, {QString::number(frames)});
+    return;
+  }
+
+  keyframePending_ = true;
+
+  // an encoder with new settings is already coming and starts with a keyframe
+  bool opening = reconfiguring_;
+  reconfigureMutex_.unlock();
+
+  printDebug(DEBUG_NORMAL, this, "Keyframe requested");
+
+  if(!opening)
+  {
+    reconfigure();
+  }
+}
+
+
+void KvazaarFilter::reconfigure()
+{
+  reconfigureMutex_.lock();
+
+  // the previous reconfiguration was not taken into use yet
+  bool replaced = reconfiguring_;
+  QFuture<Encoder> previous = nextEncoder_;
+  startOpening();
+  reconfigureMutex_.unlock();
+
+  // waiting for it here does not stop the encoding thread
+  if(replaced)
+  {
+    closeEncoder(previous.result());
+  }
+}
+
+
+void KvazaarFilter::startOpening()
+{
+  // Opening the encoder takes a while so it is done in the background while
+  // the old one keeps encoding. The encoder is switched in process.
+  nextEncoder_ = QtConcurrent::run([this]()
+  {
+    return openEncoder();
+  });
+  reconfiguring_ = true;
+
+  // the encoder reads the latest bitrate
+  bitrateChanged_ = false;
+}
+
+
 bool KvazaarFilter::init()
 {
   qDebug() << getName() << "iniating";
 
-  // input picture should not exist at this point
-  if(!input_pic_ && !api_)
+  // encoder should not exist at this point
+  if(!api_)
   {
-
     api_ = kvz_api_get(8);
     if(!api_)
     {
       printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to retrieve Kvazaar API.");
       return false;
     }
-    config_ = api_->config_alloc();
-    enc_ = nullptr;
 
-    if(!config_)
+    Encoder encoder = openEncoder();
+    config_ = encoder.config;
+    enc_ = encoder.encoder;
+
+    if(!enc_)
     {
-      printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to allocate Kvazaar config.");
       return false;
     }
-    QSettings settings("kvazzup.ini", QSettings::IniFormat);
 
-    api_->config_init(config_);
-    api_->config_parse(config_, "preset", settings.value("video/Preset").toString().toUtf8());
+    framesEncoded_ = 0;
+    lastKeyframe_ = QDateTime::currentMSecsSinceEpoch();
+    picturePool_->setResolution(config_->width, config_->height);
 
-    // input
+    qDebug() << getName() << "iniation succeeded.";
+  }
+  return true;
+}
 
-#ifdef __linux__
-    // On Linux the Camerafilter seems to have a Qt bug that causes not being able to set resolution
-    config_->width = 640;
-    config_->height = 480;
-    config_->framerate_num = 30;
-#else
-    config_->width = settings.value("video/ResolutionWidth").toInt();
-    config_->height = settings.value("video/ResolutionHeight").toInt();
-    framerate_num_ = settings.value("video/Framerate").toFloat();
-    config_->framerate_num = framerate_num_;
-#endif
-    config_->framerate_denom = framerate_denom_;
 
-    // parallelization
+KvazaarFilter::Encoder KvazaarFilter::openEncoder()
+{
+  Encoder encoder = {api_->config_alloc(), nullptr};
+  kvz_config* config = encoder.config;
 
-    if (settings.value("video/kvzThreads") == "auto")
-    {
-      config_->threads = QThread::idealThreadCount();
-    }
-    else if (settings.value("video/kvzThreads") == "Main")
-    {
-      config_->threads = 0;
-    }
-    else
-    {
-      config_->threads = settings.value("video/kvzThreads").toInt();
-    }
+  if(!config)
+  {
+    printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to allocate Kvazaar config.");
+    return encoder;
+  }
 
-    config_->owf = settings.value("video/OWF").toInt();
-    config_->wpp = settings.value("video/WPP").toInt();
+  QSettings settings("kvazzup.ini", QSettings::IniFormat);
 
-    bool tiles = false; //settings.value("video/WPP").toBool();
+  api_->config_init(config);
+  api_->config_parse(config, "preset", settings.value("video/Preset").toString().toUtf8());
 
-    if (tiles)
-    {
-      std::string dimensions = settings.value("video/tileDimensions").toString().toStdString();
-      api_->config_parse(config_, "tiles", dimensions.c_str());
-    }
+  // input
 
-    // this does not work with uvgRTP at the moment. Avoid using slices.
-    if(settings.value("video/Slices").toInt() == 1)
-    {
-      if(config_->wpp)
-      {
-        config_->slices = KVZ_SLICES_WPP;
-      }
-      else if (tiles)
-      {
-        config_->slices = KVZ_SLICES_TILES;
-      }
-    }
+#ifdef __linux__
+  // On Linux the Camerafilter seems to have a Qt bug that causes not being able to set resolution
+  config->width = 640;
+  config->height = 480;
+  config->framerate_num = 30;
+#else
+  config->width = settings.value("video/ResolutionWidth").toInt();
+  config->height = settings.value("video/ResolutionHeight").toInt();
+  config->framerate_num = settings.value("video/Framerate").toFloat();
+#endif
+  config->framerate_denom = framerate_denom_;
 
-    // Structure
+  // the simulcast layers are encoded from downscaled pictures
+  config->width = halved_size(config->width, layer_);
+  config->height = halved_size(config->height, layer_);
 
-    config_->qp = settings.value("video/QP").toInt();
-    config_->intra_period = settings.value("video/Intra").toInt();
-    config_->vps_period = settings.value("video/VPS").toInt();
+  // parallelization
 
-    config_->target_bitrate = settings.value("video/bitrate").toInt();
+  if (settings.value("video/kvzThreads") == "auto")
+  {
+    config->threads = QThread::idealThreadCount();
+  }
+  else if (settings.value("video/kvzThreads") == "Main")
+  {
+    config->threads = 0;
+  }
+  else
+  {
+    config->threads = settings.value("video/kvzThreads").toInt();
+  }
 
-    if (config_->target_bitrate != 0)
-    {
-      QString rcAlgo = settings.value("video/rcAlgorithm").toString();
+  config->owf = settings.value("video/OWF").toInt();
+  config->wpp = settings.value("video/WPP").toInt();
 
-      if (rcAlgo == "lambda")
-      {
-        config_->rc_algorithm = KVZ_LAMBDA;
-      }
-      else if (rcAlgo == "oba")
-      {
-        config_->rc_algorithm = KVZ_OBA;
-        config_->clip_neighbour = settings.value("video/obaClipNeighbours").toInt();
-      }
-      else
-      {
-        printWarning(this, "Some carbage in rc algorithm setting");
-        config_->rc_algorithm = KVZ_NO_RC;
-      }
-    }
-    else
-    {
-      config_->rc_algorithm = KVZ_NO_RC;
-    }
+  bool tiles = false; //settings.value("video/WPP").toBool();
 
-    config_->gop_lowdelay = 1;
+  if (tiles)
+  {
+    std::string dimensions = settings.value("video/tileDimensions").toString().toStdString();
+    api_->config_parse(config, "tiles", dimensions.c_str());
+  }
 
-    if (settings.value("video/scalingList").toInt() == 0)
+  // this does not work with uvgRTP at the moment. Avoid using slices.
+  if(settings.value("video/Slices").toInt() == 1)
+  {
+    if(config->wpp)
     {
-      config_->scaling_list = KVZ_SCALING_LIST_OFF;
+      config->slices = KVZ_SLICES_WPP;
     }
-    else
+    else if (tiles)
     {
-      config_->scaling_list = KVZ_SCALING_LIST_DEFAULT;
+      config->slices = KVZ_SLICES_TILES;
     }
+  }
 
-    config_->lossless = settings.value("video/lossless").toInt();
+  // Structure
 
-    QString constraint = settings.value("video/mvConstraint").toString();
+  config->qp = settings.value("video/QP").toInt();
+  config->intra_period = settings.value("video/Intra").toInt();
+  config->vps_period = settings.value("video/VPS").toInt();
 
-    if (constraint == "frame")
-    {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_FRAME;
-    }
-    else if (constraint == "tile")
-    {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_TILE;
-    }
-    else if (constraint == "frametile")
+  // without periodic intra frames the parameter sets are sent only with the
+  // first frame, which is also a keyframe
+  if(settings.value("video/keyframesOnRequest").toInt() == 1)
+  {
+    config->intra_period = 0;
+  }
+
+  config->target_bitrate = settings.value("video/bitrate").toInt();
+
+  // congestion control may lower the bitrate, but only if rate control is used
+  if (config->target_bitrate != 0 && targetBitrate_ != 0)
+  {
+    config->target_bitrate = targetBitrate_;
+  }
+
+  // each halving leaves a quarter of the pixels
+  config->target_bitrate >>= 2*layer_;
+
+  if (config->target_bitrate != 0)
+  {
+    QString rcAlgo = settings.value("video/rcAlgorithm").toString();
+
+    if (rcAlgo == "lambda")
     {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_FRAME_AND_TILE;
+      config->rc_algorithm = KVZ_LAMBDA;
     }
-    else if (constraint == "frametilemargin")
+    else if (rcAlgo == "oba")
     {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_FRAME_AND_TILE_MARGIN;
+      config->rc_algorithm = KVZ_OBA;
+      config->clip_neighbour = settings.value("video/obaClipNeighbours").toInt();
     }
     else
     {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_NONE;
+      printWarning(this, "Some carbage in rc algorithm setting");
+      config->rc_algorithm = KVZ_NO_RC;
     }
+  }
+  else
+  {
+    config->rc_algorithm = KVZ_NO_RC;
+  }
+
+  config->gop_lowdelay = 1;
+
+  if (settings.value("video/scalingList").toInt() == 0)
+  {
+    config->scaling_list = KVZ_SCALING_LIST_OFF;
+  }
+  else
+  {
+    config->scaling_list = KVZ_SCALING_LIST_DEFAULT;
+  }
 
-    config_->set_qp_in_cu = settings.value("video/qpInCU").toInt();
+  config->lossless = settings.value("video/lossless").toInt();
 
-    config_->vaq = settings.value("video/vaq").toInt();
+  QString constraint = settings.value("video/mvConstraint").toString();
 
+  if (constraint == "frame")
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_FRAME;
+  }
+  else if (constraint == "tile")
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_TILE;
+  }
+  else if (constraint == "frametile")
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_FRAME_AND_TILE;
+  }
+  else if (constraint == "frametilemargin")
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_FRAME_AND_TILE_MARGIN;
+  }
+  else
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_NONE;
+  }
 
-    // compression-tab
-    customParameters(settings);
+  config->set_qp_in_cu = settings.value("video/qpInCU").toInt();
 
-    config_->hash = KVZ_HASH_NONE;
+  config->vaq = settings.value("video/vaq").toInt();
 
-    enc_ = api_->encoder_open(config_);
 
-    if(!enc_)
-    {
-      printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to open Kvazaar encoder.");
-      return false;
-    }
+  // compression-tab
+  customParameters(settings, config);
 
-    input_pic_ = api_->picture_alloc(config_->width, config_->height);
+  config->hash = KVZ_HASH_NONE;
 
-    if(!input_pic_)
-    {
-      printDebug(DEBUG_PROGRAM_ERROR, this, "Could not allocate input picture.");
-      return false;
-    }
+  encoder.encoder = api_->encoder_open(config);
 
-    qDebug() << getName() << "iniation succeeded.";
+  if(!encoder.encoder)
+  {
+    printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to open Kvazaar encoder.");
+  }
+
+  return encoder;
+}
+
+
+void KvazaarFilter::closeEncoder(Encoder encoder)
+{
+  if(encoder.encoder)
+  {
+    api_->encoder_close(encoder.encoder);
+  }
+  if(encoder.config)
+  {
+    api_->config_destroy(encoder.config);
   }
-  return true;
 }
 
+void KvazaarFilter::waitForClosing()
+{
+  reconfigureMutex_.lock();
+  QList<QFuture<void>> closing = closing_;
+  closing_.clear();
+  reconfigureMutex_.unlock();
+
+  for(auto& task : closing)
+  {
+    task.waitForFinished();
+  }
+}
+
+
 void KvazaarFilter::close()
 {
+  reconfigureMutex_.lock();
+  bool pending = reconfiguring_;
+  QFuture<Encoder> next = nextEncoder_;
+  reconfiguring_ = false;
+  keyframePending_ = false;
+  bitrateChanged_ = false;
+  reconfigureMutex_.unlock();
+
+  // the encoder opening in the background must finish before it is closed
+  if(pending)
+  {
+    closeEncoder(next.result());
+  }
+
+  waitForClosing();
+
   if(api_)
   {
-    api_->encoder_close(enc_);
-    api_->config_destroy(config_);
+    closeEncoder({config_, enc_});
     enc_ = nullptr;
     config_ = nullptr;
-
-    api_->picture_free(input_pic_);
-    input_pic_ = nullptr;
     api_ = nullptr;
   }
   qDebug() << getName() << "Kvazaar closed";
@@ -261,19 +485,14 @@ void KvazaarFilter::process()
 
   while(input)
   {
-    if(!input_pic_)
-    {
-      printDebug(DEBUG_PROGRAM_ERROR, this,  "Input picture was not allocated correctly.");
-      break;
-    }
-
+    checkReconfiguration(input.get());
     feedInput(std::move(input));
 
     input = getInput();
   }
 }
 
-void KvazaarFilter::customParameters(QSettings& settings)
+void KvazaarFilter::customParameters(QSettings& settings, kvz_config* config)
 {
   int size = settings.beginReadArray("parameters");
 
@@ -285,7 +504,7 @@ void KvazaarFilter::customParameters(QSettings& settings)
     settings.setArrayIndex(i);
     QString name = settings.value("Name").toString();
     QString value = settings.value("Value").toString();
-    if (api_->config_parse(config_, name.toStdString().c_str(),
+    if (api_->config_parse(config, name.toStdString().c_str(),
                            value.toStdString().c_str()) != 1)
     {
       qDebug() << "Initialization," << metaObject()->className()
@@ -296,6 +515,153 @@ void KvazaarFilter::customParameters(QSettings& settings)
 }
 
 
+void KvazaarFilter::checkReconfiguration(const Data* input)
+{
+  QMutexLocker lock(&reconfigureMutex_);
+
+  // periodic intra frames also count for the keyframe request interval
+  if(framesUntilIntra() == 0)
+  {
+    lastKeyframe_ = QDateTime::currentMSecsSinceEpoch();
+  }
+
+  // A new bitrate only changes the rate so it never costs an extra intra
+  // frame as long as the encoder sends them periodically.
+  if(bitrateChanged_ && !reconfiguring_)
+  {
+    bool periodicIntra = config_->intra_period > 0;
+    bool intraSoon = periodicIntra && framesUntilIntra() <= BITRATE_OPEN_AHEAD;
+    bool longWait = !periodicIntra && QDateTime::currentMSecsSinceEpoch() - lastKeyframe_ >=
+        MIN_BITRATE_KEYFRAME_INTERVAL;
+
+    if(intraSoon || longWait || keyframePending_)
+    {
+      startOpening();
+
+      if(longWait)
+      {
+        keyframePending_ = true;
+      }
+    }
+  }
+
+  if(!reconfiguring_ || !nextEncoder_.isFinished())
+  {
+    return;
+  }
+
+  Encoder next = nextEncoder_.result();
+
+  if(!next.encoder)
+  {
+    printWarning(this, "Failed to reconfigure Kvazaar. Continuing with the old settings.");
+    closeEncoder(next);
+    reconfiguring_ = false;
+    keyframePending_ = false;
+    return;
+  }
+
+  bool fitsCurrent = fitsConfig(config_, input);
+  bool fitsNext = fitsConfig(next.config, input);
+
+  // The new encoder starts with an intra frame. Switching when the old
+  // encoder would send one anyway avoids an extra intra frame.
+  bool intraFrame = config_->intra_period > 0 && framesUntilIntra() == 0;
+
+  // the input may not have changed to the new resolution yet
+  if(!fitsNext)
+  {
+    return;
+  }
+
+  // An extra intra frame is only sent when the old encoder cannot encode
+  // the input anymore or a keyframe has been requested.
+  if(fitsCurrent && !intraFrame && !keyframePending_)
+  {
+    return;
+  }
+
+  printDebug(DEBUG_NORMAL, this, "Switching to the reconfigured encoder",
+             {"Resolution", "Reason"},
+             {QString::number(next.config->width) + "x" + QString::number(next.config->height),
+              !fitsCurrent ? "input changed" : (intraFrame ? "intra frame" : "keyframe request")});
+
+  flushEncoder();
+
+  // closing waits for the encoder threads so it is done in the background
+  const kvz_api* api = api_;
+  Encoder old = {config_, enc_};
+  for(auto it = closing_.begin(); it != closing_.end();)
+  {
+    it = it->isFinished() ? closing_.erase(it) : it + 1;
+  }
+
+  closing_.push_back(QtConcurrent::run([api, old]()
+  {
+    api->encoder_close(old.encoder);
+    api->config_destroy(old.config);
+  }));
+
+  config_ = next.config;
+  enc_ = next.encoder;
+  picturePool_->setResolution(config_->width, config_->height);
+
+  reconfiguring_ = false;
+  framesEncoded_ = 0;
+  keyframePending_ = false;
+  lastKeyframe_ = QDateTime::currentMSecsSinceEpoch();
+}
+
+
+uint32_t KvazaarFilter::framesUntilIntra() const
+{
+  if(config_->intra_period <= 0)
+  {
+    return UINT32_MAX;
+  }
+
+  uint32_t period = config_->intra_period;
+  return (period - framesEncoded_ % period) % period;
+}
+
+
+bool KvazaarFilter::fitsConfig(const kvz_config* config, const Data* input) const
+{
+  return config->width == input->width
+      && config->height == input->height
+      && config->framerate_num == input->framerate;
+}
+
+
+void KvazaarFilter::flushEncoder()
+{
+  kvz_picture *recon_pic = nullptr;
+  kvz_frame_info frame_info;
+  kvz_data_chunk *data_out = nullptr;
+  uint32_t len_out = 0;
+
+  // without input Kvazaar returns the frames it is still encoding
+  do
+  {
+    api_->encoder_encode(enc_, nullptr,
+                         &data_out, &len_out,
+                         &recon_pic, nullptr,
+                         &frame_info );
+
+    if(data_out != nullptr)
+    {
+      parseEncodedFrame(data_out, len_out, recon_pic);
+    }
+  } while(data_out != nullptr);
+
+  if(!encodingFrames_.empty())
+  {
+    printProgramWarning(this, "Kvazaar did not return all frames when flushing.");
+    encodingFrames_.clear();
+  }
+}
+
+
 void KvazaarFilter::feedInput(std::unique_ptr<Data> input)
 {
   kvz_picture *recon_pic = nullptr;
@@ -303,9 +669,7 @@ void KvazaarFilter::feedInput(std::unique_ptr<Data> input)
   kvz_data_chunk *data_out = nullptr;
   uint32_t len_out = 0;
 
-  if(config_->width != input->width
-     || config_->height != input->height
-     || config_->framerate_num != input->framerate)
+  if(!fitsConfig(config_, input.get()))
   {
     // This should not happen.
     qDebug() << getName() << "WARNING: Input resolution or framerate differs:"
@@ -317,23 +681,33 @@ void KvazaarFilter::feedInput(std::unique_ptr<Data> input)
     return;
   }
 
-  // copy input to kvazaar picture
-  memcpy(input_pic_->y,
-         input->data.get(),
-         input->width*input->height);
-  memcpy(input_pic_->u,
-         &(input->data.get()[input->width*input->height]),
-         input->width*input->height/4);
-  memcpy(input_pic_->v,
-         &(input->data.get()[input->width*input->height + input->width*input->height/4]),
-         input->width*input->height/4);
+  // Usually the previous filter has written the frame to one of our pictures.
+  // Kvazaar takes its own reference to the picture so we can let go of it.
+  FrameBuffer copy;
+  kvz_picture* input_pic = picturePool_->findPicture(input->data.get());
+
+  if(!input_pic)
+  {
+    // the planes are one after another in both
+    copy = picturePool_->allocate(input->width*input->height*3/2);
+    input_pic = picturePool_->findPicture(copy.get());
+
+    if(!input_pic)
+    {
+      printDebug(DEBUG_PROGRAM_ERROR, this, "Could not allocate input picture.");
+      return;
+    }
+
+    memcpy(copy.get(), input->data.get(), input->width*input->height*3/2);
+  }
 
-  input_pic_->pts = pts_;
+  input_pic->pts = pts_;
   ++pts_;
+  ++framesEncoded_;
 
   encodingFrames_.push_front(std::move(input));
 
-  api_->encoder_encode(enc_, input_pic_,
+  api_->encoder_encode(enc_, input_pic,
                        &data_out, &len_out,
                        &recon_pic, nullptr,
                        &frame_info );
@@ -357,7 +731,7 @@ void KvazaarFilter::parseEncodedFrame(kvz_data_chunk *data_out,
   std::unique_ptr<Data> encodedFrame = std::move(encodingFrames_.back());
   encodingFrames_.pop_back();
 
-  std::unique_ptr<uchar[]> hevc_frame(new uchar[len_out]);
+  FrameBuffer hevc_frame = allocateBuffer(len_out);
   uint8_t* writer = hevc_frame.get();
   uint32_t dataWritten = 0;
 
@@ -372,7 +746,7 @@ void KvazaarFilter::parseEncodedFrame(kvz_data_chunk *data_out,
 
       sendEncodedFrame(std::move(slice), std::move(hevc_frame), dataWritten);
 
-      hevc_frame = std::unique_ptr<uchar[]>(new uchar[len_out - dataWritten]);
+      hevc_frame = allocateBuffer(len_out - dataWritten);
       writer = hevc_frame.get();
       dataWritten = 0;
     }
@@ -384,8 +758,6 @@ void KvazaarFilter::parseEncodedFrame(kvz_data_chunk *data_out,
   api_->chunk_free(data_out);
   api_->picture_free(recon_pic);
 
-  uint32_t delay = QDateTime::currentMSecsSinceEpoch() - encodedFrame->presentationTime;
-  getStats()->sendDelay("video", delay);
   getStats()->addEncodedPacket("video", len_out);
 
   // send last packet reusing input structure
@@ -394,7 +766,7 @@ void KvazaarFilter::parseEncodedFrame(kvz_data_chunk *data_out,
 
 
 void KvazaarFilter::sendEncodedFrame(std::unique_ptr<Data> input,
-                                     std::unique_ptr<uchar[]> hevc_frame,
+                                     FrameBuffer hevc_frame,
                                      uint32_t dataWritten)
 {
   input->type = HEVCVIDEO;
@@ -1,8 +1,15 @@
 #pragma once
 #include "filter.h"
+#include "kvazaarpicturepool.h"
 
 #include <QSize>
 #include <QSettings>
+#include <QFuture>
+#include <QMutex>
+#include <QList>
+
+#include <atomic>
+
 struct kvz_api;
 struct kvz_config;
 struct kvz_encoder;
@@ -13,19 +20,85 @@ class KvazaarFilter : public Filter
 {
 public:
   KvazaarFilter(QString id, StatisticsInterface* stats);
+  ~KvazaarFilter();
 
+  // Settings are changed by opening a new encoder in the background while
+  // the current one keeps encoding, and switching at the next intra frame.
+  // The switch only happens elsewhere if the input no longer fits the old
+  // encoder, a keyframe is requested or there are no periodic intra frames.
   virtual void updateSettings();
 
+  // Overrides the bitrate in settings until the next updateSettings. Ignored
+  // if rate control is not enabled. The new bitrate is taken into use at the
+  // next periodic intra frame so that it does not cost an extra keyframe.
+  // Without periodic intra frames it waits for a keyframe request, or sends
+  // a keyframe for it if none has been sent in 10 seconds. That keeps the
+  // bitrate spikes of extra keyframes rare at the cost of reacting slowly.
+  void setTargetBitrate(uint32_t bitrate);
+
+  // Served by the next periodic intra frame if it comes within a second.
+  // Otherwise a new encoder is opened in the background and switched to as
+  // soon as it is ready, since it starts with a keyframe. Kvazaar has no way
+  // to force an intra frame in a running encoder. A pending bitrate change
+  // is taken into use with it. Repeated requests are ignored until then.
+  virtual void requestKeyframe();
+
+  // Encodes a simulcast layer of halved resolution and bitrate instead of
+  // the full resolution. Call before init.
+  void setLayer(uint8_t layer)
+  {
+    layer_ = layer;
+  }
+
   virtual bool init();
 
   void close();
 
+  // the filter before the encoder should allocate its output from this pool
+  std::shared_ptr<FramePool> getPicturePool()
+  {
+    return picturePool_;
+  }
+
 protected:
   virtual void process();
 
 private:
 
-  void customParameters(QSettings& settings);
+  struct Encoder
+  {
+    kvz_config* config;
+    kvz_encoder* encoder;
+  };
+
+  // opens an encoder with the current settings in the background
+  void reconfigure();
+
+  // starts opening the next encoder. reconfigureMutex_ must be held and no
+  // other encoder may be opening.
+  void startOpening();
+
+  // how many frames the current encoder encodes before its next intra frame
+  uint32_t framesUntilIntra() const;
+
+  // creates an encoder with the current settings. Can be called from any thread.
+  Encoder openEncoder();
+
+  void closeEncoder(Encoder encoder);
+
+  // waits until the replaced encoders have been closed in the background
+  void waitForClosing();
+
+  // switches to the reconfigured encoder if it is ready and this is a good moment
+  void checkReconfiguration(const Data* input);
+
+  // whether the encoder with this config can encode the input
+  bool fitsConfig(const kvz_config* config, const Data* input) const;
+
+  // outputs all the frames the encoder is still working on
+  void flushEncoder();
+
+  void customParameters(QSettings& settings, kvz_config* config);
 
   // copy the frame data to kvazaar input in suitable format.
   void feedInput(std::unique_ptr<Data> input);
@@ -35,7 +108,7 @@ private:
                          kvz_picture *recon_pic);
 
   void sendEncodedFrame(std::unique_ptr<Data> input,
-                        std::unique_ptr<uchar[]> hevc_frame,
+                        FrameBuffer hevc_frame,
                         uint32_t dataWritten);
 
 
@@ -45,11 +118,34 @@ private:
 
   int64_t pts_;
 
-  kvz_picture *input_pic_;
+  // the input pictures, shared with the filter producing them
+  std::shared_ptr<KvazaarPicturePool> picturePool_;
 
-  int32_t framerate_num_;
   int32_t framerate_denom_;
 
   // temporarily store frame data during encoding
   std::deque<std::unique_ptr<Data>> encodingFrames_;
+
+  // the encoder with new settings, waiting to be switched to
+  QMutex reconfigureMutex_;
+  QFuture<Encoder> nextEncoder_;
+  bool reconfiguring_;
+
+  // the replaced encoders being closed in the background
+  QList<QFuture<void>> closing_;
+
+  // by the current encoder, to know when it sends an intra frame
+  std::atomic<uint32_t> framesEncoded_;
+
+  // the next encoder switch should not wait for an intra frame
+  bool keyframePending_;
+  int64_t lastKeyframe_; // milliseconds since epoch
+
+  // a new bitrate is waiting for the next intra frame
+  bool bitrateChanged_;
+
+  // from congestion control, 0 if settings are used
+  std::atomic<uint32_t> targetBitrate_;
+
+  uint8_t layer_;
 };
@@ -0,0 +1,146 @@
+#include "kvazaarpicturepool.h"
+
+#include <kvazaar.h>
+
+#include <new>
+
+// how many released pictures are kept for reuse
+const uint32_t MAX_FREE_PICTURES = 8;
+
+
+// returns the picture to the pool when the last FrameBuffer is gone
+struct PictureReleaser
+{
+  std::shared_ptr<KvazaarPicturePool> pool;
+
+  void operator()(kvz_picture* picture) const
+  {
+    pool->release(picture);
+  }
+};
+
+
+// Kvazaar changes the reference count atomically
+static bool referencedByKvazaar(const kvz_picture* picture)
+{
+  return *static_cast<const volatile int32_t*>(&picture->refcount) > 1;
+}
+
+
+KvazaarPicturePool::KvazaarPicturePool():
+  FramePool(),
+  api_(kvz_api_get(8)),
+  pictureMutex_(),
+  width_(0),
+  height_(0),
+  usedPictures_(),
+  freePictures_()
+{}
+
+
+KvazaarPicturePool::~KvazaarPicturePool()
+{
+  // the used pictures keep the pool alive, so only free ones can be left
+  for (kvz_picture* picture : freePictures_)
+  {
+    api_->picture_free(picture);
+  }
+}
+
+
+void KvazaarPicturePool::setResolution(int32_t width, int32_t height)
+{
+  pictureMutex_.lock();
+  width_ = width;
+  height_ = height;
+
+  for (kvz_picture* picture : freePictures_)
+  {
+    api_->picture_free(picture);
+  }
+  freePictures_.clear();
+  pictureMutex_.unlock();
+}
+
+
+FrameBuffer KvazaarPicturePool::allocate(uint32_t size)
+{
+  pictureMutex_.lock();
+
+  if (api_ == nullptr || width_ == 0 || size != (uint32_t)(width_*height_ + width_*height_/2))
+  {
+    pictureMutex_.unlock();
+    return FramePool::allocate(size);
+  }
+
+  kvz_picture* picture = nullptr;
+
+  for (unsigned int i = 0; i < freePictures_.size(); ++i)
+  {
+    if (!referencedByKvazaar(freePictures_.at(i)))
+    {
+      picture = freePictures_.at(i);
+      freePictures_.erase(freePictures_.begin() + i);
+      break;
+    }
+  }
+
+  if (picture == nullptr)
+  {
+    // Kvazaar pictures have the planes one after another like our YUV420 frames
+    picture = api_->picture_alloc(width_, height_);
+
+    if (picture == nullptr)
+    {
+      pictureMutex_.unlock();
+      throw std::bad_alloc();
+    }
+  }
+
+  usedPictures_[picture->fulldata] = picture;
+  pictureMutex_.unlock();
+
+  std::shared_ptr<KvazaarPicturePool> pool =
+      std::static_pointer_cast<KvazaarPicturePool>(shared_from_this());
+
+  // the frame data shares the lifetime of the picture
+  std::shared_ptr<kvz_picture> owner(picture, PictureReleaser{pool});
+  return FrameBuffer(std::shared_ptr<uchar>(owner, picture->fulldata));
+}
+
+
+kvz_picture* KvazaarPicturePool::findPicture(const uchar* data)
+{
+  kvz_picture* picture = nullptr;
+
+  pictureMutex_.lock();
+  auto found = usedPictures_.find(data);
+  if (found != usedPictures_.end())
+  {
+    picture = found->second;
+  }
+  pictureMutex_.unlock();
+
+  return picture;
+}
+
+
+void KvazaarPicturePool::release(kvz_picture* picture)
+{
+  pictureMutex_.lock();
+  usedPictures_.erase(picture->fulldata);
+
+  if (picture->width == width_ && picture->height == height_ &&
+      freePictures_.size() < MAX_FREE_PICTURES)
+  {
+    freePictures_.push_back(picture);
+    picture = nullptr;
+  }
+  pictureMutex_.unlock();
+
+  // Kvazaar frees the picture itself if it still holds a reference
+  if (picture != nullptr)
+  {
+    api_->picture_free(picture);
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "framepool.h"
+
+#include <map>
+
+struct kvz_api;
+struct kvz_picture;
+
+// Frame buffers that are Kvazaar input pictures. The filter producing the
+// YUV frames for the encoder allocates its output from this pool, so the
+// encoder can use the frame as it is instead of copying it to its own
+// picture. Kvazaar keeps its own reference to the pictures it is
+// encoding, so a picture is reused only after both Kvazaar and all the
+// filters have released it.
+//
+// Only buffers of exactly one YUV420 frame at the current resolution are
+// Kvazaar pictures, other sizes are served like in a normal frame pool.
+
+class KvazaarPicturePool : public FramePool
+{
+public:
+  KvazaarPicturePool();
+  virtual ~KvazaarPicturePool();
+
+  // the resolution of the encoder. Pictures of other resolutions are freed.
+  void setResolution(int32_t width, int32_t height);
+
+  virtual FrameBuffer allocate(uint32_t size);
+
+  // returns the picture which contains this frame data or null if the data
+  // was not allocated from this pool. The buffer must still be referenced.
+  kvz_picture* findPicture(const uchar* data);
+
+private:
+
+  friend struct PictureReleaser;
+
+  void release(kvz_picture* picture);
+
+  const kvz_api* api_;
+
+  QMutex pictureMutex_;
+
+  int32_t width_;
+  int32_t height_;
+
+  // pictures given out, by their frame data
+  std::map<const uchar*, kvz_picture*> usedPictures_;
+
+  // these may still be referenced by Kvazaar
+  std::vector<kvz_picture*> freePictures_;
+};
@@ -0,0 +1,65 @@
+#include "layerselectorfilter.h"
+
+#include "common.h"
+
+// nothing is sent until the first layer has been switched to
+const uint8_t NO_LAYER = 255;
+
+const uint8_t VPS_NAL_TYPE = 32;
+
+LayerSelectorFilter::LayerSelectorFilter(QString id, StatisticsInterface* stats):
+  Filter(id, "Layer Selector", stats, HEVCVIDEO, HEVCVIDEO),
+  wantedLayer_(0),
+  currentLayer_(NO_LAYER)
+{}
+
+
+void LayerSelectorFilter::setLayer(uint8_t layer)
+{
+  if (layer != wantedLayer_)
+  {
+    printDebug(DEBUG_NORMAL, this, "Changing simulcast layer",
+               {"Previous", "New"},
+               {QString::number(wantedLayer_), QString::number(layer)});
+    wantedLayer_ = layer;
+  }
+}
+
+
+void LayerSelectorFilter::process()
+{
+  std::unique_ptr<Data> input = getInput();
+
+  while(input)
+  {
+    uint8_t wanted = wantedLayer_;
+    if (input->layer == wanted && currentLayer_ != wanted && startsWithVPS(input.get()))
+    {
+      currentLayer_ = wanted;
+    }
+
+    // the other layers are left to the peers which want them
+    if (input->layer == currentLayer_)
+    {
+      sendOutput(std::move(input));
+    }
+
+    input = getInput();
+  }
+}
+
+
+bool LayerSelectorFilter::startsWithVPS(const Data* input) const
+{
+  const uint8_t* buff = input->data.get();
+
+  // Kvazaar starts the frame with a start code of three or four bytes
+  uint32_t pos = 0;
+  while (pos < input->data_size && pos < 4 && buff[pos] == 0)
+  {
+    ++pos;
+  }
+
+  return pos >= 2 && pos + 1 < input->data_size && buff[pos] == 1 &&
+      ((buff[pos + 1] >> 1) & 0x3F) == VPS_NAL_TYPE;
+}
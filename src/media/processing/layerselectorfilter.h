@@ -0,0 +1,36 @@
+#pragma once
+#include "filter.h"
+
+#include <atomic>
+
+// Passes the encoded video of one simulcast layer to a peer. All the layer
+// encoders send to the selector and a new layer is switched to at its next
+// VPS, so the decoder of the peer gets the parameter sets and an intra frame
+// first.
+
+class LayerSelectorFilter : public Filter
+{
+public:
+  LayerSelectorFilter(QString id, StatisticsInterface* stats);
+
+  // the layer is changed once it sends its next parameter sets
+  void setLayer(uint8_t layer);
+
+  uint8_t getLayer() const
+  {
+    return wantedLayer_;
+  }
+
+protected:
+
+  void process();
+
+private:
+
+  bool startsWithVPS(const Data* input) const;
+
+  std::atomic<uint8_t> wantedLayer_;
+
+  // the layer which is sent, or NO_LAYER before the first switch
+  uint8_t currentLayer_;
+};
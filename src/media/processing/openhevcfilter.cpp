@@ -6,50 +6,177 @@
 
 #include <QSettings>
 
+#include <algorithm>
+
 enum OHThreadType {OH_THREAD_FRAME  = 1, OH_THREAD_SLICE  = 2, OH_THREAD_FRAMESLICE  = 3};
 
+enum HEVCNALType {VPS_NAL = 32, SPS_NAL = 33, PPS_NAL = 34};
+
+// how many frames to wait for parameter sets before asking for a keyframe again
+const uint32_t KEYFRAME_WAIT_FRAMES = 30;
+
+// WPP lets this many threads decode rows in parallel before the wavefront
+// dependencies limit it. More threads are also used for frames.
+const int MAX_WPP_THREADS = 4;
+
+QMutex OpenHEVCFilter::budgetMutex_;
+int OpenHEVCFilter::threadBudget_ = 0;
+int OpenHEVCFilter::decoders_ = 0;
+
+
+// the NAL type of the first NAL unit after the start code
+static uint8_t firstNALType(const Data* input)
+{
+  const uint8_t* buff = input->data.get();
+  if(input->data_size < 5)
+  {
+    return 0;
+  }
+  return (buff[buff[2] == 1 ? 3 : 4] >> 1) & 0x3F;
+}
+
+
+// reads the bits of a NAL unit payload, which has the emulation prevention
+// bytes removed
+class BitReader
+{
+public:
+  BitReader(const std::vector<uint8_t>& rbsp):
+    rbsp_(rbsp),
+    position_(0)
+  {}
+
+  uint32_t bits(int count)
+  {
+    uint32_t value = 0;
+    for(int i = 0; i < count; ++i)
+    {
+      uint32_t byte = position_/8 < rbsp_.size() ? rbsp_[position_/8] : 0;
+      value = (value << 1) | ((byte >> (7 - position_%8)) & 1);
+      ++position_;
+    }
+    return value;
+  }
+
+  // exp-Golomb codes
+  uint32_t ue()
+  {
+    int zeros = 0;
+    while(bits(1) == 0 && zeros < 32)
+    {
+      ++zeros;
+    }
+    return (1u << zeros) - 1 + bits(zeros);
+  }
+
+  int32_t se()
+  {
+    uint32_t code = ue();
+    return (code & 1) ? (int32_t)((code + 1)/2) : -(int32_t)(code/2);
+  }
+
+private:
+  const std::vector<uint8_t>& rbsp_;
+  size_t position_;
+};
+
+
 OpenHEVCFilter::OpenHEVCFilter(uint32_t sessionID, StatisticsInterface *stats):
   Filter(QString::number(sessionID), "OpenHEVC", stats, HEVCVIDEO, YUV420VIDEO),
   handle_(),
+  decoderOpen_(false),
+  threadType_(0),
+  threads_(0),
   parameterSets_(false),
+  parameterSetInputs_(),
   waitFrames_(0),
   slices_(true),
   sessionID_(sessionID),
-  threads_(-1)
+  registered_(false)
 {}
 
 
+OpenHEVCFilter::~OpenHEVCFilter()
+{
+  uninit();
+}
+
+
 bool OpenHEVCFilter::init()
 {
   printNormal(this, "Starting to initiate OpenHEVC");
-  QSettings settings("kvazzup.ini", QSettings::IniFormat);
 
-  threads_ = settings.value("video/OPENHEVC_threads").toInt();
-  handle_ = libOpenHevcInit(threads_, OH_THREAD_FRAME);
+  budgetMutex_.lock();
+  if(!registered_)
+  {
+    registered_ = true;
+    ++decoders_;
+  }
+  budgetMutex_.unlock();
+
+  updateSettings();
+
+  // The stream tells which threading suits it, but the decoder is needed
+  // before the first parameter sets arrive.
+  if(!openDecoder(OH_THREAD_FRAME, threadShare()))
+  {
+    return false;
+  }
+
+  // This is because we don't know anything about the incoming stream
+  maxBufferSize_ = -1; // no buffer limit
+
+  return true;
+}
+
+
+void OpenHEVCFilter::uninit()
+{
+  closeDecoder();
+
+  budgetMutex_.lock();
+  if(registered_)
+  {
+    registered_ = false;
+    --decoders_;
+  }
+  budgetMutex_.unlock();
+}
+
+
+bool OpenHEVCFilter::openDecoder(int threadType, int threads)
+{
+  handle_ = libOpenHevcInit(threads, threadType);
 
   libOpenHevcSetDebugMode(handle_, 0);
   if(libOpenHevcStartDecoder(handle_) == -1)
   {
     printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to start decoder.");
+    libOpenHevcClose(handle_);
     return false;
   }
   libOpenHevcSetTemporalLayer_id(handle_, 0);
   libOpenHevcSetActiveDecoders(handle_, 0);
   libOpenHevcSetViewLayers(handle_, 0);
-  printNormal(this, "OpenHEVC initiation successful.", {"Version"}, {libOpenHevcVersion(handle_)});
-
-  // This is because we don't know anything about the incoming stream
-  maxBufferSize_ = -1; // no buffer limit
+  printDebug(DEBUG_NORMAL, this, "OpenHEVC initiation successful.",
+             {"Version", "Threads"}, {libOpenHevcVersion(handle_), QString::number(threads)});
 
+  decoderOpen_ = true;
+  threadType_ = threadType;
+  threads_ = threads;
   return true;
 }
 
 
-void OpenHEVCFilter::uninit()
+void OpenHEVCFilter::closeDecoder()
 {
-  printNormal(this, "Uniniating.");
-  libOpenHevcFlush(handle_);
-  libOpenHevcClose(handle_);
+  if(decoderOpen_)
+  {
+    printNormal(this, "Uniniating.");
+    libOpenHevcFlush(handle_);
+    libOpenHevcClose(handle_);
+    decoderOpen_ = false;
+  }
 }
 
 
@@ -67,15 +194,151 @@ void OpenHEVCFilter::run()
 void OpenHEVCFilter::updateSettings()
 {
   QSettings settings("kvazzup.ini", QSettings::IniFormat);
-  if (settings.value("video/OPENHEVC_threads").toInt() != threads_)
+
+  // zero means all cores
+  int budget = settings.value("video/OPENHEVC_threads").toInt();
+  if(budget <= 0)
   {
-    uninit();
-    init();
+    budget = QThread::idealThreadCount();
   }
+
+  budgetMutex_.lock();
+  threadBudget_ = budget;
+  budgetMutex_.unlock();
+
   Filter::updateSettings();
 }
 
 
+int OpenHEVCFilter::threadShare()
+{
+  QMutexLocker lock(&budgetMutex_);
+  return std::max(1, threadBudget_/std::max(1, decoders_));
+}
+
+
+void OpenHEVCFilter::checkThreading(Data* input)
+{
+  uint8_t nalType = firstNALType(input);
+
+  // only the parameter sets are looked at
+  if(nalType < VPS_NAL || nalType > PPS_NAL)
+  {
+    return;
+  }
+
+  if(nalType == VPS_NAL)
+  {
+    parameterSetInputs_.clear();
+  }
+
+  int threadType = ppsThreadType(input);
+
+  if(threadType == 0)
+  {
+    // a new decoder will need these
+    parameterSetInputs_.push_back(std::unique_ptr<Data>(deepDataCopy(input)));
+    return;
+  }
+
+  // The threading only changes at the parameter sets so the decoder does not
+  // lose anything it needs. More decoders may also have joined the budget.
+  int threads = threadShare();
+  if(decoderOpen_ && threadType == threadType_ && threads == threads_)
+  {
+    return;
+  }
+
+  printDebug(DEBUG_NORMAL, this, "Changing decoder threading",
+             {"Type", "Threads"},
+             {threadType == OH_THREAD_FRAMESLICE ? "frame and slice" :
+              threadType == OH_THREAD_SLICE ? "slice" : "frame", QString::number(threads)});
+
+  closeDecoder();
+  if(!openDecoder(threadType, threads))
+  {
+    return;
+  }
+
+  // the old decoder got these
+  for(auto& parameterSet : parameterSetInputs_)
+  {
+    libOpenHevcDecode(handle_, parameterSet->data.get(), parameterSet->data_size,
+                      parameterSet->presentationTime);
+  }
+}
+
+
+int OpenHEVCFilter::ppsThreadType(const Data* input) const
+{
+  const uint8_t* buff = input->data.get();
+  const uint32_t size = input->data_size;
+
+  // find the PPS NAL unit
+  uint32_t start = 0;
+  for(uint32_t i = 0; i + 4 < size && start == 0; ++i)
+  {
+    if(buff[i] == 0 && buff[i + 1] == 0 && buff[i + 2] == 1 &&
+       ((buff[i + 3] >> 1) & 0x3F) == PPS_NAL)
+    {
+      start = i + 5; // after the NAL header
+    }
+  }
+
+  if(start == 0)
+  {
+    return 0;
+  }
+
+  // the payload ends at the next start code
+  std::vector<uint8_t> rbsp;
+  for(uint32_t i = start; i < size; ++i)
+  {
+    if(i + 2 < size && buff[i] == 0 && buff[i + 1] == 0 && buff[i + 2] <= 1)
+    {
+      break;
+    }
+    if(i >= start + 2 && buff[i] == 3 && buff[i - 1] == 0 && buff[i - 2] == 0)
+    {
+      continue; // emulation prevention
+    }
+    rbsp.push_back(buff[i]);
+  }
+
+  BitReader pps(rbsp);
+  pps.ue();    // pps_pic_parameter_set_id
+  pps.ue();    // pps_seq_parameter_set_id
+  pps.bits(7); // dependent slices, output flag, extra slice header bits,
+               // sign data hiding, cabac init present
+  pps.ue();    // num_ref_idx_l0_default_active_minus1
+  pps.ue();    // num_ref_idx_l1_default_active_minus1
+  pps.se();    // init_qp_minus26
+  pps.bits(2); // constrained intra pred, transform skip
+  if(pps.bits(1))
+  {
+    pps.ue();  // diff_cu_qp_delta_depth
+  }
+  pps.se();    // pps_cb_qp_offset
+  pps.se();    // pps_cr_qp_offset
+  pps.bits(4); // slice chroma qp offsets, weighted pred and bipred, transquant bypass
+
+  bool tiles = pps.bits(1);
+  bool wpp = pps.bits(1);
+
+  printDebug(DEBUG_NORMAL, this, "Parallel tools of the stream",
+             {"WPP", "Tiles"}, {wpp ? "yes" : "no", tiles ? "yes" : "no"});
+
+  // Slice threading decodes the CTU rows of WPP in parallel without the
+  // added delay of frame threading. OpenHEVC does not decode tiles in
+  // parallel, so they are decoded with frame threading like plain streams.
+  if(wpp)
+  {
+    return threadShare() > MAX_WPP_THREADS ? OH_THREAD_FRAMESLICE : OH_THREAD_SLICE;
+  }
+  return OH_THREAD_FRAME;
+}
+
+
 void OpenHEVCFilter::combineFrame(std::unique_ptr<Data>& combinedFrame)
 {
   if(sliceBuffer_.size() == 0)
@@ -92,7 +355,7 @@ void OpenHEVCFilter::combineFrame(std::unique_ptr<Data>& combinedFrame)
     combinedFrame->data_size += sliceBuffer_.at(i)->data_size;
   }
 
-  combinedFrame->data = std::unique_ptr<uchar[]>(new uchar[combinedFrame->data_size]);
+  combinedFrame->data = allocateBuffer(combinedFrame->data_size);
 
   uint32_t dataWritten = 0;
   for(unsigned int i = 0; i < sliceBuffer_.size(); ++i)
@@ -105,9 +368,7 @@ void OpenHEVCFilter::combineFrame(std::unique_ptr<Data>& combinedFrame)
   if(slices_ && sliceBuffer_.size() == 1)
   {
     slices_ = false;
-    printPeerError(this, "Detected no slices in incoming stream.");
-    uninit();
-    init();
+    printNormal(this, "Detected no slices in incoming stream.");
   }
 
   sliceBuffer_.clear();
@@ -134,8 +395,6 @@ void OpenHEVCFilter::process()
     {
       slices_ = true;
       printNormal(this, "Detected slices in incoming stream");
-      uninit();
-      init();
     }
 
     if(!parameterSets_ && (buff[4] >> 1) == 32)
@@ -156,12 +415,17 @@ void OpenHEVCFilter::process()
           break;
         }
 
-        int gotPicture = libOpenHevcDecode(handle_, frame->data.get(), frame->data_size, frame->presentationTime);
+        int gotPicture = -1;
+        if(decoderOpen_)
+        {
+          gotPicture = libOpenHevcDecode(handle_, frame->data.get(), frame->data_size, frame->presentationTime);
+        }
 
         OpenHevc_Frame openHevcFrame;
         if( gotPicture == -1)
         {
           printDebug(DEBUG_ERROR, this,  "Error while decoding.");
+          emit keyframeNeeded();
         }
         else if(!gotPicture && frame->data_size >= 2)
         {
@@ -183,31 +447,27 @@ void OpenHEVCFilter::process()
 
           frame->width = openHevcFrame.frameInfo.nWidth;
           frame->height = openHevcFrame.frameInfo.nHeight;
-          uint32_t finalDataSize = frame->width*frame->height + frame->width*frame->height/2;
-          std::unique_ptr<uchar[]> yuv_frame(new uchar[finalDataSize]);
+          // The picture belongs to the decoder so it has to be copied, but
+          // the planes are copied whole with the decoder's row pitch instead
+          // of repacking every row.
+          uint32_t yStride = openHevcFrame.frameInfo.nYPitch;
+          uint32_t uStride = openHevcFrame.frameInfo.nUPitch;
+          uint32_t vStride = openHevcFrame.frameInfo.nVPitch;
 
-          uint8_t* pY = (uint8_t*)yuv_frame.get();
-          uint8_t* pU = (uint8_t*)&(yuv_frame.get()[frame->width*frame->height]);
-          uint8_t* pV = (uint8_t*)&(yuv_frame.get()[frame->width*frame->height + frame->width*frame->height/4]);
+          uint32_t ySize = yStride*frame->height;
+          uint32_t uSize = uStride*frame->height/2;
+          uint32_t vSize = vStride*frame->height/2;
 
-          uint32_t s_stride = openHevcFrame.frameInfo.nYPitch;
-          uint32_t qs_stride = openHevcFrame.frameInfo.nUPitch/2;
+          uint32_t finalDataSize = ySize + uSize + vSize;
+          FrameBuffer yuv_frame = allocateBuffer(finalDataSize);
 
-          uint32_t d_stride = frame->width/2;
-          uint32_t dd_stride = frame->width;
+          memcpy(yuv_frame.get(), openHevcFrame.pvY, ySize);
+          memcpy(yuv_frame.get() + ySize, openHevcFrame.pvU, uSize);
+          memcpy(yuv_frame.get() + ySize + uSize, openHevcFrame.pvV, vSize);
 
-          for (int i=0; i<frame->height; i++) {
-            memcpy(pY,  (uint8_t *) openHevcFrame.pvY + i*s_stride, dd_stride);
-            pY += dd_stride;
-
-            if (! (i%2) ) {
-              memcpy(pU,  (uint8_t *) openHevcFrame.pvU + i*qs_stride, d_stride);
-              pU += d_stride;
-
-              memcpy(pV,  (uint8_t *) openHevcFrame.pvV + i*qs_stride, d_stride);
-              pV += d_stride;
-            }
-          }
+          frame->stride[0] = yStride;
+          frame->stride[1] = uStride;
+          frame->stride[2] = vStride;
 
           // TODO: put delay into deque, and set timestamp accordingly to get more accurate latency.
 
@@ -219,10 +479,16 @@ void OpenHEVCFilter::process()
           sendOutput(std::move(frame));
         }
       }
+      checkThreading(input.get());
       sliceBuffer_.push_back(std::move(input));
     }
     else
     {
+      // the parameter sets are sent with keyframes
+      if(waitFrames_ % KEYFRAME_WAIT_FRAMES == 0)
+      {
+        emit keyframeNeeded();
+      }
       ++waitFrames_;
     }
 
@@ -3,15 +3,22 @@
 
 #include "openHevcWrapper.h"
 
+#include <QMutex>
+
+// Decodes HEVC with OpenHEVC. The threading of the decoder is chosen from
+// the parallel tools the picture parameter set of the stream enables, and
+// the decoding threads set in settings are shared by all the decoders.
 class OpenHEVCFilter : public Filter
 {
 public:
   OpenHEVCFilter(uint32_t sessionID, StatisticsInterface* stats);
+  ~OpenHEVCFilter();
 
   virtual bool init();
   void uninit();
   void run();
 
+  // the new thread count is taken into use at the next parameter sets
   virtual void updateSettings();
 
 protected:
@@ -19,13 +26,34 @@ protected:
 
 private:
 
+  bool openDecoder(int threadType, int threads);
+  void closeDecoder();
+
+  // Reopens the decoder at a PPS if the threading should change. The
+  // parameter sets given to the old decoder are given to the new one.
+  void checkThreading(Data* input);
+
+  // the OpenHEVC thread type for the PPS in this input, 0 if there is none
+  int ppsThreadType(const Data* input) const;
+
+  // the decoding threads of one decoder
+  static int threadShare();
+
   // combine the slices to a frame.
   void combineFrame(std::unique_ptr<Data> &combinedFrame);
 
   OpenHevc_Handle handle_;
+  bool decoderOpen_;
+
+  // what the decoder was opened with
+  int threadType_;
+  int threads_;
 
   bool parameterSets_;
 
+  // the VPS and SPS of the latest parameter sets, if they came separately
+  std::vector<std::unique_ptr<Data>> parameterSetInputs_;
+
   uint32_t waitFrames_;
 
   bool slices_;
@@ -34,5 +62,10 @@ private:
 
   uint32_t sessionID_;
 
-  int threads_;
+  bool registered_;
+
+  // the thread budget and the decoders sharing it
+  static QMutex budgetMutex_;
+  static int threadBudget_;
+  static int decoders_;
 };
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <smmintrin.h>
+#include <immintrin.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Mixing of 16-bit PCM audio. All the inputs are summed to 32-bit
+// accumulators in one pass over the samples. The sums are brought back to
+// 16 bits with a gain given as a linear ramp over a block, which is how the
+// limiter of AudioOutputDevice changes its gain smoothly. The conversion
+// saturates and returns how many samples did not fit.
+
+// the SIMD kernels are compiled for their instruction set regardless of the
+// compiler flags and are only called if the CPU supports them
+#if defined(__GNUC__)
+#define AUDIOMIX_TARGET(isa) __attribute__((target(isa)))
+#else
+#define AUDIOMIX_TARGET(isa)
+#endif
+
+
+// output[i] = sum of inputs[n][i]
+inline void mix_audio_scalar(const int16_t* const* inputs, unsigned int count,
+                             int32_t* output, unsigned int samples)
+{
+  for (unsigned int i = 0; i < samples; ++i)
+  {
+    int32_t sum = 0;
+    for (unsigned int n = 0; n < count; ++n)
+    {
+      sum += inputs[n][i];
+    }
+    output[i] = sum;
+  }
+}
+
+
+AUDIOMIX_TARGET("sse4.1")
+inline void mix_audio_sse41(const int16_t* const* inputs, unsigned int count,
+                            int32_t* output, unsigned int samples)
+{
+  unsigned int i = 0;
+  for (; i + 8 <= samples; i += 8)
+  {
+    __m128i low = _mm_setzero_si128();
+    __m128i high = _mm_setzero_si128();
+
+    for (unsigned int n = 0; n < count; ++n)
+    {
+      __m128i in = _mm_loadu_si128((__m128i const*)(inputs[n] + i));
+      low = _mm_add_epi32(low, _mm_cvtepi16_epi32(in));
+      high = _mm_add_epi32(high, _mm_cvtepi16_epi32(_mm_srli_si128(in, 8)));
+    }
+
+    _mm_storeu_si128((__m128i*)(output + i), low);
+    _mm_storeu_si128((__m128i*)(output + i + 4), high);
+  }
+
+  for (; i < samples; ++i)
+  {
+    int32_t sum = 0;
+    for (unsigned int n = 0; n < count; ++n)
+    {
+      sum += inputs[n][i];
+    }
+    output[i] = sum;
+  }
+}
+
+
+AUDIOMIX_TARGET("avx2")
+inline void mix_audio_avx2(const int16_t* const* inputs, unsigned int count,
+                           int32_t* output, unsigned int samples)
+{
+  unsigned int i = 0;
+  for (; i + 16 <= samples; i += 16)
+  {
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+
+    for (unsigned int n = 0; n < count; ++n)
+    {
+      __m256i in = _mm256_loadu_si256((__m256i const*)(inputs[n] + i));
+      low = _mm256_add_epi32(low, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(in)));
+      high = _mm256_add_epi32(high, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(in, 1)));
+    }
+
+    _mm256_storeu_si256((__m256i*)(output + i), low);
+    _mm256_storeu_si256((__m256i*)(output + i + 8), high);
+  }
+
+  for (; i < samples; ++i)
+  {
+    int32_t sum = 0;
+    for (unsigned int n = 0; n < count; ++n)
+    {
+      sum += inputs[n][i];
+    }
+    output[i] = sum;
+  }
+}
+
+
+// the largest absolute value of the mixed samples
+inline int32_t mix_peak_scalar(const int32_t* mix, unsigned int samples)
+{
+  int32_t peak = 0;
+  for (unsigned int i = 0; i < samples; ++i)
+  {
+    int32_t value = abs(mix[i]);
+    if (value > peak)
+    {
+      peak = value;
+    }
+  }
+  return peak;
+}
+
+
+AUDIOMIX_TARGET("sse4.1")
+inline int32_t mix_peak_sse41(const int32_t* mix, unsigned int samples)
+{
+  __m128i peaks = _mm_setzero_si128();
+
+  unsigned int i = 0;
+  for (; i + 4 <= samples; i += 4)
+  {
+    __m128i in = _mm_loadu_si128((__m128i const*)(mix + i));
+    peaks = _mm_max_epi32(peaks, _mm_abs_epi32(in));
+  }
+
+  peaks = _mm_max_epi32(peaks, _mm_shuffle_epi32(peaks, _MM_SHUFFLE(1, 0, 3, 2)));
+  peaks = _mm_max_epi32(peaks, _mm_shuffle_epi32(peaks, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  int32_t peak = _mm_cvtsi128_si32(peaks);
+  int32_t tail = mix_peak_scalar(mix + i, samples - i);
+  return tail > peak ? tail : peak;
+}
+
+
+// output[i] = mix[i] * gain, where the gain goes linearly from startGain
+// towards endGain. Returns the number of clipped samples.
+inline uint32_t mix_to_pcm_scalar(const int32_t* mix, int16_t* output, unsigned int samples,
+                                  float startGain, float endGain)
+{
+  uint32_t clipped = 0;
+  float step = (endGain - startGain)/samples;
+
+  for (unsigned int i = 0; i < samples; ++i)
+  {
+    float value = mix[i]*(startGain + step*i);
+    int32_t rounded = (int32_t)lrintf(value);
+
+    if (rounded > INT16_MAX)
+    {
+      rounded = INT16_MAX;
+      ++clipped;
+    }
+    else if (rounded < INT16_MIN)
+    {
+      rounded = INT16_MIN;
+      ++clipped;
+    }
+    output[i] = rounded;
+  }
+
+  return clipped;
+}
+
+
+AUDIOMIX_TARGET("sse4.1")
+inline uint32_t mix_to_pcm_sse41(const int32_t* mix, int16_t* output, unsigned int samples,
+                                 float startGain, float endGain)
+{
+  float step = (endGain - startGain)/samples;
+
+  __m128 gain = _mm_setr_ps(startGain, startGain + step, startGain + 2*step, startGain + 3*step);
+  const __m128 gainStep = _mm_set1_ps(4*step);
+
+  const __m128i maximum = _mm_set1_epi32(INT16_MAX);
+  const __m128i minimum = _mm_set1_epi32(INT16_MIN);
+
+  // the comparisons give -1 for each clipped sample
+  __m128i clips = _mm_setzero_si128();
+
+  unsigned int i = 0;
+  for (; i + 8 <= samples; i += 8)
+  {
+    __m128 in0 = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i const*)(mix + i)));
+    __m128 in1 = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i const*)(mix + i + 4)));
+
+    __m128i out0 = _mm_cvtps_epi32(_mm_mul_ps(in0, gain));
+    gain = _mm_add_ps(gain, gainStep);
+    __m128i out1 = _mm_cvtps_epi32(_mm_mul_ps(in1, gain));
+    gain = _mm_add_ps(gain, gainStep);
+
+    clips = _mm_add_epi32(clips, _mm_cmpgt_epi32(out0, maximum));
+    clips = _mm_add_epi32(clips, _mm_cmplt_epi32(out0, minimum));
+    clips = _mm_add_epi32(clips, _mm_cmpgt_epi32(out1, maximum));
+    clips = _mm_add_epi32(clips, _mm_cmplt_epi32(out1, minimum));
+
+    _mm_storeu_si128((__m128i*)(output + i), _mm_packs_epi32(out0, out1));
+  }
+
+  clips = _mm_add_epi32(clips, _mm_shuffle_epi32(clips, _MM_SHUFFLE(1, 0, 3, 2)));
+  clips = _mm_add_epi32(clips, _mm_shuffle_epi32(clips, _MM_SHUFFLE(2, 3, 0, 1)));
+  uint32_t clipped = -_mm_cvtsi128_si32(clips);
+
+  if (i < samples)
+  {
+    clipped += mix_to_pcm_scalar(mix + i, output + i, samples - i,
+                                 startGain + step*i, endGain);
+  }
+
+  return clipped;
+}
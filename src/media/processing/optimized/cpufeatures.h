@@ -0,0 +1,78 @@
+#pragma once
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Runtime detection of the instruction sets the optimized kernels can use.
+// The kernels are compiled for all levels, but may only be called if both
+// the CPU and the operating system support the instructions.
+
+enum SIMDLevel {SIMD_NONE = 0, SIMD_SSE41, SIMD_AVX2, SIMD_AVX512BW};
+
+inline SIMDLevel detectSIMDLevel()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+
+  __cpuid(info, 1);
+  bool sse41 = info[2] & (1 << 19);
+  bool osxsave = info[2] & (1 << 27);
+
+  // the OS must save the YMM and ZMM registers on context switch
+  unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+  bool ymm = (xcr0 & 0x6) == 0x6;
+  bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+  bool avx2 = false;
+  bool avx512bw = false;
+  if (maxLeaf >= 7)
+  {
+    __cpuidex(info, 7, 0);
+    avx2 = info[1] & (1 << 5);
+    avx512bw = (info[1] & (1 << 16)) && (info[1] & (1 << 30));
+  }
+
+  if (avx512bw && zmm)
+  {
+    return SIMD_AVX512BW;
+  }
+  if (avx2 && ymm)
+  {
+    return SIMD_AVX2;
+  }
+  if (sse41)
+  {
+    return SIMD_SSE41;
+  }
+#else
+  // these also check the OS support
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+  {
+    return SIMD_AVX512BW;
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1"))
+  {
+    return SIMD_SSE41;
+  }
+#endif
+  return SIMD_NONE;
+}
+
+inline const char* simdLevelName(SIMDLevel level)
+{
+  switch (level)
+  {
+  case SIMD_AVX512BW: return "AVX-512BW";
+  case SIMD_AVX2:     return "AVX2";
+  case SIMD_SSE41:    return "SSE4.1";
+  default:            return "none";
+  }
+}
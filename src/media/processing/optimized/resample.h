@@ -0,0 +1,90 @@
+#pragma once
+
+#include <smmintrin.h>
+#include <immintrin.h>
+#include <stdint.h>
+
+// Inner products of the polyphase resampler. Each output sample is the
+// product of one phase of the filter and the newest input samples, which
+// are kept as floats so the kernels do not have to convert them for every
+// phase. The number of taps must be a multiple of eight.
+
+// the SIMD kernels are compiled for their instruction set regardless of the
+// compiler flags and are only called if the CPU supports them
+#if defined(__GNUC__)
+#define RESAMPLE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RESAMPLE_TARGET(isa)
+#endif
+
+
+inline float resample_dot_scalar(const float* samples, const float* taps, unsigned int count)
+{
+  float sum = 0.0f;
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    sum += samples[i]*taps[i];
+  }
+  return sum;
+}
+
+
+RESAMPLE_TARGET("sse4.1")
+inline float resample_dot_sse41(const float* samples, const float* taps, unsigned int count)
+{
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+
+  for (unsigned int i = 0; i < count; i += 8)
+  {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(taps + i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(samples + i + 4), _mm_loadu_ps(taps + i + 4)));
+  }
+
+  __m128 sum = _mm_add_ps(sum0, sum1);
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+  return _mm_cvtss_f32(sum);
+}
+
+
+RESAMPLE_TARGET("avx2")
+inline float resample_dot_avx2(const float* samples, const float* taps, unsigned int count)
+{
+  __m256 sum = _mm256_setzero_ps();
+
+  for (unsigned int i = 0; i < count; i += 8)
+  {
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(samples + i), _mm256_loadu_ps(taps + i)));
+  }
+
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(1, 1, 1, 1)));
+  return _mm_cvtss_f32(half);
+}
+
+
+// int16 to float for the sample history
+inline void resample_load_scalar(const int16_t* input, float* output, unsigned int samples)
+{
+  for (unsigned int i = 0; i < samples; ++i)
+  {
+    output[i] = input[i];
+  }
+}
+
+
+RESAMPLE_TARGET("sse4.1")
+inline void resample_load_sse41(const int16_t* input, float* output, unsigned int samples)
+{
+  unsigned int i = 0;
+  for (; i + 8 <= samples; i += 8)
+  {
+    __m128i in = _mm_loadu_si128((__m128i const*)(input + i));
+    _mm_storeu_ps(output + i, _mm_cvtepi32_ps(_mm_cvtepi16_epi32(in)));
+    _mm_storeu_ps(output + i + 4, _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(in, 8))));
+  }
+
+  resample_load_scalar(input + i, output + i, samples - i);
+}
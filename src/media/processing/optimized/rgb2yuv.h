@@ -1,7 +1,10 @@
+#pragma once
+
 #include <emmintrin.h>
 #include <xmmintrin.h>
 #include <pmmintrin.h>
 #include <smmintrin.h>
+#include <immintrin.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <math.h>
@@ -11,7 +14,76 @@
 
 #include <omp.h>
 
-int rgb2yuv_i_sse41_single(uint8_t* input, uint8_t* output, int width, int height)
+// All kernels flip the image vertically. Y = (76R + 150G + 29B) >> 8 and the
+// chroma is calculated from the vertical sums of a 2x2 block and averaged
+// horizontally. The AVX kernels give the same result as the scalar
+// reference and the SSE4.1 kernels.
+
+// the SIMD kernels are compiled for their instruction set regardless of the
+// compiler flags and are only called if the CPU supports them
+#if defined(__GNUC__)
+#define RGB2YUV_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RGB2YUV_TARGET(isa)
+#endif
+
+
+static inline uint8_t rgb2yuv_luma(const uint8_t* pixel)
+{
+  return (uint8_t)((76*pixel[2] + 150*pixel[1] + 29*pixel[0]) >> 8);
+}
+
+
+// top is the left pixel of the 2x2 block, bottom the one below it
+static inline uint8_t rgb2yuv_chroma(const uint8_t* top, const uint8_t* bottom,
+                                     int r_mul, int g_mul, int b_mul)
+{
+  int32_t left = (r_mul*(top[2] + bottom[2]) + g_mul*(top[1] + bottom[1])
+      + b_mul*(top[0] + bottom[0]) + 255*255) >> 9;
+  int32_t right = (r_mul*(top[6] + bottom[6]) + g_mul*(top[5] + bottom[5])
+      + b_mul*(top[4] + bottom[4]) + 255*255) >> 9;
+
+  left = left < 0 ? 0 : (left > 255 ? 255 : left);
+  right = right < 0 ? 0 : (right > 255 ? 255 : right);
+
+  return (uint8_t)((left + right) >> 1);
+}
+
+
+// converts two rows starting from pixel x
+static inline void rgb2yuv_rows_scalar(const uint8_t* in0, const uint8_t* in1,
+                                       uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v,
+                                       int x, int width)
+{
+  for (; x < width; x += 2)
+  {
+    y0[x]     = rgb2yuv_luma(in0 + 4*x);
+    y0[x + 1] = rgb2yuv_luma(in0 + 4*x + 4);
+    y1[x]     = rgb2yuv_luma(in1 + 4*x);
+    y1[x + 1] = rgb2yuv_luma(in1 + 4*x + 4);
+
+    u[x/2] = rgb2yuv_chroma(in0 + 4*x, in1 + 4*x, -43, -84, 127);
+    v[x/2] = rgb2yuv_chroma(in0 + 4*x, in1 + 4*x, 127, -106, -21);
+  }
+}
+
+
+// Reference implementation. Width and height must be even.
+inline int rgb2yuv_scalar(uint8_t* input, uint8_t* output, int width, int height)
+{
+  for (int row = 0; row < height; row += 2)
+  {
+    const uint8_t* in0 = input + row*width*4;
+    uint8_t* y0 = output + (height - 1 - row)*width;
+    uint8_t* u = output + width*height + (height/2 - 1 - row/2)*(width/2);
+
+    rgb2yuv_rows_scalar(in0, in0 + width*4, y0, y0 - width, u, u + width*height/4, 0, width);
+  }
+  return 1;
+}
+
+RGB2YUV_TARGET("sse4.1")
+inline int rgb2yuv_i_sse41_single(uint8_t* input, uint8_t* output, int width, int height)
 {
   const int r_mul_y[4] = { 76, 76, 76, 76 };
   const int r_mul_u[4] = { -43, -43, -43, -43 };
@@ -144,7 +216,8 @@ int rgb2yuv_i_sse41_single(uint8_t* input, uint8_t* output, int width, int heigh
 }
 
 
-int rgb2yuv_i_sse41(uint8_t* input, uint8_t* output, int width, int height, int threads)
+RGB2YUV_TARGET("sse4.1")
+inline int rgb2yuv_i_sse41(uint8_t* input, uint8_t* output, int width, int height, int threads)
 {
   const int r_mul_y[4] = { 76, 76, 76, 76 };
   const int r_mul_u[4] = { -43, -43, -43, -43 };
@@ -211,12 +284,7 @@ int rgb2yuv_i_sse41(uint8_t* input, uint8_t* output, int width, int height, int
     __m128i temp_y = _mm_shuffle_epi8(res_y, shufflemask);
 
     // this takes advantage of losing the remainder when dividing with width.
-    uint8_t *y_place = out_y + 4*i/16 - (((i/16 - 1)*4)/width)*2*width;
-
-    if (i == 0)
-    {
-      y_place = out_y;
-    }
+    uint8_t *y_place = out_y + 4*i/16 - ((4*i/16)/width)*2*width;
 
     memcpy(y_place, &temp_y, 4);
   }
@@ -276,3 +344,223 @@ int rgb2yuv_i_sse41(uint8_t* input, uint8_t* output, int width, int height, int
   //_mm_empty();
   return 1;
 }
+
+
+// Y of 8 pixels as 32-bit values. The pixels are split to 16-bit B,R and G,A
+// pairs so madd can do the multiplications and the first addition.
+RGB2YUV_TARGET("avx2")
+static inline __m256i rgb2yuv_luma_avx2(__m256i pixels)
+{
+  const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+  const __m256i br_mul = _mm256_set1_epi32((76 << 16) | 29);
+  const __m256i ga_mul = _mm256_set1_epi32(150);
+
+  __m256i br = _mm256_and_si256(pixels, mask);
+  __m256i ga = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask);
+
+  return _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(br, br_mul),
+                                            _mm256_madd_epi16(ga, ga_mul)), 8);
+}
+
+
+// Chroma of 8 pixels from two rows. The coefficients fit to 8 bits so maddubs
+// can be used. The result is in the even 32-bit elements.
+RGB2YUV_TARGET("avx2")
+static inline __m256i rgb2yuv_chroma_avx2(__m256i top, __m256i bottom, __m256i mul)
+{
+  const __m256i ones = _mm256_set1_epi16(1);
+  const __m256i offset = _mm256_set1_epi32(255*255);
+  const __m256i max_val = _mm256_set1_epi32(255);
+
+  __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(_mm256_maddubs_epi16(top, mul), ones),
+                                 _mm256_madd_epi16(_mm256_maddubs_epi16(bottom, mul), ones));
+
+  __m256i chroma = _mm256_srai_epi32(_mm256_add_epi32(sum, offset), 9);
+  chroma = _mm256_max_epi32(_mm256_setzero_si256(), _mm256_min_epi32(max_val, chroma));
+
+  // average of the pixel pair
+  return _mm256_srli_epi32(_mm256_add_epi32(chroma, _mm256_srli_epi64(chroma, 32)), 1);
+}
+
+
+// 16 pixels from two rows
+RGB2YUV_TARGET("avx2")
+static inline void rgb2yuv_chroma16_avx2(const uint8_t* in0, const uint8_t* in1,
+                                         uint8_t* u, uint8_t* v)
+{
+  const __m256i u_mul = _mm256_set1_epi32((int)(((uint8_t)-43 << 16) | ((uint8_t)-84 << 8) | 127));
+  const __m256i v_mul = _mm256_set1_epi32((int)((127 << 16) | ((uint8_t)-106 << 8) | (uint8_t)-21));
+  const __m256i chroma_order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const __m256i byte_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  __m256i a0 = _mm256_loadu_si256((__m256i const*)in0);
+  __m256i b0 = _mm256_loadu_si256((__m256i const*)(in0 + 32));
+  __m256i a1 = _mm256_loadu_si256((__m256i const*)in1);
+  __m256i b1 = _mm256_loadu_si256((__m256i const*)(in1 + 32));
+
+  // the even elements of the first 8 pixels and the second 8 pixels interleaved
+  __m256i res_u = _mm256_blend_epi32(rgb2yuv_chroma_avx2(a0, a1, u_mul),
+                                     _mm256_slli_epi64(rgb2yuv_chroma_avx2(b0, b1, u_mul), 32), 0xAA);
+  __m256i res_v = _mm256_blend_epi32(rgb2yuv_chroma_avx2(a0, a1, v_mul),
+                                     _mm256_slli_epi64(rgb2yuv_chroma_avx2(b0, b1, v_mul), 32), 0xAA);
+
+  res_u = _mm256_permutevar8x32_epi32(res_u, chroma_order);
+  res_v = _mm256_permutevar8x32_epi32(res_v, chroma_order);
+
+  __m256i packed = _mm256_packs_epi32(res_u, res_v);
+  packed = _mm256_packus_epi16(packed, packed);
+  packed = _mm256_permutevar8x32_epi32(packed, byte_order);
+
+  __m128i result = _mm256_castsi256_si128(packed);
+  _mm_storel_epi64((__m128i*)u, result);
+  _mm_storel_epi64((__m128i*)v, _mm_unpackhi_epi64(result, result));
+}
+
+
+// 32 pixels of one row
+RGB2YUV_TARGET("avx2")
+static inline void rgb2yuv_luma32_avx2(const uint8_t* in, uint8_t* out)
+{
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  __m256i y_a = rgb2yuv_luma_avx2(_mm256_loadu_si256((__m256i const*)in));
+  __m256i y_b = rgb2yuv_luma_avx2(_mm256_loadu_si256((__m256i const*)(in + 32)));
+  __m256i y_c = rgb2yuv_luma_avx2(_mm256_loadu_si256((__m256i const*)(in + 64)));
+  __m256i y_d = rgb2yuv_luma_avx2(_mm256_loadu_si256((__m256i const*)(in + 96)));
+
+  __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(y_a, y_b), _mm256_packs_epi32(y_c, y_d));
+  _mm256_storeu_si256((__m256i*)out, _mm256_permutevar8x32_epi32(packed, order));
+}
+
+
+// Width and height must be even. Threads 1 disables OpenMP.
+RGB2YUV_TARGET("avx2")
+inline int rgb2yuv_i_avx2(uint8_t* input, uint8_t* output, int width, int height, int threads)
+{
+  if (threads > 0)
+  {
+    omp_set_num_threads(threads);
+  }
+
+  #pragma omp parallel for if(threads != 1)
+  for (int row = 0; row < height; row += 2)
+  {
+    const uint8_t* in0 = input + row*width*4;
+    const uint8_t* in1 = in0 + width*4;
+    uint8_t* y0 = output + (height - 1 - row)*width;
+    uint8_t* y1 = y0 - width;
+    uint8_t* u = output + width*height + (height/2 - 1 - row/2)*(width/2);
+    uint8_t* v = u + width*height/4;
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+      rgb2yuv_luma32_avx2(in0 + 4*x, y0 + x);
+      rgb2yuv_luma32_avx2(in1 + 4*x, y1 + x);
+
+      rgb2yuv_chroma16_avx2(in0 + 4*x,      in1 + 4*x,      u + x/2,     v + x/2);
+      rgb2yuv_chroma16_avx2(in0 + 4*x + 64, in1 + 4*x + 64, u + x/2 + 8, v + x/2 + 8);
+    }
+
+    rgb2yuv_rows_scalar(in0, in1, y0, y1, u, v, x, width);
+  }
+
+  return 1;
+}
+
+
+RGB2YUV_TARGET("avx512f,avx512bw")
+static inline __m512i rgb2yuv_luma_avx512(__m512i pixels)
+{
+  const __m512i mask = _mm512_set1_epi32(0x00FF00FF);
+  const __m512i br_mul = _mm512_set1_epi32((76 << 16) | 29);
+  const __m512i ga_mul = _mm512_set1_epi32(150);
+
+  __m512i br = _mm512_and_si512(pixels, mask);
+  __m512i ga = _mm512_and_si512(_mm512_srli_epi32(pixels, 8), mask);
+
+  return _mm512_srli_epi32(_mm512_add_epi32(_mm512_madd_epi16(br, br_mul),
+                                            _mm512_madd_epi16(ga, ga_mul)), 8);
+}
+
+
+// chroma of 16 pixels from two rows, written as 8 bytes
+RGB2YUV_TARGET("avx512f,avx512bw")
+static inline void rgb2yuv_chroma16_avx512(__m512i top, __m512i bottom, __m512i mul, uint8_t* out)
+{
+  const __m512i ones = _mm512_set1_epi16(1);
+  const __m512i offset = _mm512_set1_epi32(255*255);
+  const __m512i max_val = _mm512_set1_epi32(255);
+
+  __m512i sum = _mm512_add_epi32(_mm512_madd_epi16(_mm512_maddubs_epi16(top, mul), ones),
+                                 _mm512_madd_epi16(_mm512_maddubs_epi16(bottom, mul), ones));
+
+  __m512i chroma = _mm512_srai_epi32(_mm512_add_epi32(sum, offset), 9);
+  chroma = _mm512_max_epi32(_mm512_setzero_si512(), _mm512_min_epi32(max_val, chroma));
+
+  // the pair average ends up in the lowest byte of each 64-bit element
+  chroma = _mm512_srli_epi32(_mm512_add_epi32(chroma, _mm512_srli_epi64(chroma, 32)), 1);
+  _mm_storel_epi64((__m128i*)out, _mm512_cvtepi64_epi8(chroma));
+}
+
+
+// 64 pixels of one row
+RGB2YUV_TARGET("avx512f,avx512bw")
+static inline void rgb2yuv_luma64_avx512(const uint8_t* in, uint8_t* out)
+{
+  const __m512i order = _mm512_set_epi32(15, 11, 7, 3, 14, 10, 6, 2,
+                                         13, 9, 5, 1, 12, 8, 4, 0);
+
+  __m512i y_a = rgb2yuv_luma_avx512(_mm512_loadu_si512((void const*)in));
+  __m512i y_b = rgb2yuv_luma_avx512(_mm512_loadu_si512((void const*)(in + 64)));
+  __m512i y_c = rgb2yuv_luma_avx512(_mm512_loadu_si512((void const*)(in + 128)));
+  __m512i y_d = rgb2yuv_luma_avx512(_mm512_loadu_si512((void const*)(in + 192)));
+
+  __m512i packed = _mm512_packus_epi16(_mm512_packs_epi32(y_a, y_b), _mm512_packs_epi32(y_c, y_d));
+  _mm512_storeu_si512((void*)out, _mm512_permutexvar_epi32(order, packed));
+}
+
+
+// Width and height must be even. Threads 1 disables OpenMP.
+RGB2YUV_TARGET("avx512f,avx512bw")
+inline int rgb2yuv_i_avx512bw(uint8_t* input, uint8_t* output, int width, int height, int threads)
+{
+  const __m512i u_mul = _mm512_set1_epi32((int)(((uint8_t)-43 << 16) | ((uint8_t)-84 << 8) | 127));
+  const __m512i v_mul = _mm512_set1_epi32((int)((127 << 16) | ((uint8_t)-106 << 8) | (uint8_t)-21));
+
+  if (threads > 0)
+  {
+    omp_set_num_threads(threads);
+  }
+
+  #pragma omp parallel for if(threads != 1)
+  for (int row = 0; row < height; row += 2)
+  {
+    const uint8_t* in0 = input + row*width*4;
+    const uint8_t* in1 = in0 + width*4;
+    uint8_t* y0 = output + (height - 1 - row)*width;
+    uint8_t* y1 = y0 - width;
+    uint8_t* u = output + width*height + (height/2 - 1 - row/2)*(width/2);
+    uint8_t* v = u + width*height/4;
+
+    int x = 0;
+    for (; x + 64 <= width; x += 64)
+    {
+      rgb2yuv_luma64_avx512(in0 + 4*x, y0 + x);
+      rgb2yuv_luma64_avx512(in1 + 4*x, y1 + x);
+
+      for (int i = 0; i < 64; i += 16)
+      {
+        __m512i top = _mm512_loadu_si512((void const*)(in0 + 4*(x + i)));
+        __m512i bottom = _mm512_loadu_si512((void const*)(in1 + 4*(x + i)));
+
+        rgb2yuv_chroma16_avx512(top, bottom, u_mul, u + (x + i)/2);
+        rgb2yuv_chroma16_avx512(top, bottom, v_mul, v + (x + i)/2);
+      }
+    }
+
+    rgb2yuv_rows_scalar(in0, in1, y0, y1, u, v, x, width);
+  }
+
+  return 1;
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <emmintrin.h>
 #include <xmmintrin.h>
 #include <pmmintrin.h>
@@ -10,7 +12,63 @@
 
 #include <omp.h>
 
-int yuv2rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+// the SIMD kernels are compiled for their instruction set regardless of the
+// compiler flags and are only called if the CPU supports them
+#if defined(__GNUC__)
+#define YUV2RGB_TARGET(isa) __attribute__((target(isa)))
+#else
+#define YUV2RGB_TARGET(isa)
+#endif
+
+static inline uint8_t yuv2rgb_clamp(int32_t input)
+{
+  if(input & ~255)
+  {
+    return (-input) >> 31;
+  }
+  return input;
+}
+
+
+// The kernels take the row pitch of each plane so that pictures padded by
+// the decoder can be converted without packing them first. The versions
+// without strides are for packed I420.
+
+// Reference implementation. Gives the same result as the SIMD kernels.
+inline int yuv2rgb_scalar(const uint8_t* in_y, int y_stride, const uint8_t* in_u, int u_stride,
+                          const uint8_t* in_v, int v_stride, uint8_t* output, int width, int height)
+{
+  for(int y = 0; y < height; ++y)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      int32_t luma = in_y[y*y_stride + x];
+      int32_t cb = in_u[y/2*u_stride + x/2] - 128;
+      int32_t cr = in_v[y/2*v_stride + x/2] - 128;
+
+      int32_t rpixel = cr + (cr >> 2) + (cr >> 3) + (cr >> 5);
+      int32_t gpixel = ((cb >> 2) + (cb >> 4) + (cb >> 5)) + ((cr >> 1) + (cr >> 3) + (cr >> 4) + (cr >> 5));
+      int32_t bpixel = cb + (cb >> 1) + (cb >> 2) + (cb >> 6);
+
+      uint8_t* out = output + 4*(y*width + x);
+      out[0] = yuv2rgb_clamp(luma + bpixel);
+      out[1] = yuv2rgb_clamp(luma - gpixel);
+      out[2] = yuv2rgb_clamp(luma + rpixel);
+      out[3] = 0;
+    }
+  }
+  return 1;
+}
+
+inline int yuv2rgb_scalar(const uint8_t* input, uint8_t* output, int width, int height)
+{
+  return yuv2rgb_scalar(input, width, input + width*height, width/2,
+                        input + width*height*5/4, width/2, output, width, height);
+}
+
+YUV2RGB_TARGET("sse4.1")
+inline int yuv2rgb_i_sse41(const uint8_t* in_y, int y_stride, const uint8_t* in_u, int u_stride,
+                           const uint8_t* in_v, int v_stride, uint8_t* output, uint16_t width, uint16_t height)
 {
   const int mini[4] = { 0,0,0,0 };
   const int middle[4] = { 128, 128, 128, 128 };
@@ -24,9 +82,6 @@ int yuv2rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint16_t he
   uint8_t *row_g = (uint8_t *)malloc(width*4);
   uint8_t *row_b = (uint8_t *)malloc(width*4);
 
-  uint8_t *in_y = &input[0];
-  uint8_t *in_u = &input[width*height];
-  uint8_t *in_v = &input[width*height + (width*height >> 2)];
   uint8_t *out = output;
 
   int8_t row = 0;   
@@ -110,6 +165,12 @@ int yuv2rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint16_t he
     // Track rows for chroma
     pix += 16;
     if (pix == width) {
+      // skip the padding at the end of the rows
+      in_y += y_stride - width;
+      if (!row) {
+        in_u += u_stride - width/2;
+        in_v += v_stride - width/2;
+      }
       row = !row;
       pix = 0;
     }
@@ -121,6 +182,13 @@ int yuv2rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint16_t he
   return 1;
 }
 
+YUV2RGB_TARGET("sse4.1")
+inline int yuv2rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  return yuv2rgb_i_sse41(input, width, input + width*height, width/2,
+                         input + width*height*5/4, width/2, output, width, height);
+}
+
  #define _mm256_set_m128i(/* __m128i */ hi, /* __m128i */ lo) _mm256_insertf128_si256(_mm256_castsi128_si256(lo), (hi), 0x1)
 
 // Return the next aligned address for *p. Result is at most alignment larger than p.
@@ -128,7 +196,10 @@ int yuv2rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint16_t he
 // 32 bytes is enough for AVX2
 #define SIMD_ALIGNMENT 32
 
-int yuv2rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height, uint8_t threads)
+YUV2RGB_TARGET("avx2")
+inline int yuv2rgb_i_avx2(const uint8_t* in_y_base, int y_stride, const uint8_t* in_u_base, int u_stride,
+                          const uint8_t* in_v_base, int v_stride, uint8_t* output,
+                          uint16_t width, uint16_t height, uint8_t threads)
 {
   const int mini[8] = { 0,0,0,0,0,0,0,0 };
   const int middle[8] = { 128, 128, 128, 128,128, 128, 128, 128 };
@@ -138,10 +209,6 @@ int yuv2rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t hei
   const __m256i middle_val = _mm256_loadu_si256((__m256i const*)middle);
   const __m256i max_val = _mm256_loadu_si256((__m256i const*)maxi);
 
-  uint8_t *in_y_base = &input[0];;
-  uint8_t *in_u_base = &input[width*height];;
-  uint8_t *in_v_base = &input[width*height + (width*height >> 2)];
-
   __m128i luma_shufflemask_lo = _mm_set_epi8(-1, -1, -1, 3, -1, -1, -1, 2, -1, -1, -1, 1, -1, -1, -1, 0);
   __m128i luma_shufflemask_hi = _mm_set_epi8(-1, -1, -1, 7, -1, -1, -1, 6, -1, -1, -1, 5, -1, -1, -1, 4);
   __m128i chroma_shufflemask_lo = _mm_set_epi8(-1, -1, -1, 1, -1, -1, -1, 1, -1, -1, -1, 0, -1, -1, -1, 0);
@@ -153,9 +220,10 @@ int yuv2rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t hei
   for (uint32_t i = 0; i < width*height; i += 16) {
     uint8_t *out = output + 4*i;
 
-    int8_t row = i%(width*2) >= width ? 1 : 0;
+    uint32_t y = i/width;
+    uint32_t x = i%width;
 
-    uint8_t *in_y = in_y_base + i;
+    const uint8_t *in_y = in_y_base + y*y_stride + x;
 
     // Load 16 bytes (16 luma pixels)
     __m128i y_a = _mm_loadu_si128((__m128i const*) in_y);
@@ -167,10 +235,9 @@ int yuv2rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t hei
 
     __m128i u_a, v_a;
 
-    int32_t temp = row?width/4:0;
-    uint8_t *in_u = in_u_base + ((i - i%width)/4) + (i%width)/2 - temp;
+    const uint8_t *in_u = in_u_base + y/2*u_stride + x/2;
     u_a = _mm_loadl_epi64((__m128i const*) in_u);
-    uint8_t *in_v = in_v_base + ((i - i%width)/4) + (i%width)/2 - temp;
+    const uint8_t *in_v = in_v_base + y/2*v_stride + x/2;
     v_a = _mm_loadl_epi64((__m128i const*) in_v);
 
     __m128i chroma_u_lo = _mm_shuffle_epi8(u_a, chroma_shufflemask_lo);
@@ -226,8 +293,17 @@ int yuv2rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t hei
   return 1;
 }
 
+YUV2RGB_TARGET("avx2")
+inline int yuv2rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height, uint8_t threads)
+{
+  return yuv2rgb_i_avx2(input, width, input + width*height, width/2,
+                        input + width*height*5/4, width/2, output, width, height, threads);
+}
 
-int yuv2rgb_i_avx2_single(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+
+YUV2RGB_TARGET("avx2")
+inline int yuv2rgb_i_avx2_single(const uint8_t* in_y, int y_stride, const uint8_t* in_u, int u_stride,
+                                 const uint8_t* in_v, int v_stride, uint8_t* output, uint16_t width, uint16_t height)
 {
   const int mini[8] = { 0,0,0,0,0,0,0,0 };
   const int middle[8] = { 128, 128, 128, 128,128, 128, 128, 128 };
@@ -247,9 +323,6 @@ int yuv2rgb_i_avx2_single(uint8_t* input, uint8_t* output, uint16_t width, uint1
   uint8_t *row_b = (uint8_t*)ALIGNED_POINTER(row_b_temp, SIMD_ALIGNMENT);
 
 
-  uint8_t *in_y = &input[0];
-  uint8_t *in_u = &input[width*height];
-  uint8_t *in_v = &input[width*height + (width*height >> 2)];
   uint8_t *out = output;
 
   int8_t row = 0;
@@ -355,6 +428,12 @@ int yuv2rgb_i_avx2_single(uint8_t* input, uint8_t* output, uint16_t width, uint1
     // Track rows for chroma
     pix += 16;
     if (pix == width) {
+      // skip the padding at the end of the rows
+      in_y += y_stride - width;
+      if (!row) {
+        in_u += u_stride - width/2;
+        in_v += v_stride - width/2;
+      }
       row = !row;
       pix = 0;
     }
@@ -366,3 +445,10 @@ int yuv2rgb_i_avx2_single(uint8_t* input, uint8_t* output, uint16_t width, uint1
   return 1;
 }
 
+YUV2RGB_TARGET("avx2")
+inline int yuv2rgb_i_avx2_single(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  return yuv2rgb_i_avx2_single(input, width, input + width*height, width/2,
+                               input + width*height*5/4, width/2, output, width, height);
+}
+
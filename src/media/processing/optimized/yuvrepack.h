@@ -0,0 +1,123 @@
+#pragma once
+
+#include <emmintrin.h>
+#include <stdint.h>
+#include <cstring>
+
+// Repacking of the YUV formats offered by cameras to the planar I420 used by
+// the encoder. Only the memory layout changes so no colour conversion is
+// needed. The source rows may have padding at the end (stride) and the output
+// is cropped to width x height, which must both be even.
+
+
+// copies one plane row by row leaving out the padding
+inline void copy_plane(const uint8_t* input, int stride, uint8_t* output, int width, int height)
+{
+  for (int y = 0; y < height; ++y)
+  {
+    memcpy(output + y*width, input + y*stride, width);
+  }
+}
+
+
+// splits interleaved UVUV... to separate U and V rows
+inline void split_uv_row_sse2(const uint8_t* uv, uint8_t* u, uint8_t* v, int chromaWidth)
+{
+  const __m128i low_mask = _mm_set1_epi16(0x00FF);
+
+  int x = 0;
+  for (; x + 16 <= chromaWidth; x += 16)
+  {
+    __m128i uv0 = _mm_loadu_si128((__m128i const*)(uv + 2*x));
+    __m128i uv1 = _mm_loadu_si128((__m128i const*)(uv + 2*x + 16));
+
+    __m128i u_16 = _mm_packus_epi16(_mm_and_si128(uv0, low_mask), _mm_and_si128(uv1, low_mask));
+    __m128i v_16 = _mm_packus_epi16(_mm_srli_epi16(uv0, 8), _mm_srli_epi16(uv1, 8));
+
+    _mm_storeu_si128((__m128i*)(u + x), u_16);
+    _mm_storeu_si128((__m128i*)(v + x), v_16);
+  }
+
+  for (; x < chromaWidth; ++x)
+  {
+    u[x] = uv[2*x];
+    v[x] = uv[2*x + 1];
+  }
+}
+
+
+// NV12: Y plane followed by a half resolution plane of interleaved U and V
+inline void nv12_to_i420_sse2(const uint8_t* in_y, int y_stride,
+                              const uint8_t* in_uv, int uv_stride,
+                              uint8_t* output, int width, int height)
+{
+  copy_plane(in_y, y_stride, output, width, height);
+
+  uint8_t* out_u = output + width*height;
+  uint8_t* out_v = out_u + width*height/4;
+
+  for (int y = 0; y < height/2; ++y)
+  {
+    split_uv_row_sse2(in_uv + y*uv_stride, out_u + y*width/2, out_v + y*width/2, width/2);
+  }
+}
+
+
+// YUYV (YUY2): packed 4:2:2 with Y0 U0 Y1 V0 for each two pixels. The chroma
+// of two rows is averaged to get 4:2:0.
+inline void yuyv_to_i420_sse2(const uint8_t* input, int stride,
+                              uint8_t* output, int width, int height)
+{
+  const __m128i low_mask = _mm_set1_epi16(0x00FF);
+
+  uint8_t* out_y = output;
+  uint8_t* out_u = output + width*height;
+  uint8_t* out_v = out_u + width*height/4;
+
+  for (int y = 0; y < height; y += 2)
+  {
+    const uint8_t* row0 = input + y*stride;
+    const uint8_t* row1 = row0 + stride;
+
+    uint8_t* y0 = out_y + y*width;
+    uint8_t* y1 = y0 + width;
+    uint8_t* u = out_u + y/2*width/2;
+    uint8_t* v = out_v + y/2*width/2;
+
+    // 16 pixels per round
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+      __m128i a0 = _mm_loadu_si128((__m128i const*)(row0 + 2*x));
+      __m128i b0 = _mm_loadu_si128((__m128i const*)(row0 + 2*x + 16));
+      __m128i a1 = _mm_loadu_si128((__m128i const*)(row1 + 2*x));
+      __m128i b1 = _mm_loadu_si128((__m128i const*)(row1 + 2*x + 16));
+
+      _mm_storeu_si128((__m128i*)(y0 + x),
+                       _mm_packus_epi16(_mm_and_si128(a0, low_mask), _mm_and_si128(b0, low_mask)));
+      _mm_storeu_si128((__m128i*)(y1 + x),
+                       _mm_packus_epi16(_mm_and_si128(a1, low_mask), _mm_and_si128(b1, low_mask)));
+
+      // UVUV... of both rows, then averaged
+      __m128i uv0 = _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(b0, 8));
+      __m128i uv1 = _mm_packus_epi16(_mm_srli_epi16(a1, 8), _mm_srli_epi16(b1, 8));
+      __m128i uv = _mm_avg_epu8(uv0, uv1);
+
+      __m128i u_16 = _mm_packus_epi16(_mm_and_si128(uv, low_mask), _mm_setzero_si128());
+      __m128i v_16 = _mm_packus_epi16(_mm_srli_epi16(uv, 8), _mm_setzero_si128());
+
+      _mm_storel_epi64((__m128i*)(u + x/2), u_16);
+      _mm_storel_epi64((__m128i*)(v + x/2), v_16);
+    }
+
+    for (; x < width; x += 2)
+    {
+      y0[x]     = row0[2*x];
+      y0[x + 1] = row0[2*x + 2];
+      y1[x]     = row1[2*x];
+      y1[x + 1] = row1[2*x + 2];
+      u[x/2] = (row0[2*x + 1] + row1[2*x + 1] + 1) >> 1;
+      v[x/2] = (row0[2*x + 3] + row1[2*x + 3] + 1) >> 1;
+    }
+  }
+}
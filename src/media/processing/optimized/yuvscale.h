@@ -0,0 +1,118 @@
+#pragma once
+
+#include <emmintrin.h>
+#include <stdint.h>
+
+// Downscaling of planar I420 pictures to half width and height by averaging
+// each 2x2 block. Used to create the lower resolution layers of simulcast.
+// The output size is rounded down to even so it is still valid I420.
+
+
+// the size of a picture dimension after halving it times
+inline int halved_size(int size, int times)
+{
+  return (size >> times) & ~1;
+}
+
+
+// averages the 2x2 blocks of rows 2y and 2y + 1 for out_width output pixels
+inline void halve_row_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* out, int out_width)
+{
+  for (int x = 0; x < out_width; ++x)
+  {
+    out[x] = (row0[2*x] + row0[2*x + 1] + row1[2*x] + row1[2*x + 1] + 2) >> 2;
+  }
+}
+
+
+inline void halve_row_sse2(const uint8_t* row0, const uint8_t* row1, uint8_t* out, int out_width)
+{
+  const __m128i low_mask = _mm_set1_epi16(0x00FF);
+  const __m128i rounding = _mm_set1_epi16(2);
+
+  // 16 output pixels per round
+  int x = 0;
+  for (; x + 16 <= out_width; x += 16)
+  {
+    __m128i a0 = _mm_loadu_si128((__m128i const*)(row0 + 2*x));
+    __m128i b0 = _mm_loadu_si128((__m128i const*)(row0 + 2*x + 16));
+    __m128i a1 = _mm_loadu_si128((__m128i const*)(row1 + 2*x));
+    __m128i b1 = _mm_loadu_si128((__m128i const*)(row1 + 2*x + 16));
+
+    // horizontal pairs as 16-bit sums, then the two rows together
+    __m128i sum_a = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, low_mask), _mm_srli_epi16(a0, 8)),
+                                  _mm_add_epi16(_mm_and_si128(a1, low_mask), _mm_srli_epi16(a1, 8)));
+    __m128i sum_b = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(b0, low_mask), _mm_srli_epi16(b0, 8)),
+                                  _mm_add_epi16(_mm_and_si128(b1, low_mask), _mm_srli_epi16(b1, 8)));
+
+    sum_a = _mm_srli_epi16(_mm_add_epi16(sum_a, rounding), 2);
+    sum_b = _mm_srli_epi16(_mm_add_epi16(sum_b, rounding), 2);
+
+    _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(sum_a, sum_b));
+  }
+
+  halve_row_scalar(row0 + 2*x, row1 + 2*x, out + x, out_width - x);
+}
+
+
+// halves one plane. The input must have at least 2*out_width columns and
+// 2*out_height rows.
+inline void halve_plane(const uint8_t* input, int in_stride,
+                        uint8_t* output, int out_width, int out_height, bool simd)
+{
+  for (int y = 0; y < out_height; ++y)
+  {
+    const uint8_t* row0 = input + 2*y*in_stride;
+    const uint8_t* row1 = row0 + in_stride;
+
+    if (simd)
+    {
+      halve_row_sse2(row0, row1, output + y*out_width, out_width);
+    }
+    else
+    {
+      halve_row_scalar(row0, row1, output + y*out_width, out_width);
+    }
+  }
+}
+
+
+// Halves an I420 picture of width x height to halved_size(width, 1) x
+// halved_size(height, 1). The input planes may have a row pitch larger than
+// their width, the output is packed.
+inline void halve_yuv420(const uint8_t* in_y, int y_stride, const uint8_t* in_u, int u_stride,
+                         const uint8_t* in_v, int v_stride, int width, int height,
+                         uint8_t* output, bool simd)
+{
+  int out_width = halved_size(width, 1);
+  int out_height = halved_size(height, 1);
+
+  uint8_t* out_u = output + out_width*out_height;
+  uint8_t* out_v = out_u + out_width*out_height/4;
+
+  halve_plane(in_y, y_stride, output, out_width, out_height, simd);
+  halve_plane(in_u, u_stride, out_u, out_width/2, out_height/2, simd);
+  halve_plane(in_v, v_stride, out_v, out_width/2, out_height/2, simd);
+}
+
+
+// halves a packed I420 picture
+inline void halve_yuv420(const uint8_t* input, int width, int height, uint8_t* output, bool simd)
+{
+  const uint8_t* in_u = input + width*height;
+  const uint8_t* in_v = in_u + width*height/4;
+
+  halve_yuv420(input, width, in_u, width/2, in_v, width/2, width, height, output, simd);
+}
+
+
+inline void halve_yuv420_scalar(const uint8_t* input, uint8_t* output, int width, int height)
+{
+  halve_yuv420(input, width, height, output, false);
+}
+
+
+inline void halve_yuv420_sse2(const uint8_t* input, uint8_t* output, int width, int height)
+{
+  halve_yuv420(input, width, height, output, true);
+}
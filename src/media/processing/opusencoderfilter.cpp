@@ -5,17 +5,27 @@
 #include "common.h"
 #include "global.h"
 
-#include <QDateTime>
 #include <QSettings>
 
+// With DTX the encoder gives packets of this size or smaller during silence.
+// They need not be sent, the receiver conceals the gap.
+const opus_int32 DTX_PACKET_SIZE = 2;
 
-OpusEncoderFilter::OpusEncoderFilter(QString id, QAudioFormat format, StatisticsInterface* stats):
+
+OpusEncoderFilter::OpusEncoderFilter(QString id, QAudioFormat format, uint16_t frameDuration,
+                                     StatisticsInterface* stats):
   Filter(id, "Opus Encoder", stats, RAWAUDIO, OPUSAUDIO),
   enc_(nullptr),
   opusOutput_(nullptr),
   max_data_bytes_(65536),
   format_(format),
-  samplesPerFrame_(0)
+  frameDuration_(frameDuration),
+  samplesPerFrame_(0),
+  droppedFrameSize_(0),
+  targetBitrate_(0),
+  appliedBitrate_(0),
+  packetLoss_(0),
+  appliedPacketLoss_(0)
 {
   opusOutput_ = new uchar[max_data_bytes_];
 }
@@ -42,7 +52,7 @@ bool OpusEncoderFilter::init()
     return false;
   }
 
-  samplesPerFrame_ = format_.sampleRate()/AUDIO_FRAMES_PER_SECOND;
+  samplesPerFrame_ = format_.sampleRate()*frameDuration_/1000;
 
   updateSettings();
 
@@ -59,8 +69,20 @@ void OpusEncoderFilter::updateSettings()
   QString type = settings.value("audio/signalType").toString();
 
   opus_encoder_ctl(enc_, OPUS_SET_BITRATE(bitrate));
+  targetBitrate_ = bitrate;
+  appliedBitrate_ = bitrate;
+
   opus_encoder_ctl(enc_, OPUS_SET_COMPLEXITY(complexity));
 
+  // The next packet carries a low bitrate copy of this one, which the decoder
+  // uses if this packet is lost. Opus spends bits on it according to the
+  // expected packet loss, so it costs nothing on a clean network.
+  opus_encoder_ctl(enc_, OPUS_SET_INBAND_FEC(1));
+  opus_encoder_ctl(enc_, OPUS_SET_PACKET_LOSS_PERC(appliedPacketLoss_));
+
+  // nothing is sent during silence
+  opus_encoder_ctl(enc_, OPUS_SET_DTX(1));
+
   if (type == "Auto")
   {
     opus_encoder_ctl(enc_, OPUS_SET_SIGNAL(OPUS_AUTO));
@@ -82,19 +104,65 @@ void OpusEncoderFilter::updateSettings()
 }
 
 
+void OpusEncoderFilter::setTargetBitrate(uint32_t bitrate)
+{
+  targetBitrate_ = bitrate;
+}
+
+
+void OpusEncoderFilter::setPacketLoss(uint8_t percent)
+{
+  packetLoss_ = qMin(percent, (uint8_t)100);
+}
+
+
+void OpusEncoderFilter::setFrameDuration(uint16_t frameDuration)
+{
+  frameDuration_ = frameDuration;
+}
+
+
 void OpusEncoderFilter::process()
 {
+  // the encoder is only used from this thread
+  uint32_t bitrate = targetBitrate_;
+  if (bitrate != appliedBitrate_)
+  {
+    opus_encoder_ctl(enc_, OPUS_SET_BITRATE(bitrate));
+    appliedBitrate_ = bitrate;
+  }
+
+  uint8_t packetLoss = packetLoss_;
+  if (packetLoss != appliedPacketLoss_)
+  {
+    opus_encoder_ctl(enc_, OPUS_SET_PACKET_LOSS_PERC(packetLoss));
+    appliedPacketLoss_ = packetLoss;
+  }
+
+  // Opus takes any of the supported frame durations without reinitialization
+  samplesPerFrame_ = format_.sampleRate()*frameDuration_/1000;
+
   std::unique_ptr<Data> input = getInput();
 
   while(input)
   {
     // The audiocapturefilter makes sure the frames are the correct (samplesPerFrame_) size.
+    // Frames captured before a frame duration change are dropped.
     if (input->data_size != samplesPerFrame_*format_.bytesPerFrame())
     {
-      printProgramError(this, "Wrong size of input frame");
-      return;
+      if (input->data_size != droppedFrameSize_)
+      {
+        printDebug(DEBUG_WARNING, this, "Dropping input frames of wrong size",
+                   {"Size", "Expected"}, {QString::number(input->data_size),
+                    QString::number(samplesPerFrame_*format_.bytesPerFrame())});
+        droppedFrameSize_ = input->data_size;
+      }
+      input = getInput();
+      continue;
     }
 
+    droppedFrameSize_ = 0;
+
     opus_int32 len = 0; // encoded frame size
     uint32_t pos = 0; // output position
 
@@ -109,9 +177,15 @@ void OpusEncoderFilter::process()
       break;
     }
 
+    if (len <= DTX_PACKET_SIZE)
+    {
+      input = getInput();
+      continue;
+    }
+
     std::unique_ptr<Data> u_copy(shallowDataCopy(input.get()));
 
-    std::unique_ptr<uchar[]> opus_frame(new uchar[len]);
+    FrameBuffer opus_frame = allocateBuffer(len);
     memcpy(opus_frame.get(), opusOutput_ + pos, len);
     u_copy->data_size = len;
 
@@ -126,9 +200,6 @@ void OpusEncoderFilter::process()
 
     if(len > 0)
     {
-      uint32_t delay = QDateTime::currentMSecsSinceEpoch() - input->presentationTime;
-
-      getStats()->sendDelay("audio", delay);
       getStats()->addEncodedPacket("audio", len);
     }
     else
@@ -4,14 +4,34 @@
 #include <opus.h>
 #include <QAudioFormat>
 
+#include <atomic>
+
 class OpusEncoderFilter : public Filter
 {
 public:
-  OpusEncoderFilter(QString id, QAudioFormat format, StatisticsInterface* stats);
+  OpusEncoderFilter(QString id, QAudioFormat format, uint16_t frameDuration,
+                    StatisticsInterface* stats);
   ~OpusEncoderFilter();
 
   virtual void updateSettings();
 
+  // Overrides the bitrate in settings until the next updateSettings.
+  // Taken into use with the next frame.
+  void setTargetBitrate(uint32_t bitrate);
+
+  // The packet loss our peers report in percent. The encoder adds more
+  // redundancy for the in-band FEC with higher loss.
+  void setPacketLoss(uint8_t percent);
+
+  // Length of the encoded frames in milliseconds. Taken into use with the
+  // next frame.
+  void setFrameDuration(uint16_t frameDuration);
+
+  virtual uint32_t inputSampleRate() const
+  {
+    return format_.sampleRate();
+  }
+
   bool init();
 
 protected:
@@ -25,5 +45,16 @@ private:
 
   QAudioFormat format_;
 
+  std::atomic<uint16_t> frameDuration_;
   uint32_t samplesPerFrame_;
+
+  // size of the last dropped frame so a duration change is only warned once
+  uint32_t droppedFrameSize_;
+
+  // the bitrate requested by congestion control and the one in use
+  std::atomic<uint32_t> targetBitrate_;
+  uint32_t appliedBitrate_;
+
+  std::atomic<uint8_t> packetLoss_;
+  uint8_t appliedPacketLoss_;
 };
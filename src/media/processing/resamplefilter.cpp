@@ -0,0 +1,71 @@
+#include "resamplefilter.h"
+
+#include "common.h"
+
+
+ResampleFilter::ResampleFilter(QString id, StatisticsInterface* stats,
+                               uint32_t inputRate, uint32_t outputRate):
+  Filter(id, "Resample", stats, RAWAUDIO, RAWAUDIO),
+  inputRate_(inputRate),
+  outputRate_(outputRate),
+  resampler_(inputRate, outputRate),
+  pending_()
+{}
+
+
+bool ResampleFilter::init()
+{
+  if (!resampler_.isValid())
+  {
+    printWarning(this, "Could not create a resampler for these sample rates",
+                 {"Rates"}, {QString::number(inputRate_) + " -> " + QString::number(outputRate_)});
+    return false;
+  }
+
+  return Filter::init();
+}
+
+
+void ResampleFilter::process()
+{
+  std::unique_ptr<Data> input = getInput();
+
+  while(input)
+  {
+    unsigned int inputSamples = input->data_size/sizeof(int16_t);
+
+    // The resampler may give a sample more or less than the exact ratio, so
+    // the frames are cut from the pending samples to keep their size constant.
+    unsigned int frameSamples = (uint64_t)inputSamples*outputRate_/inputRate_;
+    unsigned int previous = pending_.size();
+
+    pending_.resize(previous + resampler_.maxOutput(inputSamples));
+    unsigned int resampled = resampler_.process((const int16_t*)input->data.get(),
+                                                inputSamples, pending_.data() + previous);
+    pending_.resize(previous + resampled);
+
+    // the pending samples were recorded before this frame
+    int64_t presentationTime = input->presentationTime - (int64_t)previous*1000/outputRate_;
+
+    unsigned int position = 0;
+    while (frameSamples != 0 && pending_.size() - position >= frameSamples)
+    {
+      uint32_t size = frameSamples*sizeof(int16_t);
+
+      std::unique_ptr<Data> output(shallowDataCopy(input.get()));
+      output->data = allocateBuffer(size);
+      output->data_size = size;
+      output->framerate = outputRate_;
+      output->presentationTime = presentationTime + (int64_t)position*1000/outputRate_;
+
+      memcpy(output->data.get(), pending_.data() + position, size);
+      position += frameSamples;
+
+      sendOutput(std::move(output));
+    }
+
+    pending_.erase(pending_.begin(), pending_.begin() + position);
+
+    input = getInput();
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "filter.h"
+
+#include "audioresampler.h"
+
+#include <vector>
+
+// Converts raw audio between two sample rates, for example from a microphone
+// that only records 44.1 kHz to the 48 kHz of Opus. The output frames have
+// the same duration as the input frames. FilterGraph adds this filter when
+// the sample rates of two connected filters differ.
+
+class ResampleFilter : public Filter
+{
+public:
+  ResampleFilter(QString id, StatisticsInterface* stats,
+                 uint32_t inputRate, uint32_t outputRate);
+
+  virtual bool init();
+
+  virtual uint32_t inputSampleRate() const
+  {
+    return inputRate_;
+  }
+
+  virtual uint32_t outputSampleRate() const
+  {
+    return outputRate_;
+  }
+
+protected:
+
+  void process();
+
+private:
+
+  uint32_t inputRate_;
+  uint32_t outputRate_;
+
+  AudioResampler resampler_;
+
+  // resampled audio waiting for a whole frame
+  std::vector<int16_t> pending_;
+};
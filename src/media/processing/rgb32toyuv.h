@@ -1,6 +1,8 @@
 #pragma once
 #include "filter.h"
 
+#include "optimized/cpufeatures.h"
+
 // converts the RGB32 video frame to and YUV420 frame. May use optimizations.
 
 
@@ -18,7 +20,8 @@ protected:
 
 private:
 
-  bool sse_;
+  // best instruction set supported by this CPU
+  SIMDLevel simd_;
 
   int threadCount_;
 };
@@ -69,10 +69,11 @@ std::unique_ptr<Data> ScaleFilter::scaleFrame(std::unique_ptr<Data> input)
         QImage::Format_RGB32);
 
   QImage scaled = image.scaled(newSize_);
+  // the input buffer can be reused if it is large enough and nobody else reads it
   if(newSize_.width() * newSize_.height()
-     > input->width * input->height)
+     > input->width * input->height || input->data.isShared())
   {
-    input->data = std::unique_ptr<uchar[]>(new uchar[scaled.sizeInBytes()]);
+    input->data = allocateBuffer(scaled.sizeInBytes());
   }
   memcpy(input->data.get(), scaled.bits(), scaled.sizeInBytes());
   input->width = newSize_.width();
@@ -28,6 +28,11 @@ void ScreenShareFilter::process()
   if (!screen)
       return;
 
+  if (skipFrame())
+  {
+    return;
+  }
+
 
   QPixmap screenCapture = screen->grabWindow(0);
   QImage image = screenCapture.toImage();
@@ -37,7 +42,7 @@ void ScreenShareFilter::process()
 
   newImage->presentationTime = QDateTime::currentMSecsSinceEpoch();
   newImage->type = output_;
-  newImage->data = std::unique_ptr<uchar[]>(new uchar[image.sizeInBytes()]);
+  newImage->data = allocateBuffer(image.sizeInBytes());
 
   image = image.mirrored(false, true);
   uchar *bits = image.bits();
@@ -49,6 +54,11 @@ void ScreenShareFilter::process()
   newImage->width = screen->size().width() - screen->size().width()%8;
   newImage->height = screen->size().height() - screen->size().height()%8;
   newImage->source = LOCAL;
+  newImage->layer = 0;
+  newImage->stride[0] = 0;
+  newImage->stride[1] = 0;
+  newImage->stride[2] = 0;
+  newImage->sequenceNumber = 0;
   newImage->framerate = FRAMERATE;
 
   std::unique_ptr<Data> u_newImage( newImage );
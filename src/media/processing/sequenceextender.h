@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Extends 16-bit RTP sequence numbers to 32 bits so that the order of the
+// packets survives the wraparound. Each number is placed within half the
+// sequence space of the highest one seen. The first number is offset by one
+// wraparound so that packets older than it do not go below zero.
+
+class SequenceExtender
+{
+public:
+  SequenceExtender():
+    known_(false),
+    highest_(0)
+  {}
+
+  uint32_t extend(uint16_t sequence)
+  {
+    if (!known_)
+    {
+      known_ = true;
+      highest_ = sequence + 0x10000;
+      return highest_;
+    }
+
+    uint32_t extended = highest_ + (int16_t)(sequence - (uint16_t)highest_);
+
+    // a reordered packet does not move the highest number back
+    if (extended > highest_)
+    {
+      highest_ = extended;
+    }
+
+    return extended;
+  }
+
+  uint32_t highest() const
+  {
+    return highest_;
+  }
+
+private:
+
+  bool known_;
+  uint32_t highest_;
+};
@@ -31,7 +31,7 @@ public:
   virtual void outgoingMedia(uint32_t sessionID, QString name, QStringList& ipList,
                              QStringList& audioPorts, QStringList& videoPorts) = 0;
 
-  // the delay it takes from input to the point when input is encoded
+  // the delay from capture to the point when the frame is handed to RTP
   virtual void sendDelay(QString type, uint32_t delay) = 0;
 
   // the delay until the presentation of the packet
@@ -40,6 +40,16 @@ public:
   // one packet has been presented to user
   virtual void presentPackage(uint32_t sessionID, QString type) = 0;
 
+  // Frame pacing of the video view: frames dropped and repeated so far and
+  // the current jitter buffer delay in milliseconds.
+  virtual void updatePresentation(uint32_t sessionID, uint32_t dropped,
+                                  uint32_t repeated, uint16_t bufferDelay) = 0;
+
+  // Audio jitter buffer: buffered and target delay in milliseconds, frames
+  // concealed so far and frames discarded for being late or excess.
+  virtual void updateAudioBuffer(uint32_t sessionID, uint16_t depth, uint16_t targetDelay,
+                                 uint32_t concealed, uint32_t discarded) = 0;
+
   // For tracking of encoding bitrate and possibly other information.
   virtual void addEncodedPacket(QString type, uint32_t size) = 0;
 
@@ -52,6 +62,11 @@ public:
   // tracking of received packets.
   virtual void addReceivePacket(uint32_t sessionID, QString type, uint16_t size) = 0;
 
+  // Send bitrate estimated from the receiver reports. Loss is the worst
+  // reported fraction and RTT is in milliseconds or -1 if not known.
+  virtual void updateCongestionControl(uint32_t estimate, uint32_t videoBitrate,
+                                       uint32_t audioBitrate, float loss, int32_t rtt) = 0;
+
 
   // FILTER
   // tell the that we want to track this filter or stop tracking
@@ -65,6 +80,12 @@ public:
   // Tracking of packets dropped due to buffer overflow
   virtual void packetDropped(uint32_t id) = 0;
 
+  // Tracking of how well the frame buffer pool of a filter reuses its memory
+  virtual void updateBufferPool(uint32_t id, uint32_t hits, uint32_t misses) = 0;
+
+  // Tracking of processing time. Usage is the percentage of one core.
+  virtual void updateCPUUsage(uint32_t id, uint16_t usage) = 0;
+
 
   // SIP
   // Tracking of sent and received SIP Messages
@@ -0,0 +1,85 @@
+#include "presentationscheduler.h"
+
+#include "videodrawhelper.h"
+
+#include "common.h"
+
+#include <QDateTime>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QWidget>
+
+// used if the refresh rate of the screen is not known
+const qreal DEFAULT_REFRESH_RATE = 60.0;
+
+
+PresentationScheduler& PresentationScheduler::instance()
+{
+  static PresentationScheduler scheduler;
+  return scheduler;
+}
+
+
+PresentationScheduler::PresentationScheduler():
+  views_(),
+  timer_()
+{
+  qreal refreshRate = DEFAULT_REFRESH_RATE;
+
+  QScreen* screen = QGuiApplication::primaryScreen();
+  if (screen != nullptr && screen->refreshRate() > 1.0)
+  {
+    refreshRate = screen->refreshRate();
+  }
+
+  printDebug(DEBUG_NORMAL, "PresentationScheduler", "Presenting video at the screen refresh rate",
+             {"Refresh rate"}, {QString::number(refreshRate)});
+
+  timer_.setTimerType(Qt::PreciseTimer);
+  timer_.setInterval(qMax(1, qRound(1000.0/refreshRate)));
+  connect(&timer_, &QTimer::timeout, this, &PresentationScheduler::refresh);
+}
+
+
+void PresentationScheduler::addView(VideoDrawHelper* helper, QWidget* widget)
+{
+  views_.push_back({helper, widget});
+
+  if (!timer_.isActive())
+  {
+    timer_.start();
+  }
+}
+
+
+void PresentationScheduler::removeView(VideoDrawHelper* helper)
+{
+  for (auto view = views_.begin(); view != views_.end(); ++view)
+  {
+    if (view->helper == helper)
+    {
+      views_.erase(view);
+      break;
+    }
+  }
+
+  if (views_.empty())
+  {
+    timer_.stop();
+  }
+}
+
+
+void PresentationScheduler::refresh()
+{
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+  // update() only marks the widget, Qt paints all of them in the same pass
+  for (View& view : views_)
+  {
+    if (view.helper->present(now))
+    {
+      view.widget->update();
+    }
+  }
+}
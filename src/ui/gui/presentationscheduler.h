@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+
+#include <vector>
+
+// Decides when the video views show their frames. All views are checked once
+// per display refresh and the ones with a frame due are updated together, so
+// all the views of the conference are painted in one pass per refresh instead
+// of repainting each view whenever a frame arrives. The timer follows the
+// refresh rate of the screen and the OpenGL views wait for vsync when
+// swapping.
+
+class QWidget;
+class VideoDrawHelper;
+
+class PresentationScheduler : public QObject
+{
+  Q_OBJECT
+public:
+  // shared by all the views. Must be used from the GUI thread.
+  static PresentationScheduler& instance();
+
+  void addView(VideoDrawHelper* helper, QWidget* widget);
+  void removeView(VideoDrawHelper* helper);
+
+private slots:
+
+  void refresh();
+
+private:
+  PresentationScheduler();
+
+  struct View
+  {
+    VideoDrawHelper* helper;
+    QWidget* widget;
+  };
+
+  std::vector<View> views_;
+
+  QTimer timer_;
+};
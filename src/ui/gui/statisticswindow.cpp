@@ -44,11 +44,16 @@ StatisticsInterface(),
   transferredData_(0),
   receivePacketCount_(0),
   receivedData_(0),
+  congestionState_("-"),
+  presentation_(),
+  presentationState_("-"),
+  audioBuffers_(),
+  audioBufferState_("-"),
   packetsDropped_(0),
-  videoEncDelayIndex_(0),
-  videoEncDelay_(BUFFERSIZE,nullptr),
-  audioEncDelayIndex_(0),
-  audioEncDelay_(BUFFERSIZE,nullptr),
+  videoSendDelayIndex_(0),
+  videoSendDelay_(BUFFERSIZE,nullptr),
+  audioSendDelayIndex_(0),
+  audioSendDelay_(BUFFERSIZE,nullptr),
   guiTimer_(),
   guiUpdates_(0),
   lastTabIndex_(254) // an invalid value so we will update the tab immediately
@@ -89,7 +94,7 @@ StatisticsInterface(),
   fillTableHeaders(ui_->table_incoming, sessionMutex_,
                           {"IP", "Audio Ports", "Video Ports"});
   fillTableHeaders(ui_->filterTable, filterMutex_,
-                          {"Filter", "Info", "TID", "Buffer Size", "Dropped"});
+                          {"Filter", "Info", "TID", "Buffer Size", "Dropped", "Pool Hit/Miss", "CPU %"});
   fillTableHeaders(ui_->sent_list, sipMutex_,
                           {"Type", "Destination"});
   fillTableHeaders(ui_->received_list, sipMutex_,
@@ -254,7 +259,7 @@ uint32_t StatisticsWindow::addFilter(QString type, QString identifier, uint64_t
   threadID = threadID.rightJustified(5, '0');
 
   int rowIndex = addTableRow(ui_->filterTable, filterMutex_,
-                                  {type, identifier, threadID, "-/-", "0"});
+                                  {type, identifier, threadID, "-/-", "0", "-/-", "0"});
 
   filterMutex_.lock();
   uint32_t id = nextFilterID_;
@@ -263,7 +268,7 @@ uint32_t StatisticsWindow::addFilter(QString type, QString identifier, uint64_t
   {
     nextFilterID_ = 10;
   }
-  buffers_[id] = FilterStatus{0,QString::number(TID), 0, 0, rowIndex};
+  buffers_[id] = FilterStatus{0,QString::number(TID), 0, 0, 0, 0, 0, rowIndex};
   filterMutex_.unlock();
 
   return id;
@@ -364,13 +369,13 @@ void StatisticsWindow::sendDelay(QString type, uint32_t delay)
 {
   if(type == "video" || type == "Video")
   {
-    updateValueBuffer(videoEncDelay_,
-                      videoEncDelayIndex_, delay);
+    updateValueBuffer(videoSendDelay_,
+                      videoSendDelayIndex_, delay);
   }
   else if(type == "audio" || type == "Audio")
   {
-    updateValueBuffer(audioEncDelay_,
-                      audioEncDelayIndex_, delay);
+    updateValueBuffer(audioSendDelay_,
+                      audioSendDelayIndex_, delay);
   }
 }
 
@@ -412,6 +417,54 @@ void StatisticsWindow::presentPackage(uint32_t sessionID, QString type)
 }
 
 
+void StatisticsWindow::updatePresentation(uint32_t sessionID, uint32_t dropped,
+                                          uint32_t repeated, uint16_t bufferDelay)
+{
+  deliveryMutex_.lock();
+  presentation_[sessionID] = {dropped, repeated, bufferDelay};
+
+  uint32_t totalDropped = 0;
+  uint32_t totalRepeated = 0;
+  uint16_t maxDelay = 0;
+  for (auto& view : presentation_)
+  {
+    totalDropped += view.second.dropped;
+    totalRepeated += view.second.repeated;
+    maxDelay = qMax(maxDelay, view.second.bufferDelay);
+  }
+
+  presentationState_ = "dropped " + QString::number(totalDropped) + ", repeated " +
+      QString::number(totalRepeated) + ", buffer " + QString::number(maxDelay) + " ms";
+  deliveryMutex_.unlock();
+}
+
+
+void StatisticsWindow::updateAudioBuffer(uint32_t sessionID, uint16_t depth,
+                                         uint16_t targetDelay, uint32_t concealed,
+                                         uint32_t discarded)
+{
+  deliveryMutex_.lock();
+  audioBuffers_[sessionID] = {depth, targetDelay, concealed, discarded};
+
+  uint16_t maxDepth = 0;
+  uint16_t maxTarget = 0;
+  uint32_t totalConcealed = 0;
+  uint32_t totalDiscarded = 0;
+  for (auto& buffer : audioBuffers_)
+  {
+    maxDepth = qMax(maxDepth, buffer.second.depth);
+    maxTarget = qMax(maxTarget, buffer.second.targetDelay);
+    totalConcealed += buffer.second.concealed;
+    totalDiscarded += buffer.second.discarded;
+  }
+
+  audioBufferState_ = QString::number(maxDepth) + " / " + QString::number(maxTarget) +
+      " ms, concealed " + QString::number(totalConcealed) + ", discarded " +
+      QString::number(totalDiscarded);
+  deliveryMutex_.unlock();
+}
+
+
 void StatisticsWindow::addEncodedPacket(QString type, uint32_t size)
 {
   if(type == "video" || type == "Video")
@@ -519,6 +572,24 @@ void StatisticsWindow::addSendPacket(uint16_t size)
 }
 
 
+void StatisticsWindow::updateCongestionControl(uint32_t estimate, uint32_t videoBitrate,
+                                               uint32_t audioBitrate, float loss, int32_t rtt)
+{
+  QString state = QString::number(estimate/1000) + " kbit/s (video " +
+      QString::number(videoBitrate/1000) + ", audio " + QString::number(audioBitrate/1000) +
+      "), loss " + QString::number(loss*100, 'f', 1) + " %";
+
+  if (rtt != -1)
+  {
+    state += ", RTT " + QString::number(rtt) + " ms";
+  }
+
+  deliveryMutex_.lock();
+  congestionState_ = state;
+  deliveryMutex_.unlock();
+}
+
+
 void StatisticsWindow::addReceivePacket(uint32_t sessionID, QString type,
                                         uint16_t size)
 {
@@ -586,6 +657,48 @@ void StatisticsWindow::packetDropped(uint32_t id)
 }
 
 
+void StatisticsWindow::updateBufferPool(uint32_t id, uint32_t hits, uint32_t misses)
+{
+  filterMutex_.lock();
+  if(buffers_.find(id) != buffers_.end())
+  {
+    if(buffers_[id].poolHits != hits ||
+       buffers_[id].poolMisses != misses)
+    {
+      dirtyBuffers_ = true;
+      buffers_[id].poolHits = hits;
+      buffers_[id].poolMisses = misses;
+    }
+  }
+  else
+  {
+    printProgramWarning(this, "Couldn't find correct filter for buffer pool status",
+                        "Filter id", QString::number(id));
+  }
+  filterMutex_.unlock();
+}
+
+
+void StatisticsWindow::updateCPUUsage(uint32_t id, uint16_t usage)
+{
+  filterMutex_.lock();
+  if(buffers_.find(id) != buffers_.end())
+  {
+    if(buffers_[id].cpuUsage != usage)
+    {
+      dirtyBuffers_ = true;
+      buffers_[id].cpuUsage = usage;
+    }
+  }
+  else
+  {
+    printProgramWarning(this, "Couldn't find correct filter for CPU usage",
+                        "Filter id", QString::number(id));
+  }
+  filterMutex_.unlock();
+}
+
+
 void StatisticsWindow::paintEvent(QPaintEvent *event)
 {
   Q_UNUSED(event);
@@ -639,6 +752,9 @@ void StatisticsWindow::paintEvent(QPaintEvent *event)
       ui_->data_sent_value->setText( QString::number(transferredData_));
       ui_->packets_received_value->setText( QString::number(receivePacketCount_));
       ui_->data_received_value->setText( QString::number(receivedData_));
+      ui_->congestion_value->setText(congestionState_);
+      ui_->presentation_value->setText(presentationState_);
+      ui_->audio_buffer_value->setText(audioBufferState_);
 
       // bandwidth chart
       float packetRate = 0.0f; // not interested in this at the moment.
@@ -663,14 +779,14 @@ void StatisticsWindow::paintEvent(QPaintEvent *event)
         // calculate local audio bitrate
         uint32_t audioBitrate = calculateAverage(audioPackets_, audioIndex_, interval, true);
 
-        uint32_t videoEncoderDelay = calculateAverage(videoEncDelay_, videoEncDelayIndex_, interval, false);
-        uint32_t audioEncoderDelay = calculateAverage(audioEncDelay_, audioEncDelayIndex_, interval, false);
+        uint32_t videoSendDelay = calculateAverage(videoSendDelay_, videoSendDelayIndex_, interval, false);
+        uint32_t audioSendDelay = calculateAverage(audioSendDelay_, audioSendDelayIndex_, interval, false);
 
         // add points to chart
         ui_->v_bitrate_chart->addPoint(chartVideoID_, videoBitrate);
         ui_->a_bitrate_chart->addPoint(chartAudioID_, audioBitrate);
-        ui_->v_delay_chart->addPoint(chartVideoID_, videoEncoderDelay);
-        ui_->a_delay_chart->addPoint(chartAudioID_, audioEncoderDelay);
+        ui_->v_delay_chart->addPoint(chartVideoID_, videoSendDelay);
+        ui_->a_delay_chart->addPoint(chartAudioID_, audioSendDelay);
         ui_->v_framerate_chart->addPoint(chartVideoID_, videoFramerate);
 
         // add points for all existing sessions
@@ -730,9 +846,16 @@ void StatisticsWindow::paintEvent(QPaintEvent *event)
                                                          "/" + QString::number(it.second.bufferSize)));
           ui_->filterTable->setItem(it.second.tableIndex, 4,
                                     new QTableWidgetItem(QString::number(it.second.dropped)));
+          ui_->filterTable->setItem(it.second.tableIndex, 5,
+                                    new QTableWidgetItem(QString::number(it.second.poolHits) +
+                                                         "/" + QString::number(it.second.poolMisses)));
+          ui_->filterTable->setItem(it.second.tableIndex, 6,
+                                    new QTableWidgetItem(QString::number(it.second.cpuUsage)));
 
           ui_->filterTable->item(it.second.tableIndex, 3)->setTextAlignment(Qt::AlignHCenter);
           ui_->filterTable->item(it.second.tableIndex, 4)->setTextAlignment(Qt::AlignHCenter);
+          ui_->filterTable->item(it.second.tableIndex, 5)->setTextAlignment(Qt::AlignHCenter);
+          ui_->filterTable->item(it.second.tableIndex, 6)->setTextAlignment(Qt::AlignHCenter);
         }
         filterMutex_.unlock();
 
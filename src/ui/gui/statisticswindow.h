@@ -46,11 +46,17 @@ public:
   virtual void sendDelay(QString type, uint32_t delay);
   virtual void receiveDelay(uint32_t sessionID, QString type, int32_t delay);
   virtual void presentPackage(uint32_t sessionID, QString type);
+  virtual void updatePresentation(uint32_t sessionID, uint32_t dropped,
+                                  uint32_t repeated, uint16_t bufferDelay);
+  virtual void updateAudioBuffer(uint32_t sessionID, uint16_t depth, uint16_t targetDelay,
+                                 uint32_t concealed, uint32_t discarded);
   virtual void addEncodedPacket(QString type, uint32_t size);
 
   // delivery
   virtual void addSendPacket(uint16_t size);
   virtual void addReceivePacket(uint32_t sessionID, QString type, uint16_t size);
+  virtual void updateCongestionControl(uint32_t estimate, uint32_t videoBitrate,
+                                       uint32_t audioBitrate, float loss, int32_t rtt);
 
   // filter
   virtual uint32_t addFilter(QString type, QString identifier, uint64_t TID);
@@ -58,6 +64,8 @@ public:
   virtual void updateBufferStatus(uint32_t id, uint16_t buffersize,
                                   uint16_t maxBufferSize);
   virtual void packetDropped(uint32_t id);
+  virtual void updateBufferPool(uint32_t id, uint32_t hits, uint32_t misses);
+  virtual void updateCPUUsage(uint32_t id, uint16_t usage);
 
   // sip
   virtual void addSentSIPMessage(QString type, QString message, QString address);
@@ -142,6 +150,9 @@ private:
     QString TID;
     uint32_t bufferSize;
     uint32_t dropped;
+    uint32_t poolHits;
+    uint32_t poolMisses;
+    uint16_t cpuUsage;
 
     int tableIndex;
   };
@@ -178,13 +189,39 @@ private:
   uint64_t receivePacketCount_;
   uint64_t receivedData_;
 
+  // latest state of the congestion control
+  QString congestionState_;
+
+  // frame pacing of each video view
+  struct PresentationInfo
+  {
+    uint32_t dropped;
+    uint32_t repeated;
+    uint16_t bufferDelay;
+  };
+
+  std::map<uint32_t, PresentationInfo> presentation_;
+  QString presentationState_;
+
+  // jitter buffer of each audio stream
+  struct AudioBufferInfo
+  {
+    uint16_t depth;
+    uint16_t targetDelay;
+    uint32_t concealed;
+    uint32_t discarded;
+  };
+
+  std::map<uint32_t, AudioBufferInfo> audioBuffers_;
+  QString audioBufferState_;
+
   uint64_t packetsDropped_;
 
   // TODO: delete these
-  uint32_t videoEncDelayIndex_;
-  std::vector<ValueInfo*> videoEncDelay_;
-  uint32_t audioEncDelayIndex_;
-  std::vector<ValueInfo*> audioEncDelay_;
+  uint32_t videoSendDelayIndex_;
+  std::vector<ValueInfo*> videoSendDelay_;
+  uint32_t audioSendDelayIndex_;
+  std::vector<ValueInfo*> audioSendDelay_;
 
 
   // a timer for reducing number of gui updates and making it more readable
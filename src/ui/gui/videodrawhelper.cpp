@@ -1,12 +1,30 @@
 #include "videodrawhelper.h"
 
+#include "presentationscheduler.h"
+#include "statisticsinterface.h"
 #include "common.h"
 
 #include <QDebug>
+#include <QDateTime>
 #include <QWidget>
 #include <QKeyEvent>
 
-const uint16_t VIEWBUFFERSIZE = 5;
+#include <algorithm>
+#include <cstdlib>
+
+const uint16_t VIEWBUFFERSIZE = 10;
+
+// the presentation delay is this many times the jitter of the frames
+const double JITTER_MULTIPLIER = 2.0;
+const int64_t MAX_BUFFER_DELAY = 100; // ms
+
+// how many frames the fastest delay is searched from
+const unsigned int TRANSIT_WINDOW = 100;
+
+// longer gaps are pauses in the stream, not missing frames
+const int64_t MAX_FRAME_INTERVAL = 1000; // ms
+
+const int64_t REPORT_INTERVAL = 1000; // ms
 
 
 VideoDrawHelper::VideoDrawHelper(uint32_t sessionID, uint32_t index, uint8_t borderSize):
@@ -16,16 +34,33 @@ VideoDrawHelper::VideoDrawHelper(uint32_t sessionID, uint32_t index, uint8_t bor
   firstImageReceived_(false),
   previousSize_(QSize(0,0)),
   borderSize_(borderSize),
-  currentFrame_(0)
+  widget_(nullptr),
+  stats_(nullptr),
+  newFrame_(false),
+  jitter_(0),
+  frameInterval_(0),
+  lastTimestamp_(0),
+  bufferDelay_(0),
+  nextDue_(0),
+  dropped_(0),
+  repeated_(0),
+  lastReport_(0)
 {}
 
 VideoDrawHelper::~VideoDrawHelper()
 {
+  if (widget_ != nullptr)
+  {
+    PresentationScheduler::instance().removeView(this);
+  }
   frameBuffer_.clear();
 }
 
 void VideoDrawHelper::initWidget(QWidget* widget)
 {
+  widget_ = widget;
+  PresentationScheduler::instance().addView(this, widget);
+
   widget->setAutoFillBackground(false);
   widget->setAttribute(Qt::WA_NoSystemBackground, true);
 
@@ -44,73 +79,115 @@ bool VideoDrawHelper::readyToDraw()
   return firstImageReceived_;
 }
 
-void VideoDrawHelper::inputImage(QWidget* widget, std::unique_ptr<uchar[]> data, QImage &image,
-                                 int64_t timestamp)
+void VideoDrawHelper::inputImage(QWidget* widget, FrameBuffer data, QImage &image,
+                                 int64_t timestamp, int chromaStride)
 {
-  if(!firstImageReceived_)
-  {
-    currentFrame_ = timestamp;
-    lastFrame_ = {image, std::move(data), timestamp};
-    firstImageReceived_ = true;
-    updateTargetRect(widget);
-  }
-  else
+  int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+  QMutexLocker lock(&frameMutex_);
+
+  // the variation of the delay decides how much we buffer
+  int64_t transit = now - timestamp;
+  if (!transits_.empty())
   {
-    if(previousSize_ != image.size())
-    {
-      qDebug() << "Drawing," << metaObject()->className()
-               << ": Video widget needs to update its target rectangle because of resolution change.";
-      frameBuffer_.clear();
-      frameBuffer_.push_front({image, std::move(data), timestamp});
+    jitter_ += (std::abs(transit - transits_.back()) - jitter_)/16.0;
 
-      updateTargetRect(widget);
-    }
-    else
+    int64_t interval = timestamp - lastTimestamp_;
+    if (interval > 0 && interval < MAX_FRAME_INTERVAL)
     {
-      frameBuffer_.push_front({image, std::move(data), timestamp});
+      frameInterval_ = frameInterval_ == 0 ? interval
+                                           : frameInterval_ + (interval - frameInterval_)/8.0;
     }
+  }
+  lastTimestamp_ = timestamp;
 
-    // delete oldes image if there is too much buffer
-    if(frameBuffer_.size() > VIEWBUFFERSIZE)
-    {
-      if ( widget->isVisible() &&
-           widget->isActiveWindow() &&
-          !widget->isHidden() &&
-          !widget->isMinimized())
-      {
-        printWarning(this, "Buffer full when inputting image",
-                   {"Buffer"}, QString::number(frameBuffer_.size()) + "/"
-                     + QString::number(VIEWBUFFERSIZE));
-      }
+  transits_.push_back(transit);
+  if (transits_.size() > TRANSIT_WINDOW)
+  {
+    transits_.pop_front();
+  }
+
+  bufferDelay_ = qBound((int64_t)0, (int64_t)(JITTER_MULTIPLIER*jitter_), MAX_BUFFER_DELAY);
 
-      frameBuffer_.pop_back();
+  // present when the fastest frame of the window would have arrived plus the buffer
+  int64_t due = timestamp + *std::min_element(transits_.begin(), transits_.end()) + bufferDelay_;
 
-      //setUpdatesEnabled(true);
+  frameBuffer_.push_front({image, std::move(data), timestamp, due, chromaStride});
 
-      //stats_->packetDropped("view" + QString::number(sessionID_));
+  // delete oldes image if there is too much buffer
+  if(frameBuffer_.size() > VIEWBUFFERSIZE)
+  {
+    if ( widget->isVisible() &&
+         widget->isActiveWindow() &&
+        !widget->isHidden() &&
+        !widget->isMinimized())
+    {
+      printWarning(this, "Buffer full when inputting image",
+                 {"Buffer"}, QString::number(frameBuffer_.size()) + "/"
+                   + QString::number(VIEWBUFFERSIZE));
     }
+
+    frameBuffer_.pop_back();
+    ++dropped_;
   }
 }
 
-bool VideoDrawHelper::getRecentImage(QImage& image)
+bool VideoDrawHelper::present(int64_t now)
 {
-  Q_ASSERT(readyToDraw());
-  if(readyToDraw())
+  QMutexLocker lock(&frameMutex_);
+
+  // show the newest frame that is due, the older ones are dropped
+  bool presented = false;
+  while (!frameBuffer_.empty() && frameBuffer_.back().due <= now)
   {
-    if(!frameBuffer_.empty())
+    if (presented)
     {
-      image = frameBuffer_.back().image;
-
-      lastFrame_ = std::move(frameBuffer_.back());
-      frameBuffer_.pop_back();
-      return true;
+      ++dropped_;
     }
-    else
+
+    lastFrame_ = std::move(frameBuffer_.back());
+    frameBuffer_.pop_back();
+    presented = true;
+  }
+
+  if (presented)
+  {
+    newFrame_ = true;
+    nextDue_ = lastFrame_.due + (int64_t)frameInterval_;
+
+    if (!firstImageReceived_ || previousSize_ != lastFrame_.image.size())
     {
-      image = lastFrame_.image;
+      firstImageReceived_ = true;
+      updateTargetRect(widget_);
     }
   }
-  return false;
+  else if (firstImageReceived_ && frameInterval_ > 0 &&
+           now >= nextDue_ + frameInterval_/2 && now - nextDue_ < MAX_FRAME_INTERVAL)
+  {
+    // the next frame did not arrive in time so the previous one stays
+    ++repeated_;
+    nextDue_ += (int64_t)frameInterval_;
+  }
+
+  // sessionID 0 is the self display and we are not interested
+  if (stats_ && sessionID_ != 0 && now - lastReport_ >= REPORT_INTERVAL)
+  {
+    stats_->updatePresentation(sessionID_, dropped_, repeated_, bufferDelay_);
+    lastReport_ = now;
+  }
+
+  return presented;
+}
+
+bool VideoDrawHelper::getRecentImage(QImage& image)
+{
+  Q_ASSERT(readyToDraw());
+
+  image = lastFrame_.image;
+
+  bool newFrame = newFrame_;
+  newFrame_ = false;
+  return newFrame;
 }
 
 void VideoDrawHelper::updateTargetRect(QWidget* widget)
@@ -181,7 +258,7 @@ void VideoDrawHelper::mouseDoubleClickEvent(QWidget* widget) {
 
 void VideoDrawHelper::enterFullscreen(QWidget* widget)
 {
-  qDebug() << "Drawing," << metaObject()->className() << ": Setting VideoGLWidget fullscreen";
+  qDebug() << "Drawing," << metaObject()->className() << ": Setting video widget fullscreen";
 
   tmpParent_ = widget->parentWidget();
   widget->setParent(nullptr);
@@ -3,20 +3,26 @@
 class QWidget;
 class QMouseEvent;
 class QKeyEvent;
+class StatisticsInterface;
 
 #include <QObject>
 #include <QSize>
 #include <QImage>
 #include <QRect>
+#include <QMutex>
 
 #include <QElapsedTimer>
 
+#include "media/processing/framepool.h"
+
 #include <deque>
 #include <memory>
 
 /*
  * Purpose of the VideoDrawHelper is to process all the mouse and keyboard events
  * for video view widgets. It also includes the buffer for images waiting to be drawn.
+ * Each image is presented at its timestamp plus a jitter buffer that grows with
+ * the variation of the delay. The PresentationScheduler checks which images are due.
 */
 
 // This class could possibly be combined with displayfilter.
@@ -31,14 +37,33 @@ public:
   VideoDrawHelper(uint32_t sessionID, uint32_t index, uint8_t borderSize);
   ~VideoDrawHelper();
 
+  // also registers the widget to the presentation scheduler
   void initWidget(QWidget* widget);
 
+  void setStats(StatisticsInterface* stats)
+  {
+    stats_ = stats;
+  }
+
   bool readyToDraw();
-  void inputImage(QWidget *widget, std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp);
+  // chromaStride is the row pitch of the U and V planes when the image is
+  // the luma of a YUV picture
+  void inputImage(QWidget *widget, FrameBuffer data, QImage &image, int64_t timestamp,
+                  int chromaStride = 0);
+
+  // Takes the newest image that is due at now, in milliseconds since epoch.
+  // Returns whether the widget should be painted. Called by the scheduler.
+  bool present(int64_t now);
 
   // returns whether this is a new image or the previous one
   bool getRecentImage(QImage& image);
 
+  // of the image returned by getRecentImage
+  int recentChromaStride()
+  {
+    return lastFrame_.chromaStride;
+  }
+
   void mouseDoubleClickEvent(QWidget* widget);
   void keyPressEvent(QWidget* widget, QKeyEvent* event);
 
@@ -80,12 +105,34 @@ private:
   struct Frame
   {
     QImage image;
-    std::unique_ptr<uchar[]> data;
+    FrameBuffer data;
     int64_t timestamp;
+    int64_t due; // when to present in local time
+    int chromaStride;
   };
 
+  QWidget* widget_;
+  StatisticsInterface* stats_;
+
+  // the frame being shown and whether it has been painted
   Frame lastFrame_;
+  bool newFrame_;
+
+  // frames are added from the filter thread
+  QMutex frameMutex_;
   std::deque<Frame> frameBuffer_;
 
-  int64_t currentFrame_;
+  // the delays of the latest frames from their timestamp to us
+  std::deque<int64_t> transits_;
+  double jitter_;
+  double frameInterval_;
+  int64_t lastTimestamp_;
+  int64_t bufferDelay_;
+
+  // when the next frame should be presented, for counting repeats
+  int64_t nextDue_;
+
+  uint32_t dropped_;
+  uint32_t repeated_;
+  int64_t lastReport_;
 };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "media/processing/framepool.h"
+
 #include <QImage>
 
 #include <memory>
@@ -23,7 +25,22 @@ public:
   virtual void setStats(StatisticsInterface* stats) = 0;
 
   // Takes ownership of the image data
-  virtual void inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp) = 0;
+  virtual void inputImage(FrameBuffer data, QImage &image, int64_t timestamp) = 0;
+
+  // Takes ownership of a YUV 4:2:0 picture. Used instead of inputImage when the
+  // supported format is VIDEO_YUV420. luma wraps the Y plane and the U and V
+  // planes follow it with chromaStride bytes per row. The widget mirrors the
+  // picture itself.
+  virtual void inputYUV(FrameBuffer data, QImage &luma, int chromaStride,
+                        bool mirrorHorizontal, bool mirrorVertical, int64_t timestamp)
+  {
+    Q_UNUSED(data);
+    Q_UNUSED(luma);
+    Q_UNUSED(chromaStride);
+    Q_UNUSED(mirrorHorizontal);
+    Q_UNUSED(mirrorVertical);
+    Q_UNUSED(timestamp);
+  }
 
   virtual VideoFormat supportedFormat() = 0;
 };
@@ -1,7 +1,6 @@
 #include "videoviewfactory.h"
 
 #include "videowidget.h"
-#include "videoglwidget.h"
 #include "videoyuvwidget.h"
 
 // this annoys me, but I can live with it. The only smart way to fix it would be to get signal connect working
@@ -9,13 +8,15 @@
 
 #include "common.h"
 
+#include <QOpenGLContext>
 #include <QSettings>
 #include <QDebug>
 
 VideoviewFactory::VideoviewFactory():
   sessionIDtoWidgetlist_(),
   sessionIDtoVideolist_(),
-  opengl_(false)
+  openglChecked_(false),
+  openglAvailable_(false)
 {}
 
 uint32_t VideoviewFactory::createWidget(uint32_t sessionID, QWidget* parent,
@@ -24,13 +25,14 @@ uint32_t VideoviewFactory::createWidget(uint32_t sessionID, QWidget* parent,
   qDebug() << "View, VideoFactory : Creating videowidget for sessionID:" << sessionID;
   QSettings settings("kvazzup.ini", QSettings::IniFormat);
 
-  int opengl = settings.value("video/opengl").toInt();
+  bool software = settings.value("video/softwareRendering").toInt() == 1;
 
   QWidget* vw = nullptr;
   VideoInterface* video = nullptr;
 
-  if(false && !opengl_) // YUV widget not working yet
+  if(!software && openglAvailable())
   {
+    // draws the decoded YUV directly without converting it to RGB first
     VideoYUVWidget* yuv = new VideoYUVWidget(parent, sessionID);
     vw = yuv;
     video = yuv;
@@ -41,24 +43,10 @@ uint32_t VideoviewFactory::createWidget(uint32_t sessionID, QWidget* parent,
     // signals reattaching after fullscreen mode
     QObject::connect(yuv, &VideoYUVWidget::reattach, conf, &ConferenceView::reattachWidget);
     QObject::connect(yuv, &VideoYUVWidget::detach, conf, &ConferenceView::detachWidget);
-
-    opengl_ = true;
-  }
-  else if(opengl == 1)
-  {
-    VideoGLWidget* opengl = new VideoGLWidget(parent, sessionID);
-    vw = opengl;
-    video = opengl;
-
-    // couldn't get this to work with videointerface, so the videowidget is used.
-    // TODO: try qobject_cast to get the signal working for interface
-
-    // signals reattaching after fullscreen mode
-    QObject::connect(opengl, &VideoGLWidget::reattach, conf, &ConferenceView::reattachWidget);
-    QObject::connect(opengl, &VideoGLWidget::detach, conf, &ConferenceView::detachWidget);
   }
   else
   {
+    // converts the picture to RGB on the CPU
     VideoWidget* normal = new VideoWidget(parent, sessionID);
     vw = normal;
     video = normal;
@@ -143,6 +131,25 @@ void VideoviewFactory::clearWidgets(uint32_t sessionID)
 }
 
 
+bool VideoviewFactory::openglAvailable()
+{
+  if(!openglChecked_)
+  {
+    QOpenGLContext context;
+    openglAvailable_ = context.create() && context.isValid();
+    openglChecked_ = true;
+
+    if(!openglAvailable_)
+    {
+      printDebug(DEBUG_WARNING, "VideoviewFactory",
+                 "Could not create an OpenGL context. Drawing video without OpenGL.");
+    }
+  }
+
+  return openglAvailable_;
+}
+
+
 void VideoviewFactory::checkInitializations(uint32_t sessionID)
 {
   if(sessionIDtoWidgetlist_.find(sessionID) == sessionIDtoWidgetlist_.end())
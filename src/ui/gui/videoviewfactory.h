@@ -38,9 +38,14 @@ private:
 
   void checkInitializations(uint32_t sessionID);
 
+  // The views draw YUV with OpenGL shaders when a context can be created.
+  // Otherwise they convert the picture to RGB on the CPU.
+  bool openglAvailable();
+
   //TODO: make shared ptr so they get deleted
   std::map<uint32_t, std::shared_ptr<std::vector<QWidget*>>> sessionIDtoWidgetlist_;
   std::map<uint32_t, std::shared_ptr<std::vector<VideoInterface*>>> sessionIDtoVideolist_;
 
-  bool opengl_;
+  bool openglChecked_;
+  bool openglAvailable_;
 };
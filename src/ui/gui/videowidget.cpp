@@ -21,8 +21,6 @@ VideoWidget::VideoWidget(QWidget* parent, uint32_t sessionID, uint32_t index, ui
   QFrame::setLineWidth(borderSize);
   QFrame::setMidLineWidth(1);
 
-  // the new syntax does not work for some reason (unresolved overloaded function type)
-  QObject::connect(this, SIGNAL(newImage()), this, SLOT(repaint()));
   QObject::connect(&helper_, &VideoDrawHelper::detach, this, &VideoWidget::detach);
   QObject::connect(&helper_, &VideoDrawHelper::reattach, this, &VideoWidget::reattach);
 }
@@ -30,7 +28,7 @@ VideoWidget::VideoWidget(QWidget* parent, uint32_t sessionID, uint32_t index, ui
 VideoWidget::~VideoWidget()
 {}
 
-void VideoWidget::inputImage(std::unique_ptr<uchar[]> data, QImage &image,
+void VideoWidget::inputImage(FrameBuffer data, QImage &image,
                              int64_t timestamp)
 {
   drawMutex_.lock();
@@ -38,9 +36,6 @@ void VideoWidget::inputImage(std::unique_ptr<uchar[]> data, QImage &image,
 
   helper_.inputImage(this, std::move(data), image, timestamp);
 
-  //update();
-
-  emit newImage();
   drawMutex_.unlock();
 }
 
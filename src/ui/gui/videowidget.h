@@ -26,10 +26,11 @@ public:
   virtual void setStats(StatisticsInterface* stats)
   {
     stats_ = stats;
+    helper_.setStats(stats);
   }
 
   // Takes ownership of the image data
-  virtual void inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp);
+  virtual void inputImage(FrameBuffer data, QImage &image, int64_t timestamp);
 
   virtual VideoFormat supportedFormat()
   {
@@ -41,7 +42,6 @@ signals:
   void reattach(uint32_t sessionID);
   void detach(uint32_t sessionID, uint32_t index, QWidget* widget);
 
-  void newImage();
 protected:
   void paintEvent(QPaintEvent *event);
   void resizeEvent(QResizeEvent *event);
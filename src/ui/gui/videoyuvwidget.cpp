@@ -2,6 +2,10 @@
 
 #include "statisticsinterface.h"
 
+#include "common.h"
+
+#include <QOpenGLContext>
+#include <QVector2D>
 #include <QPaintEvent>
 #include <QDebug>
 #include <QCoreApplication>
@@ -9,305 +13,279 @@
 #include <QKeyEvent>
 #include <QLayout>
 
+static const char *vertexShaderSource =
+    "attribute vec2 vertex;\n"
+    "attribute vec2 texCoord;\n"
+    "uniform vec2 lumaScale;\n"
+    "uniform vec2 chromaScale;\n"
+    "varying vec2 lumaCoord;\n"
+    "varying vec2 chromaCoord;\n"
+    "void main() {\n"
+    "   lumaCoord = texCoord * lumaScale;\n"
+    "   chromaCoord = texCoord * chromaScale;\n"
+    "   gl_Position = vec4(vertex, 0.0, 1.0);\n"
+    "}\n";
+
+// same conversion as the CPU kernels
+static const char *fragmentShaderSource =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D yTexture;\n"
+    "uniform sampler2D uTexture;\n"
+    "uniform sampler2D vTexture;\n"
+    "varying vec2 lumaCoord;\n"
+    "varying vec2 chromaCoord;\n"
+    "void main() {\n"
+    "   float y = texture2D(yTexture, lumaCoord).r;\n"
+    "   float u = texture2D(uTexture, chromaCoord).r - 0.50196;\n"
+    "   float v = texture2D(vTexture, chromaCoord).r - 0.50196;\n"
+    "   gl_FragColor = vec4(y + 1.402*v, y - 0.344*u - 0.714*v, y + 1.772*u, 1.0);\n"
+    "}\n";
+
+
 VideoYUVWidget::VideoYUVWidget(QWidget* parent, uint32_t sessionID,
                                uint32_t index, uint8_t borderSize)
   : QOpenGLWidget(parent),
   stats_(nullptr),
   sessionID_(sessionID),
   helper_(sessionID, index, borderSize),
-  texture_(0),
-  prog_(nullptr)
-
+  prog_(nullptr),
+  textures_{0, 0, 0},
+  texturesValid_(false),
+  vertexAttr_(-1),
+  texCoordAttr_(-1),
+  mirrorHorizontal_(false),
+  mirrorVertical_(false)
 {
   helper_.initWidget(this);
 
-  // the new syntax does not work for some reason (unresolved overloaded function type)
-  QObject::connect(this, SIGNAL(newImage()), this, SLOT(repaint()));
   QObject::connect(&helper_, &VideoDrawHelper::detach, this, &VideoYUVWidget::detach);
   QObject::connect(&helper_, &VideoDrawHelper::reattach, this, &VideoYUVWidget::reattach);
 }
 
 VideoYUVWidget::~VideoYUVWidget()
-{}
+{
+  cleanupGL();
+}
+
+void VideoYUVWidget::inputImage(FrameBuffer data, QImage &image, int64_t timestamp)
+{
+  Q_UNUSED(data);
+  Q_UNUSED(image);
+  Q_UNUSED(timestamp);
 
-void VideoYUVWidget::inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp)
+  printDebug(DEBUG_PROGRAM_ERROR, this, "The YUV widget was given an RGB image.");
+}
+
+void VideoYUVWidget::inputYUV(FrameBuffer data, QImage &luma, int chromaStride,
+                              bool mirrorHorizontal, bool mirrorVertical, int64_t timestamp)
 {
   Q_ASSERT(data != nullptr);
   drawMutex_.lock();
-  // if the resolution has changed in video
 
-  helper_.inputImage(this, std::move(data), image, timestamp);
+  mirrorHorizontal_ = mirrorHorizontal;
+  mirrorVertical_ = mirrorVertical;
 
-  //update();
+  helper_.inputImage(this, std::move(data), luma, timestamp, chromaStride);
 
-  emit newImage();
   drawMutex_.unlock();
 }
 
-/*
-static const char *fragmentShaderSource =
-    "uniform sampler2D s_texture;\n"
-    "void main() {\n"
-        "float y = texture2D(s_texture, gl_FragCoord.xy).r;\n"
-        "float u = texture2D(s_texture, gl_FragCoord.xy).r - 0.5;\n"
-        "float v = texture2D(s_texture, gl_FragCoord.xy).r - 0.5;\n"
-        "float r = y +             1.402 * v;\n"
-        "float g = y - 0.344 * u - 0.714 * v;\n"
-        "float b = y + 1.772 * u;\n"
-       // "gl_FragColor = vec4(r,g,b,1.0);\n"
-        "gl_FragColor = vec4(1.0,0.0,0.0,1.0);\n"
-    "}\n";
-*/
-
-/*
-static const char *vertexShaderSource =
-    "attribute vec4 vertex;\n"
-    "void main() {\n"
-    "   gl_Position = vertex;\n"
-    "}\n";
-*/
-
-static const char *vertexShaderSource2 =
-    "attribute vec4 posAttr;\n"
-    "attribute lowp vec4 colAttr;\n"
-    "varying lowp vec4 col;\n"
-    "uniform mat4 matrix;\n"
-    "void main() {\n"
-    "   col = colAttr;\n"
-    "   gl_Position = matrix * posAttr;\n"
-    "}\n";
-
-static const char *fragmentShaderSource2 =
-    "varying lowp vec4 col;\n"
-    "void main() {\n"
-    "   gl_FragColor = col;\n"
-    "}\n";
-
 
 void VideoYUVWidget::initializeGL()
 {
   initializeOpenGLFunctions();
 
-  if(prog_ == nullptr)
+  // a new context is created if the widget is moved to another window
+  connect(context(), &QOpenGLContext::aboutToBeDestroyed,
+          this, &VideoYUVWidget::cleanupGL, Qt::UniqueConnection);
+
+  prog_ = new QOpenGLShaderProgram();
+  if (!prog_->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource) ||
+      !prog_->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource) ||
+      !prog_->link())
   {
-    //makeCurrent();
-    qDebug() << "Initializing OpenGLProgram:" << glGetError();
-    prog_ = new QOpenGLShaderProgram();
-    prog_->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource2);
-    prog_->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource2);
-    prog_->link();
-     qDebug() << "Opengl initialization linking:" << glGetError() << prog_->log();
-    m_posAttr = prog_->attributeLocation("posAttr");
-    qDebug() << "Opengl initialization:" << glGetError();
-    m_colAttr = prog_->attributeLocation("colAttr");
-    qDebug() << "Opengl initialization:" << glGetError();
-    m_matrixUniform = prog_->uniformLocation("matrix");
-    qDebug() << "Opengl initialization:" << glGetError();
-
-    m_frame = 0;
-    //doneCurrent();
-    qDebug() << "Opengl initialization:" << glGetError();
+    printDebug(DEBUG_ERROR, this, "Failed to create the YUV shader.",
+               {"Log"}, {prog_->log()});
+    delete prog_;
+    prog_ = nullptr;
+    return;
   }
 
-  /*
-  qDebug() << "=== Initializing YUV OpenGL drawing widget for sessionID:" << sessionID_;
-
+  vertexAttr_ = prog_->attributeLocation("vertex");
+  texCoordAttr_ = prog_->attributeLocation("texCoord");
 
-  qDebug() << "Opengl:" << glGetError();
+  prog_->bind();
+  prog_->setUniformValue("yTexture", 0);
+  prog_->setUniformValue("uTexture", 1);
+  prog_->setUniformValue("vTexture", 2);
+  prog_->release();
 
-  if(!prog_.isLinked())
+  glGenTextures(3, textures_);
+  for (unsigned int i = 0; i < 3; ++i)
   {
-    //static const GLfloat texCoords[] = { 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f };
-    static const GLfloat vertices[]= {1.0f, 1.0f, -1.0f, 1.0f, 1.0f, -1.0f,  -1.0f, -1.0f };
-
-    vbo_.create();
-    vbo_.bind();
-    vbo_.allocate(vertices, 8*sizeof(GLfloat));
-
-    prog_.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
-    qDebug() << "Opengl:" << glGetError();
-
-    prog_.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
-    qDebug() << "Opengl source:" << glGetError();
-
-    prog_.bindAttributeLocation("vertex", 0);
-    qDebug() << "Opengl attribute:" << glGetError();
-
-    prog_.link();
-    qDebug() << "Opengl Link:" << glGetError();
+    glBindTexture(GL_TEXTURE_2D, textures_[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // non power of two textures need these with OpenGL ES 2.0
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    textureSizes_[i] = QSize();
   }
+  glBindTexture(GL_TEXTURE_2D, 0);
 
-  if(texture_ == 0)
-  {
-    prog_.bind();
-    qDebug() << "Opengl bind:" << glGetError();
+  texturesValid_ = false;
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+}
 
-    glEnable(GL_TEXTURE_2D);
-    qDebug() << "Opengl:" << glGetError();
 
-    glGenTextures(1, &texture_);
-    qDebug() << "Opengl:" << glGetError();
+void VideoYUVWidget::cleanupGL()
+{
+  if (prog_ == nullptr)
+  {
+    return;
+  }
 
-    glBindTexture(GL_TEXTURE_2D, texture_);
-    qDebug() << "Opengl:" << glGetError();
+  makeCurrent();
+  glDeleteTextures(3, textures_);
+  delete prog_;
+  prog_ = nullptr;
+  texturesValid_ = false;
+  doneCurrent();
+}
 
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    qDebug() << "Opengl:" << glGetError();
 
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    qDebug() << "Opengl:" << glGetError();
+void VideoYUVWidget::uploadFrame(const QImage& luma, int chromaStride)
+{
+  const uchar* planes[3];
+  planes[0] = luma.constBits();
+  planes[1] = planes[0] + luma.bytesPerLine()*luma.height();
+  planes[2] = planes[1] + chromaStride*luma.height()/2;
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1600, 1344, 0,
-                 GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+  // The whole rows including the padding are uploaded since OpenGL ES 2.0
+  // has no row length for unpacking. The padding is left out when sampling.
+  QSize sizes[3] = {QSize(luma.bytesPerLine(), luma.height()),
+                    QSize(chromaStride, luma.height()/2),
+                    QSize(chromaStride, luma.height()/2)};
 
-    //glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, lastImage_.size().width(), lastImage_.size().height(), 0,
-    //              GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    //prog_.bindAttributeLocation("vertex", 0);
-    int loc = prog_.uniformLocation("s_texture");
-    prog_.setUniformValue(loc, texture_);
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, textures_[i]);
 
-    prog_.release();
+    if (textureSizes_[i] != sizes[i])
+    {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, sizes[i].width(), sizes[i].height(), 0,
+                   GL_LUMINANCE, GL_UNSIGNED_BYTE, planes[i]);
+      textureSizes_[i] = sizes[i];
+    }
+    else
+    {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sizes[i].width(), sizes[i].height(),
+                      GL_LUMINANCE, GL_UNSIGNED_BYTE, planes[i]);
+    }
   }
 
-  //glOrtho(-1.0, 1.0, -1.0, 1.0, 0.1, 50);
-
-  qDebug() << "Opengl Initialization:" << glGetError() << ":" << prog_.log();
-  qDebug() << "Image size:" << lastImage_.size();
-  */
+  texturesValid_ = true;
 }
-void VideoYUVWidget::drawOpenGL(bool updateImage)
-{
-  Q_UNUSED(updateImage);
-  /*
-  qDebug() << "Drawing with OpenGL --------------------------------------------------";
-  glClear(GL_COLOR_BUFFER_BIT);
-  glBindTexture(GL_TEXTURE_2D, texture_);
 
-  if(updateImage)
-  {
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 400, 1344,
-                   GL_BGRA,  GL_UNSIGNED_BYTE, dataBuffer_.back().get());
-  }
-  prog_.bind();
-*/
-  //glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, lastImage_.size().width(), lastImage_.size().height(),
-  //                 GL_RGB, GL_UNSIGNED_BYTE, dataBuffer_.back().get());
-
-  //prog_.enableAttributeArray(0);
-  //prog_.setAttributeBuffer(0, GL_FLOAT, 0, 2, 2*sizeof(GLfloat));
 
-  //glBindBuffer();
-  //glEnableVertexAttribArray();
-  //glVertexAttribPointer();
-  //glDrawArrays(GL_TRIANGLES, 0, 3);
+void VideoYUVWidget::drawFrame(const QImage& luma, int chromaStride)
+{
+  // the target rect is in widget coordinates and the viewport starts from the bottom
+  const qreal retinaScale = devicePixelRatio();
+  QRect target = helper_.getTargetRect();
+  glViewport(target.x()*retinaScale, (height() - target.y() - target.height())*retinaScale,
+             target.width()*retinaScale, target.height()*retinaScale);
+
+  static const GLfloat vertices[] = {-1.0f, -1.0f,
+                                      1.0f, -1.0f,
+                                     -1.0f,  1.0f,
+                                      1.0f,  1.0f};
+
+  // the first row of the picture is at the top
+  GLfloat left = mirrorHorizontal_ ? 1.0f : 0.0f;
+  GLfloat right = 1.0f - left;
+  GLfloat top = mirrorVertical_ ? 1.0f : 0.0f;
+  GLfloat bottom = 1.0f - top;
+
+  const GLfloat texCoords[] = {left,  bottom,
+                               right, bottom,
+                               left,  top,
+                               right, top};
 
-  qDebug() << "Drawing with OpenGL shaders";
+  prog_->bind();
+  prog_->setUniformValue("lumaScale", QVector2D((float)luma.width()/luma.bytesPerLine(), 1.0f));
+  prog_->setUniformValue("chromaScale", QVector2D((float)luma.width()/2/chromaStride, 1.0f));
 
-  if(prog_ == nullptr)
+  for (unsigned int i = 0; i < 3; ++i)
   {
-    initializeGL();
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, textures_[i]);
   }
 
- // makeCurrent();
+  glVertexAttribPointer(vertexAttr_, 2, GL_FLOAT, GL_FALSE, 0, vertices);
+  glVertexAttribPointer(texCoordAttr_, 2, GL_FLOAT, GL_FALSE, 0, texCoords);
+  glEnableVertexAttribArray(vertexAttr_);
+  glEnableVertexAttribArray(texCoordAttr_);
 
-  const qreal retinaScale = devicePixelRatio();
-  glViewport(0, 0, width() * retinaScale, height() * retinaScale);
-  qDebug() << "Opengl:" << glGetError();
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-  glClear(GL_COLOR_BUFFER_BIT);
-  qDebug() << "Opengl:" << glGetError();
-
-  prog_->bind();
-  qDebug() << "Opengl bind:" << glGetError();
-
-  QMatrix4x4 matrix;
-  matrix.perspective(60.0f, 4.0f/3.0f, 0.1f, 100.0f);
-  matrix.translate(0, 0, -2);
-  matrix.rotate(100.0f * m_frame / 30, 0, 1, 0);
-
-  prog_->setUniformValue(m_matrixUniform, matrix);
-  qDebug() << "Opengl:" << glGetError() << prog_->log();
-
-  GLfloat vertices[] = {
-      0.0f, 0.707f,
-      -0.5f, -0.5f,
-      0.5f, -0.5f
-  };
-
-  GLfloat colors[] = {
-      1.0f, 0.0f, 0.0f,
-      0.0f, 1.0f, 0.0f,
-      0.0f, 0.0f, 1.0f
-  };
-
-  glVertexAttribPointer(m_posAttr, 2, GL_FLOAT, GL_FALSE, 0, vertices);
-  qDebug() << "Opengl:" << glGetError();
-  glVertexAttribPointer(m_colAttr, 3, GL_FLOAT, GL_FALSE, 0, colors);
-  qDebug() << "Opengl:" << glGetError();
-
-  glEnableVertexAttribArray(0);
-  qDebug() << "Opengl:" << glGetError();
-  glEnableVertexAttribArray(1);
-  qDebug() << "Opengl:" << glGetError();
-
-  glDrawArrays(GL_TRIANGLES, 0, 3);
-  qDebug() << "Opengl draw:" << glGetError();
-
-  glDisableVertexAttribArray(1);
-  qDebug() << "Opengl:" << glGetError();
-  glDisableVertexAttribArray(0);
-  qDebug() << "Opengl:" << glGetError();
+  glDisableVertexAttribArray(texCoordAttr_);
+  glDisableVertexAttribArray(vertexAttr_);
 
   prog_->release();
-
-  ++m_frame;
-
-  //doneCurrent();
-  qDebug() << "Opengl done:" << glGetError();
 }
 
+
 void VideoYUVWidget::paintGL()
 {
-  //qDebug() << "PaintEvent for widget:" << sessionID_;
-  QPainter painter(this);
+  glClear(GL_COLOR_BUFFER_BIT);
 
-  if(helper_.readyToDraw())
+  if(prog_ == nullptr || !helper_.readyToDraw())
   {
-    drawMutex_.lock();
+    return;
+  }
 
-    QImage frame;
-    if(helper_.getRecentImage(frame))
+  drawMutex_.lock();
+
+  QImage frame;
+  bool newFrame = helper_.getRecentImage(frame);
+  if(newFrame)
+  {
+    // sessionID 0 is the self display and we are not interested
+    // update stats only for each new image.
+    if(stats_ && sessionID_ != 0)
     {
-      // sessionID 0 is the self display and we are not interested
-      // update stats only for each new image.
-      if(stats_ && sessionID_ != 0)
-      {
-        stats_->presentPackage(sessionID_, "Video");
-      }
+      stats_->presentPackage(sessionID_, "Video");
     }
-
-    drawOpenGL(true);
-    drawMutex_.unlock();
   }
-  else
+
+  int chromaStride = helper_.recentChromaStride();
+
+  if(newFrame || !texturesValid_)
   {
-    drawOpenGL(false);
+    uploadFrame(frame, chromaStride);
   }
+
+  drawFrame(frame, chromaStride);
+  drawMutex_.unlock();
 }
 
 void VideoYUVWidget::resizeGL(int width, int height)
 {
   Q_UNUSED(width);
   Q_UNUSED(height);
-
-  //int side = qMin(width, height);
-  //glViewport((width - side) / 2, (height - side) / 2, side, side);
 }
 
 void VideoYUVWidget::resizeEvent(QResizeEvent *event)
 {
   QOpenGLWidget::resizeEvent(event); // its important to call this resize function, not the qwidget one.
+  helper_.updateTargetRect(this);
 }
 
 
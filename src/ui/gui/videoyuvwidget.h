@@ -3,25 +3,25 @@
 #include "videointerface.h"
 #include "videodrawhelper.h"
 
-#include <QOpenGLFunctions_2_0>
+#include <QOpenGLWidget>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
 
-#include <QPainter>
 #include <QRect>
 #include <QSize>
 #include <QImage>
 #include <QMutex>
 
-#include <QtOpenGL>
-
-#include <deque>
 #include <memory>
 
 
-// TODO: duplicate code in this and videowidget.
-
 class StatisticsInterface;
 
-// The normal QOpenGLFunctions provides access to ES API so the whole API is used instead
+// Draws YUV 4:2:0 video with OpenGL. The three planes are uploaded as
+// luminance textures and the fragment shader converts them to RGB, so the
+// colour conversion and mirroring are not done with the CPU. Only OpenGL 2.0
+// and OpenGL ES 2.0 features are used so that software renderers like Mesa
+// llvmpipe work too.
 
 class VideoYUVWidget : public QOpenGLWidget, public VideoInterface, protected QOpenGLFunctions
 {
@@ -35,16 +35,18 @@ public:
   void setStats(StatisticsInterface* stats)
   {
     stats_ = stats;
+    helper_.setStats(stats);
   }
 
-  // Takes ownership of the image data
-  void inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp);
+  // RGB images are not supported by this widget
+  void inputImage(FrameBuffer data, QImage &image, int64_t timestamp);
 
-  static unsigned int number_;
+  // Takes ownership of the image data
+  void inputYUV(FrameBuffer data, QImage &luma, int chromaStride,
+                bool mirrorHorizontal, bool mirrorVertical, int64_t timestamp);
 
   virtual VideoFormat supportedFormat()
   {
-    //return VIDEO_RGB32;
     return VIDEO_YUV420;
   }
 
@@ -54,7 +56,6 @@ signals:
   void reattach(uint32_t sessionID_);
   void detach(uint32_t sessionID_, uint32_t index, QWidget* widget);
 
-  void newImage();
 protected:
 
   // QOpenGLwidget events
@@ -67,15 +68,17 @@ protected:
   virtual void paintGL();
   virtual void resizeGL(int width, int height);
 
-private:
+private slots:
 
-  // update the rect in case the window or input has changed.
-  void updateTargetRect();
+  // the context is destroyed when the widget is moved to another window
+  void cleanupGL();
 
-  void enterFullscreen();
-  void exitFullscreen();
+private:
+
+  // copies the planes of the frame to the textures
+  void uploadFrame(const QImage& luma, int chromaStride);
 
-  void drawOpenGL(bool updateImage);
+  void drawFrame(const QImage& luma, int chromaStride);
 
   QMutex drawMutex_;
 
@@ -84,14 +87,16 @@ private:
 
   VideoDrawHelper helper_;
 
-  GLuint texture_;
-
   QOpenGLShaderProgram* prog_;
 
-  QOpenGLBuffer vbo_;
+  // Y, U and V
+  GLuint textures_[3];
+  QSize textureSizes_[3];
+  bool texturesValid_;
+
+  int vertexAttr_;
+  int texCoordAttr_;
 
-  GLuint m_posAttr;
-  GLuint m_colAttr;
-  GLuint m_matrixUniform;
-  int m_frame;
+  bool mirrorHorizontal_;
+  bool mirrorVertical_;
 };
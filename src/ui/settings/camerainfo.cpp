@@ -41,6 +41,9 @@ const std::map<QVideoFrame::PixelFormat, QString> pixelFormatStrings = {{QVideoF
 
 const QList<QVideoFrame::PixelFormat> kvazzupFormats = {QVideoFrame::Format_RGB32,
                                                         QVideoFrame::Format_YUV420P,
+                                                        QVideoFrame::Format_YV12,
+                                                        QVideoFrame::Format_NV12,
+                                                        QVideoFrame::Format_YUYV,
                                                         QVideoFrame::Format_Jpeg};
 
 CameraInfo::CameraInfo()
@@ -161,9 +161,13 @@ void VideoSettings::saveSettings()
                                            QString::number(videoSettingsUI_->tile_y->value());
   saveTextValue("video/tileDimensions",    tile_dimension, settings_);
 
-  saveTextValue("video/OPENHEVC_threads",  videoSettingsUI_->openhevc_threads->text(), settings_);
+  saveTextValue("video/OPENHEVC_threads",  QString::number(videoSettingsUI_->openhevc_threads->value()), settings_);
   saveTextValue("video/yuvThreads",        videoSettingsUI_->yuv_threads->text(), settings_);
   saveTextValue("video/rgbThreads",        videoSettingsUI_->rgb32_threads->text(), settings_);
+  saveCheckBox("video/filterPool",         videoSettingsUI_->filter_pool, settings_);
+  saveCheckBox("video/filterTrace",        videoSettingsUI_->filter_trace, settings_);
+  saveTextValue("video/backpressure",      QString::number(videoSettingsUI_->backpressure->currentIndex()), settings_);
+  saveTextValue("video/simulcastLayers",   QString::number(videoSettingsUI_->simulcast_layers->value()), settings_);
 
   // structure-tab
   settings_.setValue("video/QP",           QString::number(videoSettingsUI_->qp->value()));
@@ -180,13 +184,14 @@ void VideoSettings::saveSettings()
 
   saveCheckBox("video/qpInCU",             videoSettingsUI_->qp_in_cu_box, settings_);
   saveTextValue("video/vaq",               QString::number(videoSettingsUI_->vaq->currentIndex()), settings_);
+  saveCheckBox("video/keyframesOnRequest", videoSettingsUI_->keyframes_on_request, settings_);
 
   // compression-tab
   settings_.setValue("video/Preset",       videoSettingsUI_->preset->currentText());
   listGUIToSettings("kvazzup.ini", "parameters", QStringList() << "Name" << "Value", videoSettingsUI_->custom_parameters);
 
   // Other-tab
-  saveCheckBox("video/opengl",             videoSettingsUI_->opengl, settings_);
+  saveCheckBox("video/softwareRendering",  videoSettingsUI_->software_rendering, settings_);
   saveCheckBox("video/flipViews",          videoSettingsUI_->flip, settings_);
 }
 
@@ -305,6 +310,10 @@ void VideoSettings::restoreSettings()
     videoSettingsUI_->openhevc_threads->setValue(settings_.value("video/OPENHEVC_threads").toInt());
     videoSettingsUI_->yuv_threads->setValue(settings_.value("video/yuvThreads").toInt());
     videoSettingsUI_->rgb32_threads->setValue(settings_.value("video/rgbThreads").toInt());
+    restoreCheckBox("video/filterPool", videoSettingsUI_->filter_pool, settings_);
+    restoreCheckBox("video/filterTrace", videoSettingsUI_->filter_trace, settings_);
+    videoSettingsUI_->backpressure->setCurrentIndex(settings_.value("video/backpressure").toInt());
+    videoSettingsUI_->simulcast_layers->setValue(settings_.value("video/simulcastLayers").toInt());
 
     updateSliceBoxStatus();
 
@@ -326,6 +335,7 @@ void VideoSettings::restoreSettings()
     restoreCheckBox("video/qpInCU", videoSettingsUI_->qp_in_cu_box, settings_);
 
     videoSettingsUI_->vaq->setCurrentIndex( settings_.value("video/vaq").toInt());
+    restoreCheckBox("video/keyframesOnRequest", videoSettingsUI_->keyframes_on_request, settings_);
 
     updateObaStatus(videoSettingsUI_->rc_algorithm->currentIndex());
 
@@ -336,7 +346,7 @@ void VideoSettings::restoreSettings()
                       videoSettingsUI_->custom_parameters);
 
     // other-tab
-    restoreCheckBox("video/opengl", videoSettingsUI_->opengl, settings_);
+    restoreCheckBox("video/softwareRendering", videoSettingsUI_->software_rendering, settings_);
     restoreCheckBox("video/flipViews", videoSettingsUI_->flip, settings_);
   }
   else
@@ -0,0 +1,133 @@
+#include "media/processing/sequenceextender.h"
+
+#include <cstdio>
+#include <vector>
+
+// Checks that the jitter buffer keeps the packet order when the 16-bit RTP
+// sequence numbers wrap around and packets arrive out of order.
+//
+// Usage: sequenceextendertest
+
+static int failures = 0;
+
+
+static void check(bool condition, const char* test, const char* what)
+{
+  if (!condition)
+  {
+    std::printf("FAIL %s: %s\n", test, what);
+    ++failures;
+  }
+}
+
+
+// Extends the sequence numbers in arrival order and checks that each one
+// ends up at its expected distance from the first.
+static void checkOrder(const char* test, const std::vector<uint16_t>& arrivals,
+                       const std::vector<int>& offsets)
+{
+  SequenceExtender extender;
+  uint32_t first = extender.extend(arrivals.front());
+
+  for (size_t i = 1; i < arrivals.size(); ++i)
+  {
+    uint32_t extended = extender.extend(arrivals[i]);
+    if ((int64_t)extended - first != offsets[i])
+    {
+      std::printf("FAIL %s: packet %u was placed at %lld instead of %d\n", test,
+                  arrivals[i], (long long)extended - first, offsets[i]);
+      ++failures;
+    }
+  }
+}
+
+
+static void testInOrderWrap()
+{
+  checkOrder("in order wrap", {65533, 65534, 65535, 0, 1, 2}, {0, 1, 2, 3, 4, 5});
+}
+
+
+static void testReorderedAfterWrap()
+{
+  // 65535 arrives after the sequence has already wrapped
+  checkOrder("reordered after wrap", {65534, 0, 65535, 1}, {0, 2, 1, 3});
+}
+
+
+static void testReorderedBeforeWrap()
+{
+  // 0 arrives before 65535
+  checkOrder("reordered before wrap", {65534, 0, 1, 65535, 2}, {0, 2, 3, 1, 4});
+}
+
+
+static void testOlderThanFirst()
+{
+  // the stream starts just after the wrap and a late packet from before it arrives
+  SequenceExtender extender;
+  uint32_t first = extender.extend(3);
+  uint32_t late = extender.extend(65534);
+
+  check(late < first, "older than first", "late packet is not before the first one");
+  check(first - late == 5, "older than first", "late packet is at the wrong distance");
+  check(extender.highest() == first, "older than first", "late packet changed the highest");
+
+  uint32_t next = extender.extend(4);
+  check(next == first + 1, "older than first", "next packet is not after the first one");
+}
+
+
+static void testOlderDoesNotLowerHighest()
+{
+  SequenceExtender extender;
+  extender.extend(65535);
+  uint32_t highest = extender.extend(2);
+  extender.extend(0);
+  extender.extend(65534);
+
+  check(extender.highest() == highest, "older does not lower highest",
+        "reordered packets moved the highest back");
+}
+
+
+static void testManyWraps()
+{
+  // pairs of packets are swapped over several wraparounds
+  SequenceExtender extender;
+  uint32_t first = extender.extend(65000);
+  bool ordered = true;
+
+  for (uint32_t i = 1; i + 1 < 4*65536; i += 2)
+  {
+    uint32_t second = extender.extend((uint16_t)(65000 + i + 1));
+    uint32_t earlier = extender.extend((uint16_t)(65000 + i));
+
+    if (earlier != first + i || second != first + i + 1)
+    {
+      ordered = false;
+    }
+  }
+
+  check(ordered, "many wraps", "swapped packets lost their order");
+}
+
+
+int main()
+{
+  testInOrderWrap();
+  testReorderedAfterWrap();
+  testReorderedBeforeWrap();
+  testOlderThanFirst();
+  testOlderDoesNotLowerHighest();
+  testManyWraps();
+
+  if (failures == 0)
+  {
+    std::printf("All sequence extension tests passed\n");
+    return 0;
+  }
+
+  std::printf("%d sequence extension checks failed\n", failures);
+  return 1;
+}
@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Tests the extension of RTP sequence numbers around the wraparound.
+# Build and run separately from Kvazzup:
+#   qmake sequenceextendertest.pro && make && ./sequenceextendertest
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = sequenceextendertest
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    sequenceextendertest.cpp
+
+HEADERS += \
+    ../src/media/processing/sequenceextender.h